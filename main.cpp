@@ -1,15 +1,40 @@
 #include "FileRunner.h"
+#include "Optimizer.h"
 #include "REPL.h"
 #include "utilities.h"
 #include <iostream>
+#include <string>
 
 int main(int argc, char *argv[]) {
-  if (argc >= 2) {
-    return FileRunner::run(argv[1]);
+  auto level = O1;
+  auto mode = RUNTIME_SINGLE_THREADED;
+  std::string path;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-O0") {
+      level = O0;
+    } else if (arg == "-O1") {
+      level = O1;
+    } else if (arg == "-O2") {
+      level = O2;
+    } else if (arg == "--parallel") {
+      mode = RUNTIME_PARALLEL;
+    } else if (arg.starts_with("-")) {
+      std::cerr << "monkey: unknown option: " << arg << std::endl;
+      std::cerr << "usage: monkey [-O0|-O1|-O2] [--parallel] [file]"
+                << std::endl;
+      return 1;
+    } else {
+      path = arg;
+    }
+  }
+
+  if (!path.empty()) {
+    return FileRunner::run(path, level, mode);
   }
   std::cout << "Hello " << getCurrentUser()
             << "! This is the monkey programming language!" << std::endl;
   std::cout << "Feel free to type in commands" << std::endl;
-  REPL::start();
+  REPL::start(level);
   return 0;
 }
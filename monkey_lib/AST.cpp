@@ -1,5 +1,16 @@
 #include "AST.h"
 
+#include <unordered_map>
+
+InfixOperator lookupInfixOperator(const std::string &op) {
+  static const std::unordered_map<std::string, InfixOperator> operators = {
+      {"+", OP_PLUS}, {"-", OP_MINUS}, {"*", OP_ASTERISK}, {"/", OP_SLASH},
+      {"<", OP_LT},   {">", OP_GT},    {"==", OP_EQ},      {"!=", OP_NOT_EQ},
+  };
+  auto it = operators.find(op);
+  return it != operators.end() ? it->second : OP_UNKNOWN;
+}
+
 std::string Identifier::tokenLiteral() { return token.literal; }
 void Identifier::expressionNode() {}
 NodeType Identifier::nodeType() { return IDENTIFIER; }
@@ -79,6 +90,41 @@ std::string ArrayLiteralExpression::string() {
   return out;
 }
 
+std::string HashLiteralExpression::tokenLiteral() { return token.literal; }
+void HashLiteralExpression::expressionNode() {}
+NodeType HashLiteralExpression::nodeType() { return HASH_LITERAL; }
+std::string HashLiteralExpression::string() {
+  std::string out = "{";
+  for (size_t i = 0; i < pairs.size(); i++) {
+    out += pairs[i].first->string() + ": " + pairs[i].second->string();
+    if (i != pairs.size() - 1)
+      out += ", ";
+  }
+  out += "}";
+  return out;
+}
+
+std::string RecordLiteralExpression::tokenLiteral() { return token.literal; }
+void RecordLiteralExpression::expressionNode() {}
+NodeType RecordLiteralExpression::nodeType() { return RECORD_LITERAL; }
+std::string RecordLiteralExpression::string() {
+  std::string out = "record {";
+  for (size_t i = 0; i < names.size(); i++) {
+    out += names[i] + ": " + values[i]->string();
+    if (i != names.size() - 1)
+      out += ", ";
+  }
+  out += "}";
+  return out;
+}
+
+std::string FieldExpression::tokenLiteral() { return token.literal; }
+void FieldExpression::expressionNode() {}
+NodeType FieldExpression::nodeType() { return FIELD_EXPRESSION; }
+std::string FieldExpression::string() {
+  return "(" + left->string() + "." + name + ")";
+}
+
 std::string PrefixExpression::tokenLiteral() { return token.literal; }
 void PrefixExpression::expressionNode() {}
 NodeType PrefixExpression::nodeType() { return PREFIX_EXPRESSION; }
@@ -124,6 +170,28 @@ std::string IfExpression::string() {
   return out;
 }
 
+std::string WhileExpression::tokenLiteral() { return token.literal; }
+void WhileExpression::expressionNode() {}
+NodeType WhileExpression::nodeType() { return WHILE_EXPRESSION; }
+std::string WhileExpression::string() {
+  return "while" + condition->string() + " " + body->string();
+}
+
+std::string ForExpression::tokenLiteral() { return token.literal; }
+void ForExpression::expressionNode() {}
+NodeType ForExpression::nodeType() { return FOR_EXPRESSION; }
+std::string ForExpression::string() {
+  return "for(" + variable->string() + " in " + iterable->string() + ") " +
+         body->string();
+}
+
+std::string AssignExpression::tokenLiteral() { return token.literal; }
+void AssignExpression::expressionNode() {}
+NodeType AssignExpression::nodeType() { return ASSIGN_EXPRESSION; }
+std::string AssignExpression::string() {
+  return "(" + target->string() + " = " + value->string() + ")";
+}
+
 std::string BlockStatement::tokenLiteral() { return token.literal; }
 void BlockStatement::statementNode() {}
 NodeType BlockStatement::nodeType() { return BLOCK_STATEMENT; }
@@ -174,3 +242,108 @@ std::string IndexExpression::string() {
   out += "])";
   return out;
 }
+
+
+void forEachChild(const NodePtr &node,
+                  const std::function<void(const NodePtr &)> &visit) {
+  auto visitIfPresent = [&](const NodePtr &child) {
+    if (child != nullptr)
+      visit(child);
+  };
+
+  switch (node->nodeType()) {
+  case PROGRAM:
+    for (const auto &statement :
+         std::static_pointer_cast<Program>(node)->statements)
+      visitIfPresent(statement);
+    break;
+  case BLOCK_STATEMENT:
+    for (const auto &statement :
+         std::static_pointer_cast<BlockStatement>(node)->statements)
+      visitIfPresent(statement);
+    break;
+  case LET_STATEMENT:
+    visitIfPresent(std::static_pointer_cast<LetStatement>(node)->value);
+    break;
+  case RETURN_STATEMENT:
+    visitIfPresent(std::static_pointer_cast<ReturnStatement>(node)->returnValue);
+    break;
+  case EXPRESSION_STATEMENT:
+    visitIfPresent(
+        std::static_pointer_cast<ExpressionStatement>(node)->expression);
+    break;
+  case PREFIX_EXPRESSION:
+    visitIfPresent(std::static_pointer_cast<PrefixExpression>(node)->right);
+    break;
+  case INFIX_EXPRESSION: {
+    auto infix = std::static_pointer_cast<InfixExpression>(node);
+    visitIfPresent(infix->left);
+    visitIfPresent(infix->right);
+    break;
+  }
+  case IF_EXPRESSION: {
+    auto ifExpression = std::static_pointer_cast<IfExpression>(node);
+    visitIfPresent(ifExpression->condition);
+    visitIfPresent(ifExpression->consequence);
+    visitIfPresent(ifExpression->alternative);
+    break;
+  }
+  case WHILE_EXPRESSION: {
+    auto loop = std::static_pointer_cast<WhileExpression>(node);
+    visitIfPresent(loop->condition);
+    visitIfPresent(loop->body);
+    break;
+  }
+  case FOR_EXPRESSION: {
+    auto loop = std::static_pointer_cast<ForExpression>(node);
+    visitIfPresent(loop->iterable);
+    visitIfPresent(loop->body);
+    break;
+  }
+  case ASSIGN_EXPRESSION: {
+    auto assign = std::static_pointer_cast<AssignExpression>(node);
+    visitIfPresent(assign->target);
+    visitIfPresent(assign->value);
+    break;
+  }
+  case FUNCTION_LITERAL:
+    visitIfPresent(
+        std::static_pointer_cast<FunctionLiteralExpression>(node)->body);
+    break;
+  case CALL_EXPRESSION: {
+    auto call = std::static_pointer_cast<CallExpression>(node);
+    visitIfPresent(call->function);
+    for (const auto &argument : call->arguments)
+      visitIfPresent(argument);
+    break;
+  }
+  case ARRAY_LITERAL:
+    for (const auto &element :
+         std::static_pointer_cast<ArrayLiteralExpression>(node)->elements)
+      visitIfPresent(element);
+    break;
+  case INDEX_EXPRESSION: {
+    auto index = std::static_pointer_cast<IndexExpression>(node);
+    visitIfPresent(index->left);
+    visitIfPresent(index->index);
+    break;
+  }
+  case HASH_LITERAL:
+    for (const auto &[key, value] :
+         std::static_pointer_cast<HashLiteralExpression>(node)->pairs) {
+      visitIfPresent(key);
+      visitIfPresent(value);
+    }
+    break;
+  case RECORD_LITERAL:
+    for (const auto &value :
+         std::static_pointer_cast<RecordLiteralExpression>(node)->values)
+      visitIfPresent(value);
+    break;
+  case FIELD_EXPRESSION:
+    visitIfPresent(std::static_pointer_cast<FieldExpression>(node)->left);
+    break;
+  default:
+    break;
+  }
+}
\ No newline at end of file
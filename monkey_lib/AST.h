@@ -1,11 +1,27 @@
 #ifndef MONKEY_AST_H
 #define MONKEY_AST_H
 
+#include "Allocator.h"
 #include "Token.h"
+#include <functional>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
+class Object;
+class Shape;
+struct ShapeField;
+struct FunctionPrototype;
+
+// Creates an AST node (and its shared_ptr control block) through the current
+// runtime allocator.
+template <typename T, typename... Args>
+std::shared_ptr<T> makeNode(Args &&...args) {
+  return std::allocate_shared<T>(RuntimeStlAllocator<T>(),
+                                 std::forward<Args>(args)...);
+}
+
 enum NodeType {
   PROGRAM,
   LET_STATEMENT,
@@ -23,6 +39,40 @@ enum NodeType {
   CALL_EXPRESSION,
   ARRAY_LITERAL,
   INDEX_EXPRESSION,
+  WHILE_EXPRESSION,
+  FOR_EXPRESSION,
+  ASSIGN_EXPRESSION,
+  HASH_LITERAL,
+  RECORD_LITERAL,
+  FIELD_EXPRESSION,
+};
+
+// Infix operators decoded once so quickened nodes can dispatch on them
+// without comparing strings.
+enum InfixOperator {
+  OP_UNKNOWN,
+  OP_PLUS,
+  OP_MINUS,
+  OP_ASTERISK,
+  OP_SLASH,
+  OP_LT,
+  OP_GT,
+  OP_EQ,
+  OP_NOT_EQ,
+};
+
+InfixOperator lookupInfixOperator(const std::string &op);
+
+// Runtime specialization state of a node. Nodes start out UNSPECIALIZED,
+// rewrite themselves to a fast variant after their first execution and fall
+// back to GENERIC for good as soon as a type guard fails.
+enum Specialization {
+  UNSPECIALIZED,
+  SPECIALIZED_INTEGER,
+  SPECIALIZED_STRING,
+  SPECIALIZED_FUNCTION,
+  SPECIALIZED_BUILTIN,
+  GENERIC,
 };
 
 class Node {
@@ -40,9 +90,16 @@ public:
 typedef std::shared_ptr<Statement> StatementPtr;
 typedef std::vector<StatementPtr> StatementPtrVec;
 
+// Type of an expression proven ahead of execution by TypeInferencePass.
+enum StaticType { TYPE_UNKNOWN, TYPE_INTEGER, TYPE_BOOLEAN };
+
 class Expression : public Node {
 public:
   virtual void expressionNode() = 0;
+
+  StaticType staticType = TYPE_UNKNOWN;
+  // Set by EffectAnalysis when evaluating the expression has no side effects.
+  bool pure = false;
 };
 typedef std::shared_ptr<Expression> ExpressionPtr;
 typedef std::vector<ExpressionPtr> ExpressionPtrVec;
@@ -56,6 +113,10 @@ public:
 
   Token token;
   std::string value;
+
+  Specialization specialization = UNSPECIALIZED;
+  // Not owned: builtins live for the whole program.
+  Object *cachedBuiltin = nullptr;
 };
 typedef std::shared_ptr<Identifier> IdentifierPtr;
 typedef std::vector<IdentifierPtr> IdentifierPtrVec;
@@ -151,6 +212,7 @@ public:
   std::string operator_;
   ExpressionPtr right;
 };
+typedef std::shared_ptr<PrefixExpression> PrefixExpressionPtr;
 
 class InfixExpression : public Expression {
 public:
@@ -163,7 +225,11 @@ public:
   ExpressionPtr left;
   std::string operator_;
   ExpressionPtr right;
+
+  Specialization specialization = UNSPECIALIZED;
+  InfixOperator opcode = OP_UNKNOWN;
 };
+typedef std::shared_ptr<InfixExpression> InfixExpressionPtr;
 
 class BooleanLiteralExpression : public Expression {
 public:
@@ -202,6 +268,46 @@ public:
 };
 typedef std::shared_ptr<IfExpression> IfExpressionPtr;
 
+// Loops evaluate to null. Their bodies run in the enclosing scope, so lets in
+// a body rebind the same names on every iteration.
+class WhileExpression : public Expression {
+public:
+  std::string tokenLiteral() override;
+  void expressionNode() override;
+  std::string string() override;
+  NodeType nodeType() override;
+
+  Token token;
+  ExpressionPtr condition;
+  BlockStatementPtr body;
+};
+typedef std::shared_ptr<WhileExpression> WhileExpressionPtr;
+
+class ForExpression : public Expression {
+public:
+  std::string tokenLiteral() override;
+  void expressionNode() override;
+  std::string string() override;
+  NodeType nodeType() override;
+
+  Token token;
+  IdentifierPtr variable;
+  ExpressionPtr iterable;
+  BlockStatementPtr body;
+};
+typedef std::shared_ptr<ForExpression> ForExpressionPtr;
+
+enum EscapeState { ESCAPE_UNANALYZED, ESCAPE_LOCAL, ESCAPE_ESCAPES };
+// How a closure holds on to the variables of its enclosing functions: not at
+// all (lifted to the global environment), by copying the captured values
+// into a flat environment, or by keeping the whole environment chain.
+enum CaptureMode {
+  CAPTURE_UNANALYZED,
+  CAPTURE_NONE,
+  CAPTURE_FLAT,
+  CAPTURE_CHAIN
+};
+
 class FunctionLiteralExpression : public Expression {
 public:
   std::string tokenLiteral() override;
@@ -212,6 +318,17 @@ public:
   Token token;
   IdentifierPtrVec parameters;
   BlockStatementPtr body;
+
+  EscapeState escapeState = ESCAPE_UNANALYZED;
+  CaptureMode captureMode = CAPTURE_UNANALYZED;
+  std::vector<std::string> captures;
+  // Number of distinct names bound by parameters and lets in the body.
+  size_t frameSize = 0;
+  // Set by EffectAnalysis when calling the function has no side effects.
+  bool pureBody = false;
+  // Built by the evaluator the first time the literal runs and shared by all
+  // closures created from it.
+  std::shared_ptr<FunctionPrototype> prototype;
 };
 typedef std::shared_ptr<FunctionLiteralExpression> FunctionLiteralExpressionPtr;
 
@@ -225,6 +342,8 @@ public:
   Token token;
   ExpressionPtr function;
   ExpressionPtrVec arguments;
+
+  Specialization specialization = UNSPECIALIZED;
 };
 typedef std::shared_ptr<CallExpression> CallExpressionPtr;
 
@@ -240,4 +359,73 @@ public:
   ExpressionPtr index;
 };
 
+// `{k: v, ...}`. Keys and values are evaluated in the order written.
+class HashLiteralExpression : public Expression {
+public:
+  std::string tokenLiteral() override;
+  void expressionNode() override;
+  std::string string() override;
+  NodeType nodeType() override;
+
+  Token token;
+  std::vector<std::pair<ExpressionPtr, ExpressionPtr>> pairs;
+};
+typedef std::shared_ptr<HashLiteralExpression> HashLiteralExpressionPtr;
+
+// `record {name: v, ...}`. Values are evaluated in the order written.
+class RecordLiteralExpression : public Expression {
+public:
+  std::string tokenLiteral() override;
+  void expressionNode() override;
+  std::string string() override;
+  NodeType nodeType() override;
+
+  Token token;
+  std::vector<std::string> names;
+  ExpressionPtrVec values;
+
+  // The shape of the records the literal creates, found on its first
+  // evaluation.
+  const Shape *shape = nullptr;
+};
+typedef std::shared_ptr<RecordLiteralExpression> RecordLiteralExpressionPtr;
+
+// `r.name`. The node caches the field it last found, so reading a record of
+// the same shape again only compares the shape before loading the slot.
+class FieldExpression : public Expression {
+public:
+  std::string tokenLiteral() override;
+  void expressionNode() override;
+  std::string string() override;
+  NodeType nodeType() override;
+
+  Token token;
+  ExpressionPtr left;
+  std::string name;
+
+  const ShapeField *cachedField = nullptr;
+};
+typedef std::shared_ptr<FieldExpression> FieldExpressionPtr;
+
+// Rebinds an existing variable (`x = v`) or stores into an array element, a
+// hash or a record field (`a[i] = v`, `r.f = v`); evaluates to the value
+// stored.
+class AssignExpression : public Expression {
+public:
+  std::string tokenLiteral() override;
+  void expressionNode() override;
+  std::string string() override;
+  NodeType nodeType() override;
+
+  Token token;
+  // An Identifier, an IndexExpression or a FieldExpression.
+  ExpressionPtr target;
+  ExpressionPtr value;
+};
+typedef std::shared_ptr<AssignExpression> AssignExpressionPtr;
+
+// Calls `visit` on each direct child of `node`, in evaluation order.
+void forEachChild(const NodePtr &node,
+                  const std::function<void(const NodePtr &)> &visit);
+
 #endif // MONKEY_AST_H
@@ -0,0 +1,94 @@
+#include "Allocator.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+Allocator *Allocator::current() {
+  return _current != nullptr ? _current : &defaultAllocator();
+}
+
+Allocator &Allocator::defaultAllocator() {
+  static MallocAllocator allocator;
+  return allocator;
+}
+
+void *MallocAllocator::allocate(size_t size) {
+  if (size <= SlabAllocator::maxBlockSize)
+    return SlabAllocator::allocate(size);
+  auto pointer = std::malloc(size);
+  if (pointer == nullptr)
+    throw std::bad_alloc();
+  return pointer;
+}
+
+void MallocAllocator::deallocate(void *pointer, size_t size) {
+  if (size <= SlabAllocator::maxBlockSize)
+    SlabAllocator::deallocate(pointer, size);
+  else
+    std::free(pointer);
+}
+
+RegionAllocator::RegionAllocator(size_t chunkSize) : _chunkSize(chunkSize) {}
+
+RegionAllocator::~RegionAllocator() { release(); }
+
+void *RegionAllocator::allocate(size_t size) {
+  size = SlabAllocator::sizeClass(std::max<size_t>(size, 1));
+  _bytesAllocated += size;
+  // Large blocks get a chunk of their own so they do not waste the current
+  // one.
+  if (size > _chunkSize / 4)
+    return _newChunk(size);
+  if (static_cast<size_t>(_limit - _cursor) < size) {
+    _cursor = _newChunk(_chunkSize);
+    _limit = _cursor + _chunkSize;
+  }
+  auto block = _cursor;
+  _cursor += size;
+  return block;
+}
+
+void RegionAllocator::deallocate(void *, size_t) {}
+
+void RegionAllocator::release() {
+  while (_chunks != nullptr) {
+    auto next = _chunks->next;
+    ::operator delete(_chunks);
+    _chunks = next;
+  }
+  _cursor = _limit = nullptr;
+  _bytesAllocated = 0;
+  _bytesReserved = 0;
+}
+
+char *RegionAllocator::_newChunk(size_t size) {
+  auto chunk = static_cast<Chunk *>(::operator new(_chunkHeader + size));
+  chunk->next = _chunks;
+  chunk->size = size;
+  _chunks = chunk;
+  _bytesReserved += _chunkHeader + size;
+  return reinterpret_cast<char *>(chunk) + _chunkHeader;
+}
+
+static_assert(sizeof(Allocator *) % alignof(std::max_align_t) != 0);
+
+void *allocateBlock(size_t size) {
+  if (Allocator::_current == nullptr)
+    return Allocator::defaultAllocator().allocate(size);
+  auto allocator = Allocator::_current;
+  auto block = static_cast<Allocator **>(
+      allocator->allocate(size + sizeof(Allocator *)));
+  *block = allocator;
+  return block + 1;
+}
+
+void deallocateBlock(void *pointer, size_t size) {
+  if (reinterpret_cast<uintptr_t>(pointer) % alignof(std::max_align_t) == 0) {
+    Allocator::defaultAllocator().deallocate(pointer, size);
+    return;
+  }
+  auto block = static_cast<Allocator **>(pointer) - 1;
+  (*block)->deallocate(block, size + sizeof(Allocator *));
+}
@@ -0,0 +1,163 @@
+#ifndef MONKEY_ALLOCATOR_H
+#define MONKEY_ALLOCATOR_H
+
+#include "SlabAllocator.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+// Where the runtime gets its memory. Objects, environments, AST nodes and
+// string buffers are allocated from the allocator current on the allocating
+// thread (see AllocatorScope) and always returned to the one they came from.
+class Allocator {
+public:
+  virtual ~Allocator() = default;
+
+  // Returns at least `size` bytes aligned to alignof(std::max_align_t).
+  virtual void *allocate(size_t size) = 0;
+  // `size` is the size the block was allocated with.
+  virtual void deallocate(void *pointer, size_t size) = 0;
+
+  static Allocator *current();
+  static Allocator &defaultAllocator();
+
+private:
+  friend class AllocatorScope;
+  friend void *allocateBlock(size_t size);
+
+  static inline thread_local Allocator *_current = nullptr;
+};
+
+// The default backend: the system heap, with small blocks served from the
+// per-thread slabs.
+class MallocAllocator final : public Allocator {
+public:
+  void *allocate(size_t size) override;
+  void deallocate(void *pointer, size_t size) override;
+};
+
+// Bump-pointer allocation from large chunks. Individual frees are ignored;
+// release() returns the chunks at once. A region is meant for one isolate
+// and must not be shared between threads. release() does not run
+// destructors: everything allocated from the region has to be destroyed
+// before it is released, since objects may own memory elsewhere and hold
+// references to objects outside the region.
+class RegionAllocator : public Allocator {
+public:
+  explicit RegionAllocator(size_t chunkSize = 64 * 1024);
+  ~RegionAllocator() override;
+  RegionAllocator(const RegionAllocator &) = delete;
+  RegionAllocator &operator=(const RegionAllocator &) = delete;
+
+  void *allocate(size_t size) override;
+  void deallocate(void *pointer, size_t size) override;
+
+  void release();
+
+  // Bytes handed out since the last release, including freed ones.
+  size_t bytesAllocated() const { return _bytesAllocated; }
+  // Bytes of chunk memory the region currently holds.
+  size_t bytesReserved() const { return _bytesReserved; }
+
+private:
+  struct Chunk {
+    Chunk *next;
+    size_t size;
+  };
+  static constexpr size_t _chunkHeader =
+      (sizeof(Chunk) + alignof(std::max_align_t) - 1) /
+      alignof(std::max_align_t) * alignof(std::max_align_t);
+
+  char *_newChunk(size_t size);
+
+  size_t _chunkSize;
+  Chunk *_chunks = nullptr;
+  char *_cursor = nullptr;
+  char *_limit = nullptr;
+  size_t _bytesAllocated = 0;
+  size_t _bytesReserved = 0;
+};
+
+// Makes `allocator` current on this thread for the lifetime of the scope. A
+// null allocator leaves the current one in place.
+class AllocatorScope {
+public:
+  explicit AllocatorScope(Allocator *allocator)
+      : _previous(Allocator::_current) {
+    if (allocator != nullptr)
+      Allocator::_current = allocator;
+  }
+  ~AllocatorScope() { Allocator::_current = _previous; }
+  AllocatorScope(const AllocatorScope &) = delete;
+  AllocatorScope &operator=(const AllocatorScope &) = delete;
+
+private:
+  Allocator *_previous;
+};
+
+// Runtime blocks can be freed whichever allocator is current by then. Those
+// of the default allocator are handed out as they are; those of any other
+// allocator are prefixed with the allocator they came from, which leaves
+// them only pointer-aligned. The alignment tells the two apart.
+void *allocateBlock(size_t size);
+void deallocateBlock(void *pointer, size_t size);
+
+// Gives T class-specific operator new/delete through the current allocator
+// and counts its instances.
+template <typename T> class RuntimeAllocated {
+public:
+  static void *operator new(size_t size) {
+    static_assert(alignof(T) <= alignof(void *));
+    if (size == sizeof(T))
+      AllocationCounter<T>::allocated();
+    return allocateBlock(size);
+  }
+
+  static void operator delete(void *pointer, size_t size) {
+    if (size == sizeof(T))
+      AllocationCounter<T>::freed();
+    deallocateBlock(pointer, size);
+  }
+};
+
+// Standard allocator over the current allocator, for containers and
+// std::allocate_shared. Single-object allocations are counted against
+// `Counted` unless it is void.
+template <typename T, typename Counted = void> class RuntimeStlAllocator {
+public:
+  using value_type = T;
+
+  RuntimeStlAllocator() = default;
+  template <typename U>
+  RuntimeStlAllocator(const RuntimeStlAllocator<U, Counted> &) {}
+
+  T *allocate(size_t n) {
+    static_assert(alignof(T) <= alignof(void *));
+    if constexpr (!std::is_void_v<Counted>) {
+      if (n == 1)
+        AllocationCounter<Counted>::allocated();
+    }
+    return static_cast<T *>(allocateBlock(n * sizeof(T)));
+  }
+
+  void deallocate(T *pointer, size_t n) {
+    if constexpr (!std::is_void_v<Counted>) {
+      if (n == 1)
+        AllocationCounter<Counted>::freed();
+    }
+    deallocateBlock(pointer, n * sizeof(T));
+  }
+};
+
+template <typename T, typename U, typename Counted>
+bool operator==(const RuntimeStlAllocator<T, Counted> &,
+                const RuntimeStlAllocator<U, Counted> &) {
+  return true;
+}
+
+typedef std::basic_string<char, std::char_traits<char>,
+                          RuntimeStlAllocator<char>>
+    RuntimeString;
+
+#endif // MONKEY_ALLOCATOR_H
@@ -0,0 +1,163 @@
+#include "EffectAnalysis.h"
+
+#include <algorithm>
+
+// Builtins that only read their arguments; `push`, `put` and `delete` change
+// their first argument and memoized functions update their cache.
+static const std::set<std::string> pureBuiltins = {
+    "len", "first", "last", "rest", "slice", "concat", "sum", "min", "max",
+    "dot", "contains", "pairwiseEqual", "pairwiseLess", "pairwiseGreater",
+    "keys", "values", "substr", "split", "lines", "indexOf", "startsWith",
+    "count", "replace"};
+
+void EffectAnalysis::analyze(const ProgramPtr &program) {
+  EffectAnalysis analysis;
+
+  std::vector<Binding> bindings;
+  _bindings(program, bindings);
+  std::unordered_map<std::string, int> sites;
+  for (const auto &[name, value] : bindings) {
+    analysis._globals.insert(name);
+    sites[name]++;
+  }
+  std::set<std::string> assigned;
+  _assignedNames(program, assigned);
+  for (const auto &[name, value] : bindings) {
+    if (sites[name] == 1 && !assigned.contains(name) && value != nullptr &&
+        value->nodeType() == FUNCTION_LITERAL)
+      analysis._functions[name] =
+          static_cast<FunctionLiteralExpression *>(value);
+  }
+
+  // Every function starts out pure and loses that until nothing changes, so
+  // recursive functions can stay pure.
+  _assumePure(program);
+  do {
+    analysis._changed = false;
+    analysis._visit(program);
+  } while (analysis._changed);
+}
+
+EffectAnalysis::Effect EffectAnalysis::_visit(const NodePtr &node) {
+  auto effect = NO_EFFECT;
+  auto visitChildren = [&] {
+    forEachChild(node, [&](const NodePtr &child) {
+      effect = std::max(effect, _visit(child));
+    });
+  };
+
+  switch (node->nodeType()) {
+  case FUNCTION_LITERAL: {
+    // Creating a closure has no effect; calling it has those of its body
+    // beyond its own frame.
+    auto function = static_cast<FunctionLiteralExpression *>(node.get());
+    std::set<std::string> names;
+    for (const auto &parameter : function->parameters)
+      names.insert(parameter->value);
+    std::vector<Binding> bindings;
+    if (function->body != nullptr)
+      _bindings(function->body, bindings);
+    for (const auto &binding : bindings)
+      names.insert(binding.first);
+
+    _scopes.push_back(std::move(names));
+    auto body = function->body != nullptr ? _visit(function->body) : NO_EFFECT;
+    _scopes.pop_back();
+    if (function->pureBody && body == HAS_EFFECTS) {
+      function->pureBody = false;
+      _changed = true;
+    }
+    break;
+  }
+  case CALL_EXPRESSION:
+    visitChildren();
+    if (!_isPureCallee(static_cast<CallExpression *>(node.get())->function))
+      effect = HAS_EFFECTS;
+    break;
+  case LET_STATEMENT:
+  case FOR_EXPRESSION:
+    visitChildren();
+    effect = std::max(effect, BINDS_LOCALLY);
+    break;
+  case ASSIGN_EXPRESSION: {
+    // Rebinding a name of the innermost function stays within its frame;
+    // anything else, including storing into an array, is visible outside.
+    visitChildren();
+    auto target = static_cast<AssignExpression *>(node.get())->target;
+    if (target->nodeType() == IDENTIFIER && !_scopes.empty() &&
+        _scopes.back().contains(
+            static_cast<Identifier *>(target.get())->value))
+      effect = std::max(effect, BINDS_LOCALLY);
+    else
+      effect = HAS_EFFECTS;
+    break;
+  }
+  default:
+    visitChildren();
+    break;
+  }
+
+  if (auto expression = dynamic_cast<Expression *>(node.get()))
+    expression->pure = effect == NO_EFFECT;
+  return effect;
+}
+
+bool EffectAnalysis::_isPureCallee(const ExpressionPtr &callee) const {
+  if (callee->nodeType() == FUNCTION_LITERAL)
+    return static_cast<FunctionLiteralExpression *>(callee.get())->pureBody;
+  if (callee->nodeType() != IDENTIFIER)
+    return false;
+
+  auto &name = static_cast<Identifier *>(callee.get())->value;
+  if (_isLocal(name))
+    return false;
+  auto function = _functions.find(name);
+  if (function != _functions.end())
+    return function->second->pureBody;
+  return !_globals.contains(name) && pureBuiltins.contains(name);
+}
+
+bool EffectAnalysis::_isLocal(const std::string &name) const {
+  return std::any_of(
+      _scopes.begin(), _scopes.end(),
+      [&name](const std::set<std::string> &scope) {
+        return scope.contains(name);
+      });
+}
+
+// Collects the lets and loop variables that bind in the scope of `node`,
+// i.e. all of them except those in nested functions.
+void EffectAnalysis::_bindings(const NodePtr &node,
+                               std::vector<Binding> &bindings) {
+  if (node->nodeType() == FUNCTION_LITERAL)
+    return;
+  if (node->nodeType() == LET_STATEMENT) {
+    auto let = static_cast<LetStatement *>(node.get());
+    bindings.emplace_back(let->name->value, let->value.get());
+  } else if (node->nodeType() == FOR_EXPRESSION) {
+    auto loop = static_cast<ForExpression *>(node.get());
+    bindings.emplace_back(loop->variable->value, nullptr);
+  }
+  forEachChild(node, [&bindings](const NodePtr &child) {
+    _bindings(child, bindings);
+  });
+}
+
+// Collects the names assigned to anywhere below `node`.
+void EffectAnalysis::_assignedNames(const NodePtr &node,
+                                    std::set<std::string> &names) {
+  if (node->nodeType() == ASSIGN_EXPRESSION) {
+    auto target = static_cast<AssignExpression *>(node.get())->target;
+    if (target->nodeType() == IDENTIFIER)
+      names.insert(static_cast<Identifier *>(target.get())->value);
+  }
+  forEachChild(node, [&names](const NodePtr &child) {
+    _assignedNames(child, names);
+  });
+}
+
+void EffectAnalysis::_assumePure(const NodePtr &node) {
+  if (node->nodeType() == FUNCTION_LITERAL)
+    static_cast<FunctionLiteralExpression *>(node.get())->pureBody = true;
+  forEachChild(node, [](const NodePtr &child) { _assumePure(child); });
+}
@@ -0,0 +1,46 @@
+#ifndef MONKEY_EFFECTANALYSIS_H
+#define MONKEY_EFFECTANALYSIS_H
+
+#include "AST.h"
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Finds the expressions whose evaluation has no side effects, which may
+// therefore be evaluated in any order or at the same time. A call is only
+// pure when the analysis can tell what it calls: a builtin that does not
+// mutate its arguments, or a function bound by a single top-level let, never
+// reassigned, whose body is pure in turn.
+class EffectAnalysis {
+public:
+  // Sets Expression::pure and FunctionLiteralExpression::pureBody throughout
+  // the program.
+  static void analyze(const ProgramPtr &program);
+
+private:
+  // Ordered from harmless to unrestricted. Binding a name only affects the
+  // frame being evaluated in, which a call discards.
+  enum Effect { NO_EFFECT, BINDS_LOCALLY, HAS_EFFECTS };
+  // A bound name and the value a let binds it to; null for loop variables.
+  typedef std::pair<std::string, Expression *> Binding;
+
+  Effect _visit(const NodePtr &node);
+  bool _isPureCallee(const ExpressionPtr &callee) const;
+  bool _isLocal(const std::string &name) const;
+
+  static void _bindings(const NodePtr &node, std::vector<Binding> &bindings);
+  static void _assignedNames(const NodePtr &node,
+                             std::set<std::string> &names);
+  static void _assumePure(const NodePtr &node);
+
+  // Functions bound by exactly one top-level let and never assigned.
+  std::unordered_map<std::string, FunctionLiteralExpression *> _functions;
+  std::set<std::string> _globals;
+  // Names bound by each enclosing function, innermost last.
+  std::vector<std::set<std::string>> _scopes;
+  bool _changed = false;
+};
+
+#endif // MONKEY_EFFECTANALYSIS_H
@@ -1,33 +1,109 @@
 #include "Environment.h"
+#include "SlabAllocator.h"
 
 #include <iostream>
 #include <utility>
 
-void Environment::set(const std::string &name, std::shared_ptr<Object> value) {
+void Environment::set(const std::string &name, ObjectPtr value) {
+  if (_store.empty()) {
+    for (auto &slot : _slots) {
+      if (slot.first == name) {
+        slot.second = std::move(value);
+        return;
+      }
+    }
+    if (_slots.size() < _maxInlineBindings) {
+      _slots.emplace_back(name, std::move(value));
+      return;
+    }
+    for (auto &slot : _slots)
+      _store.emplace(std::move(slot.first), std::move(slot.second));
+    _slots.clear();
+  }
   _store[name] = std::move(value);
 }
 
-std::shared_ptr<Object> Environment::get(const std::string &name) {
-  if (_store.find(name) != _store.end()) {
-    return _store[name];
-  }
-  if (_outer) {
-    return _outer->get(name);
+ObjectPtr Environment::get(const std::string &name) {
+  for (auto environment = this; environment != nullptr;
+       environment = environment->_outer.get()) {
+    if (auto value = environment->_find(name))
+      return *value;
   }
   return NULL_;
 }
 
+ObjectPtr Environment::getUntil(const std::string &name,
+                                              const Environment *boundary) {
+  for (auto environment = this; environment != boundary;
+       environment = environment->_outer.get()) {
+    if (auto value = environment->_find(name))
+      return *value;
+  }
+  return nullptr;
+}
+
+bool Environment::assign(const std::string &name, ObjectPtr value) {
+  for (auto environment = this; environment != nullptr;
+       environment = environment->_outer.get()) {
+    if (auto slot = environment->_find(name)) {
+      *slot = std::move(value);
+      return true;
+    }
+  }
+  return false;
+}
+
+ObjectPtr *Environment::_find(const std::string &name) {
+  if (_store.empty()) {
+    for (auto &slot : _slots) {
+      if (slot.first == name)
+        return &slot.second;
+    }
+    return nullptr;
+  }
+  auto it = _store.find(name);
+  return it != _store.end() ? &it->second : nullptr;
+}
+
 std::shared_ptr<Environment> Environment::createEnclosedEnvironment() {
-  auto environment = std::make_shared<Environment>();
+  auto environment =
+      std::allocate_shared<Environment>(RuntimeStlAllocator<Environment, Environment>());
   environment->_outer = shared_from_this();
   return environment;
 }
 
+void Environment::reset(const std::shared_ptr<Environment> &outer) {
+  _slots.clear();
+  _store.clear();
+  _outer = outer;
+}
+
+void Environment::reserve(size_t bindings) {
+  if (bindings <= _maxInlineBindings)
+    _slots.reserve(bindings);
+  else
+    _store.reserve(bindings);
+}
+
+void Environment::forEachValue(
+    const std::function<void(const ObjectPtr &)> &visit) const {
+  for (const auto &slot : _slots)
+    visit(slot.second);
+  for (const auto &binding : _store)
+    visit(binding.second);
+}
+
 std::ostream &operator<<(std::ostream &os, Environment const &environment) {
+  for (auto const &x : environment._slots) {
+    os << x.first << "=" << x.second->inspect() << std::endl;
+  }
   for (auto const &x : environment._store) {
     os << x.first << "=" << x.second->inspect() << std::endl;
   }
   if (environment._outer) {
+    for (auto const &x : environment._outer->_slots) {
+      os << "outer: " << x.first << "=" << x.second->inspect() << std::endl;
+    }
     for (auto const &x : environment._outer->_store) {
       os << "outer: " << x.first << "=" << x.second->inspect() << std::endl;
     }
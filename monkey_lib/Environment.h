@@ -2,20 +2,52 @@
 #define MONKEY_ENVIRONMENT_H
 
 #include "Object.h"
+#include <functional>
 #include <memory>
 #include <string>
 #include <unordered_map>
 
+#include <utility>
+#include <vector>
+
 class Environment : public std::enable_shared_from_this<Environment> {
 public:
-  void set(const std::string &name, std::shared_ptr<Object> value);
-  std::shared_ptr<Object> get(const std::string &name);
+  void set(const std::string &name, ObjectPtr value);
+  ObjectPtr get(const std::string &name);
+  // Rebinds `name` in the nearest environment that binds it. Returns false
+  // if none does.
+  bool assign(const std::string &name, ObjectPtr value);
+  // Like get(), but stops before reaching `boundary` and returns nullptr when
+  // no environment on the way binds the name.
+  ObjectPtr getUntil(const std::string &name,
+                                   const Environment *boundary);
   std::shared_ptr<Environment> createEnclosedEnvironment();
+  // Drops all bindings and re-parents the environment, keeping its storage
+  // so it can be reused as a call frame.
+  void reset(const std::shared_ptr<Environment> &outer);
+  // Makes room for `bindings` names so a call frame does not grow while its
+  // parameters and locals are bound.
+  void reserve(size_t bindings);
+  const std::shared_ptr<Environment> &outer() const { return _outer; }
+  // Calls `visit` with the value of every binding of this environment.
+  void forEachValue(const std::function<void(const ObjectPtr &)> &visit) const;
   friend std::ostream &operator<<(std::ostream &os,
                                   Environment const &environment);
 
 private:
-  std::unordered_map<std::string, std::shared_ptr<Object>> _store;
+  ObjectPtr *_find(const std::string &name);
+
+  // Call frames hold a handful of bindings; those live in a flat vector that
+  // keeps its capacity across reset(). Larger scopes spill into _store.
+  static constexpr size_t _maxInlineBindings = 8;
+
+  typedef std::pair<std::string, ObjectPtr> Slot;
+  std::vector<Slot, RuntimeStlAllocator<Slot>> _slots;
+  std::unordered_map<
+      std::string, ObjectPtr, std::hash<std::string>,
+      std::equal_to<std::string>,
+      RuntimeStlAllocator<std::pair<const std::string, ObjectPtr>>>
+      _store;
   std::shared_ptr<Environment> _outer;
 };
 
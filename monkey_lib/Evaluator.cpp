@@ -1,168 +1,866 @@
 #include "Evaluator.h"
 
 #include "AST.h"
+#include "EffectAnalysis.h"
+#include "IntegerKernels.h"
+#include "StringKernels.h"
 #include "Object.h"
+#include "ScopeAnalysis.h"
+#include "Allocator.h"
+#include "WorkStealingPool.h"
 #include "utilities.h"
+#include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 
 
 
+// Whether `==` holds for two values other than a pair of integers. Null and
+// booleans compare by value since an isolate's singletons differ from the
+// process-wide ones, and strings by content; everything else compares by
+// identity.
+static bool isSame(const ObjectPtr &left, const ObjectPtr &right) {
+  if (left == right)
+    return true;
+  auto leftString = dynamic_cast<StringObject *>(left.get());
+  auto rightString = dynamic_cast<StringObject *>(right.get());
+  if (leftString != nullptr && rightString != nullptr)
+    return leftString->equals(*rightString);
+  auto leftBoolean = dynamic_cast<BooleanObject *>(left.get());
+  auto rightBoolean = dynamic_cast<BooleanObject *>(right.get());
+  if (leftBoolean != nullptr && rightBoolean != nullptr)
+    return leftBoolean->value == rightBoolean->value;
+  return left->type() == NULL_OBJ && right->type() == NULL_OBJ;
+}
+
+// Integer division as the array kernels do it: the one quotient that does not
+// fit, INT64_MIN / -1, wraps around instead of trapping. Zero divisors are
+// reported as errors before this is reached.
+static int64_t divide(int64_t left, int64_t right) {
+  if (right == -1)
+    return static_cast<int64_t>(0 - static_cast<uint64_t>(left));
+  return left / right;
+}
+
+// Whether `==` holds for any two values.
+static bool isEqual(const ObjectPtr &left, const ObjectPtr &right) {
+  auto leftInteger = dynamic_cast<IntegerObject *>(left.get());
+  auto rightInteger = dynamic_cast<IntegerObject *>(right.get());
+  if (leftInteger != nullptr && rightInteger != nullptr)
+    return leftInteger->value == rightInteger->value;
+  return isSame(left, right);
+}
+
+// Reads an argument of the builtin `name` that must be an array of integers
+// into `integers`. Returns the error to report, or nullptr.
+static ObjectPtr integerElements(const char *name, const ObjectPtr &arg,
+                                 ArrayObject::Integers &integers) {
+  if (arg->type() != ARRAY_OBJ)
+    return newError("argument to `%s` must be ARRAY, got %s", name,
+                    arg->type());
+  if (!static_cast<ArrayObject *>(arg.get())->toIntegers(integers))
+    return newError("elements of `%s` must be INTEGER", name);
+  return nullptr;
+}
+
+// Checks the arguments of the builtin `name`, which compares two arrays of
+// the same length element by element. Returns the error to report, or
+// nullptr.
+static ObjectPtr pairwiseArguments(const char *name, const ObjectPtrVec &args) {
+  if (args.size() != 2)
+    return newError("wrong number of arguments, got=%d, want=2", args.size());
+  for (const auto &arg : args) {
+    if (arg->type() != ARRAY_OBJ)
+      return newError("argument to `%s` must be ARRAY, got %s", name,
+                      arg->type());
+  }
+  auto left = static_cast<ArrayObject *>(args[0].get())->size();
+  auto right = static_cast<ArrayObject *>(args[1].get())->size();
+  if (left != right)
+    return newError(
+        "arguments to `%s` must have the same length, got %d and %d", name,
+        left, right);
+  return nullptr;
+}
+
+static ObjectPtr booleanArray(const ArrayObject::Integers &values) {
+  ArrayObject::Elements booleans;
+  for (auto value : values)
+    booleans.push_back(value ? TRUE_ : FALSE_);
+  return makeRef<ArrayObject>(std::move(booleans));
+}
+
+// The builtin `name`: whether `opcode` holds for each pair of integers at the
+// same index of two arrays.
+static ObjectPtr comparePairwise(const char *name, InfixOperator opcode,
+                                 const ObjectPtrVec &args) {
+  if (auto error = pairwiseArguments(name, args))
+    return error;
+  ArrayObject::Integers left, right;
+  if (auto error = integerElements(name, args[0], left))
+    return error;
+  if (auto error = integerElements(name, args[1], right))
+    return error;
+  return booleanArray(IntegerKernels::apply(opcode, left, right));
+}
+
+// Checks that every argument of the builtin `name` is a string. Returns the
+// error to report, or nullptr.
+static ObjectPtr stringArguments(const char *name, const ObjectPtrVec &args) {
+  for (const auto &arg : args) {
+    if (arg->type() != STRING_OBJ)
+      return newError("argument to `%s` must be STRING, got %s", name,
+                      arg->type());
+  }
+  return nullptr;
+}
+
+static std::string_view stringValue(const ObjectPtr &string) {
+  return static_cast<StringObject *>(string.get())->value();
+}
+
+// Splits `string` at each `separator` into an array of strings. The pieces are
+// views of `string` if together they use enough of it, since they are usually
+// kept or dropped together. For `lines`, a final empty piece is dropped and so
+// is a carriage return ending a piece.
+static ObjectPtr splitString(const Ref<StringObject> &string,
+                             std::string_view separator, bool lines) {
+  auto value = string->value();
+  std::vector<std::pair<size_t, size_t>> pieces;
+  size_t used = 0;
+  size_t start = 0;
+  while (true) {
+    auto found = StringKernels::find(value.substr(start), separator);
+    if (found != std::string_view::npos)
+      found += start;
+    auto end = found == std::string_view::npos ? value.size() : found;
+    auto length = end - start;
+    if (lines && length > 0 && value[end - 1] == '\r')
+      length--;
+    pieces.emplace_back(start, length);
+    used += length;
+    if (found == std::string_view::npos)
+      break;
+    start = end + separator.size();
+  }
+  if (lines && pieces.back().second == 0 && pieces.back().first == value.size())
+    pieces.pop_back();
+
+  auto share = StringObject::worthSharing(used, value.size());
+  ObjectPtrVec elements;
+  elements.reserve(pieces.size());
+  for (auto [start, length] : pieces)
+    elements.push_back(StringObject::substring(string, start, length, share));
+  return makeRef<ArrayObject>(elements);
+}
+
 // XXX - Maybe this should be part of the evaluator class?
 // We definietely should not be duplicating the error raising mechanism
-const std::unordered_map<std::string, BuiltinObject> builtins = {
+const std::unordered_map<std::string, Ref<BuiltinObject>> builtins = {
   {"len", 
-    BuiltinObject{[](const std::vector<std::shared_ptr<Object>>& args)->std::shared_ptr<Object>{
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
       if(args.size() != 1){
-        return std::make_shared<ErrorObject>(string_format("wrong number of arguments, got=%d, want=1", args.size()));
+        return newError("wrong number of arguments, got=%d, want=1",
+                        args.size());
       }
 
       if(args[0]->type() == ARRAY_OBJ){
-        auto arrayObject = std::dynamic_pointer_cast<ArrayObject>(args[0]);
-        return std::make_shared<IntegerObject>(arrayObject->elements.size());
+        auto arrayObject = dynamicRefCast<ArrayObject>(args[0]);
+        return makeRef<IntegerObject>(arrayObject->size());
       }
       if(args[0]->type() == STRING_OBJ){
-        auto stringObject = std::dynamic_pointer_cast<StringObject>(args[0]);
-        return std::make_shared<IntegerObject>(stringObject->value.length()); 
+        auto stringObject = dynamicRefCast<StringObject>(args[0]);
+        return makeRef<IntegerObject>(stringObject->codePoints());
+      }
+      if(args[0]->type() == HASH_OBJ){
+        return makeRef<IntegerObject>(
+            static_cast<HashObject *>(args[0].get())->pairs.size());
       }
 
-      return std::make_shared<ErrorObject>(string_format("argument to `len` not supported, got %s", args[0]->type().c_str()));
-    }}
+      return newError("argument to `len` not supported, got %s",
+                      args[0]->type());
+    })
   },
   {"first",
-    BuiltinObject{[](const std::vector<std::shared_ptr<Object>>& args)->std::shared_ptr<Object>{
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
       if(args.size() != 1){
-        return std::make_shared<ErrorObject>(string_format("wrong number of arguments, got=%d, want=1", args.size()));
+        return newError("wrong number of arguments, got=%d, want=1",
+                        args.size());
       }
 
       if (args[0]->type() != ARRAY_OBJ){
-        return std::make_shared<ErrorObject>(string_format("argument to `first` must be ARRAY, got %s", args[0]->type().c_str()));
+        return newError("argument to `first` must be ARRAY, got %s",
+                        args[0]->type());
       }
 
-      auto arr = std::dynamic_pointer_cast<ArrayObject>(args[0]);
-      if (arr->elements.size() > 0) {
-        return arr->elements[0];
+      auto arr = dynamicRefCast<ArrayObject>(args[0]);
+      if (arr->size() > 0) {
+        return arr->at(0);
       }
 
       return NULL_;
-    }}
+    })
   },
   {"last",
-    BuiltinObject{[](const std::vector<std::shared_ptr<Object>>& args)->std::shared_ptr<Object>{
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
       if(args.size() != 1){
-        return std::make_shared<ErrorObject>(string_format("wrong number of arguments, got=%d, want=1", args.size()));
+        return newError("wrong number of arguments, got=%d, want=1",
+                        args.size());
       }
 
       if (args[0]->type() != ARRAY_OBJ){
-        return std::make_shared<ErrorObject>(string_format("argument to `last` must be ARRAY, got %s", args[0]->type().c_str()));
+        return newError("argument to `last` must be ARRAY, got %s",
+                        args[0]->type());
       }
 
-      auto arr = std::dynamic_pointer_cast<ArrayObject>(args[0]);
-      auto length = arr->elements.size();
+      auto arr = dynamicRefCast<ArrayObject>(args[0]);
+      auto length = arr->size();
       if (length > 0) {
-        return arr->elements[length-1];
+        return arr->at(length-1);
       }
 
       return NULL_;
-    }}
+    })
   },
   {"rest",
-    BuiltinObject{[](const std::vector<std::shared_ptr<Object>>& args)->std::shared_ptr<Object>{
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
       if(args.size() != 1){
-        return std::make_shared<ErrorObject>(string_format("wrong number of arguments, got=%d, want=1", args.size()));
+        return newError("wrong number of arguments, got=%d, want=1",
+                        args.size());
       }
 
       if (args[0]->type() != ARRAY_OBJ){
-        return std::make_shared<ErrorObject>(string_format("argument to `rest` must be ARRAY, got %s", args[0]->type().c_str()));
+        return newError("argument to `rest` must be ARRAY, got %s",
+                        args[0]->type());
       }
 
-      auto arr = std::dynamic_pointer_cast<ArrayObject>(args[0]);
-      auto length = arr->elements.size();
+      auto arr = dynamicRefCast<ArrayObject>(args[0]);
+      auto length = arr->size();
       if (length > 0) {
-        std::vector<std::shared_ptr<Object>> slice(arr->elements.begin() + 1, arr->elements.end());
-        return std::make_shared<ArrayObject>(slice);
+        return arr->slice(1, length);
       }
 
       return NULL_;
-    }}
+    })
+  },
+  {"slice",
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
+      if(args.size() != 2 && args.size() != 3){
+        return newError("wrong number of arguments, got=%d, want=2 or 3",
+                        args.size());
+      }
+
+      if (args[0]->type() != ARRAY_OBJ){
+        return newError("argument to `slice` must be ARRAY, got %s",
+                        args[0]->type());
+      }
+
+      // Bounds are clamped to the array; an end before the start gives an
+      // empty array.
+      auto array = static_cast<ArrayObject *>(args[0].get());
+      int64_t bounds[2] = {0, static_cast<int64_t>(array->size())};
+      for (size_t i = 1; i < args.size(); i++) {
+        if (args[i]->type() != INTEGER_OBJ) {
+          return newError("bounds of `slice` must be INTEGER, got %s",
+                          args[i]->type());
+        }
+        bounds[i - 1] = std::clamp<int64_t>(
+            static_cast<IntegerObject *>(args[i].get())->value, 0,
+            array->size());
+      }
+      auto end = std::max(bounds[0], bounds[1]);
+      return array->slice(bounds[0], end);
+    })
+  },
+  {"concat",
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
+      if(args.size() != 2){
+        return newError("wrong number of arguments, got=%d, want=2",
+                        args.size());
+      }
+
+      for (const auto &arg : args) {
+        if (arg->type() != ARRAY_OBJ){
+          return newError("argument to `concat` must be ARRAY, got %s",
+                          arg->type());
+        }
+      }
+
+      return static_cast<ArrayObject *>(args[0].get())
+          ->concat(*static_cast<ArrayObject *>(args[1].get()));
+    })
   },
   {"push",
-    BuiltinObject{[](const std::vector<std::shared_ptr<Object>>& args)->std::shared_ptr<Object>{
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
+      if(args.size() != 2){
+        return newError("wrong number of arguments, got=%d, want=2",
+                        args.size());
+      }
+
+      if (args[0]->type() != ARRAY_OBJ){
+        return newError("argument to `push` must be ARRAY, got %s",
+                        args[0]->type());
+      }
+
+      // Appends in place and hands back the same array, so building one up
+      // element by element stays linear.
+      static_cast<ArrayObject *>(args[0].get())->push(args[1]);
+      return args[0];
+    })
+  },
+  {"sum",
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
+      if(args.size() != 1){
+        return newError("wrong number of arguments, got=%d, want=1",
+                        args.size());
+      }
+
+      ArrayObject::Integers integers;
+      if (auto error = integerElements("sum", args[0], integers)) {
+        return error;
+      }
+      return makeRef<IntegerObject>(IntegerKernels::sum(integers));
+    })
+  },
+  {"min",
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
+      if(args.size() != 1){
+        return newError("wrong number of arguments, got=%d, want=1",
+                        args.size());
+      }
+
+      ArrayObject::Integers integers;
+      if (auto error = integerElements("min", args[0], integers)) {
+        return error;
+      }
+      if (integers.empty()) {
+        return NULL_;
+      }
+      return makeRef<IntegerObject>(IntegerKernels::min(integers));
+    })
+  },
+  {"max",
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
+      if(args.size() != 1){
+        return newError("wrong number of arguments, got=%d, want=1",
+                        args.size());
+      }
+
+      ArrayObject::Integers integers;
+      if (auto error = integerElements("max", args[0], integers)) {
+        return error;
+      }
+      if (integers.empty()) {
+        return NULL_;
+      }
+      return makeRef<IntegerObject>(IntegerKernels::max(integers));
+    })
+  },
+  {"dot",
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
       if(args.size() != 2){
-        return std::make_shared<ErrorObject>(string_format("wrong number of arguments, got=%d, want=2", args.size()));
+        return newError("wrong number of arguments, got=%d, want=2",
+                        args.size());
       }
 
+      ArrayObject::Integers left, right;
+      if (auto error = integerElements("dot", args[0], left)) {
+        return error;
+      }
+      if (auto error = integerElements("dot", args[1], right)) {
+        return error;
+      }
+      if (left.size() != right.size()) {
+        return newError(
+            "arguments to `dot` must have the same length, got %d and %d",
+            left.size(), right.size());
+      }
+      return makeRef<IntegerObject>(IntegerKernels::dot(left, right));
+    })
+  },
+  {"contains",
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
+      if(args.size() != 2){
+        return newError("wrong number of arguments, got=%d, want=2",
+                        args.size());
+      }
+
+      if (args[0]->type() == STRING_OBJ){
+        if (auto error = stringArguments("contains", args)) {
+          return error;
+        }
+        auto found =
+            StringKernels::find(stringValue(args[0]), stringValue(args[1]));
+        return found != std::string_view::npos ? TRUE_ : FALSE_;
+      }
       if (args[0]->type() != ARRAY_OBJ){
-        return std::make_shared<ErrorObject>(string_format("argument to `push` must be ARRAY, got %s", args[0]->type().c_str()));
+        return newError(
+            "argument to `contains` must be ARRAY or STRING, got %s",
+            args[0]->type());
+      }
+
+      // Elements are compared the way `==` compares them.
+      auto array = static_cast<ArrayObject *>(args[0].get());
+      auto integer = dynamic_cast<IntegerObject *>(args[1].get());
+      if (array->isUnboxed()) {
+        auto found =
+            integer != nullptr &&
+            IntegerKernels::contains(array->integers(), integer->value);
+        return found ? TRUE_ : FALSE_;
+      }
+      for (const auto &element : array->elements()) {
+        auto found = integer != nullptr
+                         ? element->type() == INTEGER_OBJ &&
+                               static_cast<IntegerObject *>(element.get())
+                                       ->value == integer->value
+                         : isSame(element, args[1]);
+        if (found) {
+          return TRUE_;
+        }
+      }
+      return FALSE_;
+    })
+  },
+  {"pairwiseEqual",
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
+      if (auto error = pairwiseArguments("pairwiseEqual", args)) {
+        return error;
+      }
+
+      // Whether `==` holds for each pair of elements at the same index.
+      auto left = static_cast<ArrayObject *>(args[0].get());
+      auto right = static_cast<ArrayObject *>(args[1].get());
+      ArrayObject::Integers leftIntegers, rightIntegers;
+      if (left->toIntegers(leftIntegers) && right->toIntegers(rightIntegers)) {
+        return booleanArray(
+            IntegerKernels::apply(OP_EQ, leftIntegers, rightIntegers));
+      }
+      ObjectPtrVec equal;
+      equal.reserve(left->size());
+      for (size_t i = 0; i < left->size(); i++)
+        equal.push_back(isEqual(left->at(i), right->at(i)) ? TRUE_ : FALSE_);
+      return makeRef<ArrayObject>(equal);
+    })
+  },
+  {"pairwiseLess",
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
+      return comparePairwise("pairwiseLess", OP_LT, args);
+    })
+  },
+  {"pairwiseGreater",
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
+      return comparePairwise("pairwiseGreater", OP_GT, args);
+    })
+  },
+  {"keys",
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
+      if(args.size() != 1){
+        return newError("wrong number of arguments, got=%d, want=1",
+                        args.size());
       }
 
-      auto arr = std::dynamic_pointer_cast<ArrayObject>(args[0]);      
-      arr->elements.push_back(args[1]);
-      return std::make_shared<ArrayObject>(arr->elements);
-    }}
+      if (args[0]->type() != HASH_OBJ){
+        return newError("argument to `keys` must be HASH, got %s",
+                        args[0]->type());
+      }
+
+      ObjectPtrVec keys;
+      for (const auto &pair : static_cast<HashObject *>(args[0].get())->pairs)
+        keys.push_back(pair.key);
+      return makeRef<ArrayObject>(keys);
+    })
+  },
+  {"values",
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
+      if(args.size() != 1){
+        return newError("wrong number of arguments, got=%d, want=1",
+                        args.size());
+      }
+
+      if (args[0]->type() != HASH_OBJ){
+        return newError("argument to `values` must be HASH, got %s",
+                        args[0]->type());
+      }
+
+      ObjectPtrVec values;
+      for (const auto &pair : static_cast<HashObject *>(args[0].get())->pairs)
+        values.push_back(pair.value);
+      return makeRef<ArrayObject>(values);
+    })
+  },
+  {"put",
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
+      if(args.size() != 3){
+        return newError("wrong number of arguments, got=%d, want=3",
+                        args.size());
+      }
+
+      if (args[0]->type() != HASH_OBJ){
+        return newError("argument to `put` must be HASH, got %s",
+                        args[0]->type());
+      }
+      if (!HashObject::isHashable(args[1])){
+        return newError("unusable as hash key: %s", args[1]->type());
+      }
+
+      // Like `push`, changes the hash in place and hands it back.
+      static_cast<HashObject *>(args[0].get())
+          ->pairs.insert_or_assign(args[1], args[2]);
+      return args[0];
+    })
+  },
+  {"delete",
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
+      if(args.size() != 2){
+        return newError("wrong number of arguments, got=%d, want=2",
+                        args.size());
+      }
+
+      if (args[0]->type() != HASH_OBJ){
+        return newError("argument to `delete` must be HASH, got %s",
+                        args[0]->type());
+      }
+      if (!HashObject::isHashable(args[1])){
+        return newError("unusable as hash key: %s", args[1]->type());
+      }
+
+      static_cast<HashObject *>(args[0].get())->pairs.erase(args[1]);
+      return args[0];
+    })
+  },
+  {"memo",
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
+      if(args.size() != 1 && args.size() != 2){
+        return newError("wrong number of arguments, got=%d, want=1 or 2",
+                        args.size());
+      }
+
+      if (args[0]->type() != FUNCTION_OBJ){
+        return newError("argument to `memo` must be FUNCTION, got %s",
+                        args[0]->type());
+      }
+
+      auto capacity = MemoObject::defaultCapacity;
+      if (args.size() == 2) {
+        auto bound = dynamicRefCast<IntegerObject>(args[1]);
+        if (bound == nullptr || bound->value <= 0) {
+          return newError(
+              "capacity of `memo` must be a positive INTEGER, got %s", args[1]);
+        }
+        capacity = bound->value;
+      }
+
+      return makeRef<MemoObject>(dynamicRefCast<FunctionObject>(args[0]),
+                                 capacity);
+    })
+  },
+  {"memoStats",
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
+      if(args.size() != 1){
+        return newError("wrong number of arguments, got=%d, want=1",
+                        args.size());
+      }
+
+      if (args[0]->type() != MEMO_OBJ){
+        return newError("argument to `memoStats` must be MEMO, got %s",
+                        args[0]->type());
+      }
+
+      // [hits, misses, cached results]
+      auto memo = dynamicRefCast<MemoObject>(args[0]);
+      return makeRef<ArrayObject>(ObjectPtrVec{
+          makeRef<IntegerObject>(memo->hits()),
+          makeRef<IntegerObject>(memo->misses()),
+          makeRef<IntegerObject>(memo->size())});
+    })
+  },
+  {"substr",
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
+      if(args.size() != 2 && args.size() != 3){
+        return newError("wrong number of arguments, got=%d, want=2 or 3",
+                        args.size());
+      }
+
+      if (args[0]->type() != STRING_OBJ){
+        return newError("argument to `substr` must be STRING, got %s",
+                        args[0]->type());
+      }
+
+      // Bounds count code points and are clamped like those of `slice`. A
+      // substring using most of its string is a view of it.
+      auto string = staticRefCast<StringObject>(args[0]);
+      int64_t bounds[2] = {0, static_cast<int64_t>(string->codePoints())};
+      for (size_t i = 1; i < args.size(); i++) {
+        if (args[i]->type() != INTEGER_OBJ) {
+          return newError("bounds of `substr` must be INTEGER, got %s",
+                          args[i]->type());
+        }
+        bounds[i - 1] = std::clamp<int64_t>(
+            static_cast<IntegerObject *>(args[i].get())->value, 0,
+            string->codePoints());
+      }
+      auto start = string->byteOffset(bounds[0]);
+      auto length =
+          string->byteOffset(std::max(bounds[0], bounds[1])) - start;
+      return StringObject::substring(
+          string, start, length,
+          StringObject::worthSharing(length, string->length()));
+    })
+  },
+  {"split",
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
+      if(args.size() != 2){
+        return newError("wrong number of arguments, got=%d, want=2",
+                        args.size());
+      }
+
+      for (const auto &arg : args) {
+        if (arg->type() != STRING_OBJ){
+          return newError("argument to `split` must be STRING, got %s",
+                          arg->type());
+        }
+      }
+
+      auto separator = static_cast<StringObject *>(args[1].get())->value();
+      if (separator.empty()) {
+        return newError("separator of `split` must not be empty");
+      }
+      return splitString(staticRefCast<StringObject>(args[0]), separator,
+                         false);
+    })
+  },
+  {"lines",
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
+      if(args.size() != 1){
+        return newError("wrong number of arguments, got=%d, want=1",
+                        args.size());
+      }
+
+      if (args[0]->type() != STRING_OBJ){
+        return newError("argument to `lines` must be STRING, got %s",
+                        args[0]->type());
+      }
+
+      return splitString(staticRefCast<StringObject>(args[0]), "\n", true);
+    })
+  },
+  {"indexOf",
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
+      if(args.size() != 2){
+        return newError("wrong number of arguments, got=%d, want=2",
+                        args.size());
+      }
+
+      if (auto error = stringArguments("indexOf", args)) {
+        return error;
+      }
+
+      // In code points, like the indices of `s[i]`; -1 if there is none.
+      auto text = stringValue(args[0]);
+      auto found = StringKernels::find(text, stringValue(args[1]));
+      if (found == std::string_view::npos) {
+        return makeRef<IntegerObject>(-1);
+      }
+      auto string = static_cast<StringObject *>(args[0].get());
+      if (string->codePoints() != string->length()) {
+        found = StringKernels::countCodePoints(text.substr(0, found));
+      }
+      return makeRef<IntegerObject>(found);
+    })
+  },
+  {"startsWith",
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
+      if(args.size() != 2){
+        return newError("wrong number of arguments, got=%d, want=2",
+                        args.size());
+      }
+
+      if (auto error = stringArguments("startsWith", args)) {
+        return error;
+      }
+
+      return stringValue(args[0]).starts_with(stringValue(args[1])) ? TRUE_
+                                                                    : FALSE_;
+    })
+  },
+  {"count",
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
+      if(args.size() != 2){
+        return newError("wrong number of arguments, got=%d, want=2",
+                        args.size());
+      }
+
+      if (auto error = stringArguments("count", args)) {
+        return error;
+      }
+
+      // Occurrences do not overlap.
+      auto text = stringValue(args[0]);
+      auto pattern = stringValue(args[1]);
+      if (pattern.empty()) {
+        return newError("substring of `count` must not be empty");
+      }
+      int64_t count = 0;
+      for (size_t start = 0;; count++) {
+        auto found = StringKernels::find(text.substr(start), pattern);
+        if (found == std::string_view::npos) {
+          break;
+        }
+        start += found + pattern.size();
+      }
+      return makeRef<IntegerObject>(count);
+    })
+  },
+  {"replace",
+    makeRef<BuiltinObject>([](const ObjectPtrVec& args)->ObjectPtr{
+      if(args.size() != 3){
+        return newError("wrong number of arguments, got=%d, want=3",
+                        args.size());
+      }
+
+      if (auto error = stringArguments("replace", args)) {
+        return error;
+      }
+
+      // Replaces every occurrence, from left to right.
+      auto text = stringValue(args[0]);
+      auto pattern = stringValue(args[1]);
+      auto replacement = stringValue(args[2]);
+      if (pattern.empty()) {
+        return newError("substring of `replace` must not be empty");
+      }
+      auto found = StringKernels::find(text, pattern);
+      if (found == std::string_view::npos) {
+        return args[0];
+      }
+      RuntimeString result;
+      size_t start = 0;
+      for (; found != std::string_view::npos;
+           found = StringKernels::find(text.substr(start), pattern)) {
+        result += text.substr(start, found);
+        result += replacement;
+        start += found + pattern.size();
+      }
+      result += text.substr(start);
+      return makeRef<StringObject>(std::move(result));
+    })
   }
 };
 
 
-Evaluator::Evaluator(const std::shared_ptr<Environment> &environment)
-    : _environment(environment) {}
+// Quickened nodes are rewritten while other threads of a parallel evaluation
+// may be reading them. A field is published after the ones it guards, so a
+// reader that sees a specialization also sees what it relies on.
+template <typename T> static T loadQuickened(T &field) {
+  return std::atomic_ref<T>(field).load(std::memory_order_acquire);
+}
+
+template <typename T> static void storeQuickened(T &field, T value) {
+  std::atomic_ref<T>(field).store(value, std::memory_order_release);
+}
+
+static FunctionPrototypePtr newPrototype(FunctionLiteralExpression *node) {
+  auto prototype = std::make_shared<FunctionPrototype>();
+  prototype->parameters = node->parameters;
+  prototype->body = node->body;
+  prototype->arity = node->parameters.size();
+  prototype->frameSize = std::max(node->frameSize, prototype->arity);
+  prototype->reusesFrames = !ScopeAnalysis::environmentEscapes(node);
+  return prototype;
+}
+
+Evaluator::Evaluator(const std::shared_ptr<Environment> &environment,
+                     RuntimeMode mode, Allocator *allocator)
+    : _mode(mode), _allocator(allocator), _environment(environment),
+      _globals(environment) {
+  if (mode != RUNTIME_SINGLE_THREADED) {
+    _null = NULL_;
+    _true = TRUE_;
+    _false = FALSE_;
+    return;
+  }
+  AllocatorScope allocation(_allocator);
+  ThreadConfinedScope confined;
+  _null = makeRef<NullObject>();
+  _true = makeRef<BooleanObject>(true);
+  _false = makeRef<BooleanObject>(false);
+}
+
+Evaluator::~Evaluator() { _breakCycles(); }
 
-std::shared_ptr<Object> Evaluator::evaluate(const NodePtr &node) {
-  std::shared_ptr<Object> result, result2;
+ObjectPtr Evaluator::evaluate(const NodePtr &node) {
+  ObjectPtr result;
 
   switch (node->nodeType()) {
-  case NodeType::PROGRAM:
-    return _evaluateProgram(
-        std::dynamic_pointer_cast<Program>(node)->statements);
+  case NodeType::PROGRAM: {
+    auto program = std::dynamic_pointer_cast<Program>(node);
+    ScopeAnalysis::analyze(program);
+    if (_mode == RUNTIME_PARALLEL) {
+      EffectAnalysis::analyze(program);
+      _preparePrototypes(program);
+    }
+    AllocatorScope allocation(_allocator);
+    ThreadConfinedScope confined(_mode == RUNTIME_SINGLE_THREADED);
+    return _evaluateProgram(program->statements);
+  }
   case NodeType::EXPRESSION_STATEMENT:
     return evaluate(
         std::dynamic_pointer_cast<ExpressionStatement>(node)->expression);
   case NodeType::INTEGER_LITERAL:
-    return std::make_shared<IntegerObject>(
+    return makeRef<IntegerObject>(
         std::dynamic_pointer_cast<IntegerLiteralExpression>(node)->value);
   case NodeType::STRING_LITERAL:
-    return std::make_shared<StringObject>(
-        std::dynamic_pointer_cast<StringLiteralExpression>(node)->value);
+    return _strings.intern(
+        std::static_pointer_cast<StringLiteralExpression>(node)->value);
   case NodeType::BOOLEAN_LITERAL:
-    return std::dynamic_pointer_cast<BooleanLiteralExpression>(node)->value
-               ? TRUE_
-               : FALSE_;
+    return _boolean(
+        std::dynamic_pointer_cast<BooleanLiteralExpression>(node)->value);
   case NodeType::PREFIX_EXPRESSION:
+    if (std::static_pointer_cast<Expression>(node)->staticType != TYPE_UNKNOWN)
+      return _evaluateUnboxedExpression(
+          std::static_pointer_cast<Expression>(node));
     result = evaluate(std::dynamic_pointer_cast<PrefixExpression>(node)->right);
-    if (_isError(result))
+    if (_isInterrupted())
       return result;
     return _evaluatePrefixExpression(
         std::dynamic_pointer_cast<PrefixExpression>(node)->operator_, result);
   case NodeType::INFIX_EXPRESSION:
-    result = evaluate(std::dynamic_pointer_cast<InfixExpression>(node)->left);
-    if (_isError(result))
-      return result;
-    result2 = evaluate(std::dynamic_pointer_cast<InfixExpression>(node)->right);
-    if (_isError(result2))
-      return result2;
-    return _evaluateInfixExpression(
-        std::dynamic_pointer_cast<InfixExpression>(node)->operator_, result,
-        result2);
+    if (std::static_pointer_cast<Expression>(node)->staticType != TYPE_UNKNOWN)
+      return _evaluateUnboxedExpression(
+          std::static_pointer_cast<Expression>(node));
+    return _evaluateInfixNode(std::static_pointer_cast<InfixExpression>(node));
   case NodeType::BLOCK_STATEMENT:
     return _evaluateBlockStatement(
         std::dynamic_pointer_cast<BlockStatement>(node));
   case NodeType::IF_EXPRESSION:
     return _evaluateIfExpression(std::dynamic_pointer_cast<IfExpression>(node));
+  case NodeType::WHILE_EXPRESSION:
+    return _evaluateWhileExpression(
+        std::static_pointer_cast<WhileExpression>(node));
+  case NodeType::FOR_EXPRESSION:
+    return _evaluateForExpression(
+        std::static_pointer_cast<ForExpression>(node));
+  case NodeType::ASSIGN_EXPRESSION:
+    return _evaluateAssignExpression(
+        std::static_pointer_cast<AssignExpression>(node));
   case NodeType::RETURN_STATEMENT:
     result =
         evaluate(std::dynamic_pointer_cast<ReturnStatement>(node)->returnValue);
-    if (_isError(result))
+    if (_isInterrupted())
       return result;
-    return std::make_shared<ReturnValueObject>(result);
+    _completion = COMPLETION_RETURN;
+    return result;
   case NodeType::LET_STATEMENT:
     result = evaluate(std::dynamic_pointer_cast<LetStatement>(node)->value);
-    if (_isError(result))
+    if (_isInterrupted())
       return result;
     _environment->set(
         std::dynamic_pointer_cast<LetStatement>(node)->name->value, result);
-    return NULL_;
+    return _null;
   case NodeType::IDENTIFIER:
     return _evaluateIdentifier(std::dynamic_pointer_cast<Identifier>(node));
   case NodeType::FUNCTION_LITERAL:
@@ -174,180 +872,657 @@ std::shared_ptr<Object> Evaluator::evaluate(const NodePtr &node) {
   case NodeType::ARRAY_LITERAL: {
     auto array = std::dynamic_pointer_cast<ArrayLiteralExpression>(node);
     auto elements = _evaluateExpressions(array->elements);
-    if (elements.size() == 1 && _isError(elements[0])) {
+    if (_isInterrupted()) {
       return elements[0];
     }
-    return std::make_shared<ArrayObject>(elements);
+    return makeRef<ArrayObject>(std::move(elements));
   }
   case NodeType::INDEX_EXPRESSION: {
     auto indexExpression = std::dynamic_pointer_cast<IndexExpression>(node);
     auto left = evaluate(indexExpression->left);
-    if (_isError(left)) {
+    if (_isInterrupted()) {
       return left;
     }
     auto index = evaluate(indexExpression->index);
-    if (_isError(index)) {
+    if (_isInterrupted()) {
       return index;
     }
     return _evaluateIndexExpression(left, index);
   }
+  case NodeType::HASH_LITERAL:
+    return _evaluateHashLiteral(
+        std::static_pointer_cast<HashLiteralExpression>(node));
+  case NodeType::RECORD_LITERAL:
+    return _evaluateRecordLiteral(
+        std::static_pointer_cast<RecordLiteralExpression>(node));
+  case NodeType::FIELD_EXPRESSION:
+    return _evaluateFieldExpression(
+        std::static_pointer_cast<FieldExpression>(node));
   default:
     return nullptr;
   }
 }
 
-std::shared_ptr<Object> Evaluator::_evaluateProgram(
+ObjectPtr Evaluator::_evaluateProgram(
     const StatementPtrVec &statements) {
-  std::shared_ptr<Object> result;
+  ObjectPtr result;
   for (const auto &statement : statements) {
     result = evaluate(statement);
-    if (result->type() == RETURN_VALUE_OBJ) {
-      return std::dynamic_pointer_cast<ReturnValueObject>(result)->value;
-    } else if (result->type() == ERROR_OBJ) {
-      return result;
-    }
+    if (_isInterrupted())
+      break;
   }
+  // A top-level return or error ends the program; the evaluator itself is
+  // reused for the next one.
+  _completion = COMPLETION_NORMAL;
   return result;
 }
 
-std::shared_ptr<Object>
+ObjectPtr
 Evaluator::_evaluatePrefixExpression(const std::string &op,
-                                     const std::shared_ptr<Object> &right) {
+                                     const ObjectPtr &right) {
   if (op == "!") {
     return _evaluateBangOperatorExpression(right);
   } else if (op == "-") {
     return _evaluateMinusPrefixOperatorExpression(right);
   }
-  return _newError("unknown operator: %s%s", op.c_str(),
-                   right->inspect().c_str());
+  return _newError("unknown operator: %s%s", op, right);
 }
 
-std::shared_ptr<Object> Evaluator::_evaluateBangOperatorExpression(
-    const std::shared_ptr<Object> &right) {
-  return (right == FALSE_ || right == NULL_) ? TRUE_ : FALSE_;
+ObjectPtr Evaluator::_evaluateBangOperatorExpression(
+    const ObjectPtr &right) {
+  return _boolean(!_isTruthy(right));
 }
 
-std::shared_ptr<Object> Evaluator::_evaluateMinusPrefixOperatorExpression(
-    const std::shared_ptr<Object> &right) {
+ObjectPtr Evaluator::_evaluateMinusPrefixOperatorExpression(
+    const ObjectPtr &right) {
   if (right->type() != INTEGER_OBJ) {
-    return _newError("unknown operator: -%s", right->type().c_str());
+    return _newError("unknown operator: -%s", right->type());
   }
-  auto value = std::dynamic_pointer_cast<IntegerObject>(right)->value;
-  return std::make_shared<IntegerObject>(-value);
+  auto value = dynamicRefCast<IntegerObject>(right)->value;
+  return makeRef<IntegerObject>(-value);
 }
 
-std::shared_ptr<Object>
+ObjectPtr
+Evaluator::_evaluateInfixNode(const InfixExpressionPtr &node) {
+  auto left = evaluate(node->left);
+  if (_isInterrupted())
+    return left;
+  auto right = evaluate(node->right);
+  if (_isInterrupted())
+    return right;
+
+  switch (loadQuickened(node->specialization)) {
+  case SPECIALIZED_INTEGER: {
+    auto leftInteger = dynamic_cast<IntegerObject *>(left.get());
+    auto rightInteger = dynamic_cast<IntegerObject *>(right.get());
+    if (leftInteger != nullptr && rightInteger != nullptr) {
+      return _evaluateIntegerOperation(loadQuickened(node->opcode),
+                                       leftInteger->value,
+                                       rightInteger->value);
+    }
+    storeQuickened(node->specialization, GENERIC);
+    break;
+  }
+  case SPECIALIZED_STRING: {
+    auto leftString = dynamicRefCast<StringObject>(left);
+    auto rightString = dynamicRefCast<StringObject>(right);
+    if (leftString != nullptr && rightString != nullptr) {
+      switch (loadQuickened(node->opcode)) {
+      case OP_EQ:
+        return _boolean(leftString->equals(*rightString));
+      case OP_NOT_EQ:
+        return _boolean(!leftString->equals(*rightString));
+      default:
+        return _concatenate(leftString, rightString);
+      }
+    }
+    storeQuickened(node->specialization, GENERIC);
+    break;
+  }
+  case UNSPECIALIZED:
+    _quickenInfixExpression(node, left, right);
+    break;
+  default:
+    break;
+  }
+  return _evaluateInfixExpression(node->operator_, left, right);
+}
+
+void Evaluator::_quickenInfixExpression(const InfixExpressionPtr &node,
+                                        const ObjectPtr &left,
+                                        const ObjectPtr &right) {
+  auto opcode = lookupInfixOperator(node->operator_);
+  auto specialization = GENERIC;
+  if (opcode != OP_UNKNOWN && left->type() == INTEGER_OBJ &&
+      right->type() == INTEGER_OBJ) {
+    specialization = SPECIALIZED_INTEGER;
+  } else if ((opcode == OP_PLUS || opcode == OP_EQ || opcode == OP_NOT_EQ) &&
+             left->type() == STRING_OBJ && right->type() == STRING_OBJ) {
+    specialization = SPECIALIZED_STRING;
+  }
+  storeQuickened(node->opcode, opcode);
+  storeQuickened(node->specialization, specialization);
+}
+
+ObjectPtr Evaluator::_evaluateIntegerOperation(InfixOperator op,
+                                                             int64_t left,
+                                                             int64_t right) {
+  switch (op) {
+  case OP_PLUS:
+    return makeRef<IntegerObject>(left + right);
+  case OP_MINUS:
+    return makeRef<IntegerObject>(left - right);
+  case OP_ASTERISK:
+    return makeRef<IntegerObject>(left * right);
+  case OP_SLASH:
+    if (right == 0)
+      return _newError("division by zero");
+    return makeRef<IntegerObject>(divide(left, right));
+  case OP_LT:
+    return _boolean(left < right);
+  case OP_GT:
+    return _boolean(left > right);
+  case OP_EQ:
+    return _boolean(left == right);
+  case OP_NOT_EQ:
+    return _boolean(left != right);
+  default:
+    return nullptr;
+  }
+}
+
+ObjectPtr
+Evaluator::_evaluateUnboxedExpression(const ExpressionPtr &expression) {
+  int64_t value;
+  ObjectPtr boxed;
+  if (!_evaluateUnboxed(expression, value, boxed))
+    return boxed;
+  return _box(expression->staticType, value);
+}
+
+// Evaluates a subtree proven INTEGER or BOOLEAN on raw int64_t values (0/1
+// for booleans). Leaves that are not literals or operators are evaluated
+// normally and checked against their proven type. Returns false when the
+// subtree had to be evaluated generically; `boxed` then holds the result,
+// which may be an error or a value being returned.
+bool Evaluator::_evaluateUnboxed(const ExpressionPtr &expression,
+                                 int64_t &value,
+                                 ObjectPtr &boxed) {
+  switch (expression->nodeType()) {
+  case NodeType::INTEGER_LITERAL:
+    value = std::static_pointer_cast<IntegerLiteralExpression>(expression)
+                ->value;
+    return true;
+  case NodeType::BOOLEAN_LITERAL:
+    value = std::static_pointer_cast<BooleanLiteralExpression>(expression)
+                ->value;
+    return true;
+  case NodeType::PREFIX_EXPRESSION: {
+    auto prefix = std::static_pointer_cast<PrefixExpression>(expression);
+    if (prefix->staticType == TYPE_UNKNOWN)
+      break;
+    int64_t right;
+    ObjectPtr rightBoxed;
+    if (!_evaluateUnboxed(prefix->right, right, rightBoxed)) {
+      boxed = _isInterrupted()
+                  ? rightBoxed
+                  : _evaluatePrefixExpression(prefix->operator_, rightBoxed);
+      return false;
+    }
+    if (prefix->operator_ == "-") {
+      value = -right;
+    } else {
+      // Only `false` is falsy among unboxed values; integers are truthy.
+      value = prefix->right->staticType == TYPE_BOOLEAN ? !right : false;
+    }
+    return true;
+  }
+  case NodeType::INFIX_EXPRESSION: {
+    auto infix = std::static_pointer_cast<InfixExpression>(expression);
+    if (infix->staticType == TYPE_UNKNOWN)
+      break;
+    int64_t left, right;
+    ObjectPtr leftBoxed, rightBoxed;
+    auto leftUnboxed = _evaluateUnboxed(infix->left, left, leftBoxed);
+    if (!leftUnboxed && _isInterrupted()) {
+      boxed = leftBoxed;
+      return false;
+    }
+    auto rightUnboxed = _evaluateUnboxed(infix->right, right, rightBoxed);
+    if (!rightUnboxed && _isInterrupted()) {
+      boxed = rightBoxed;
+      return false;
+    }
+    if (!leftUnboxed || !rightUnboxed ||
+        infix->left->staticType != infix->right->staticType) {
+      if (leftUnboxed)
+        leftBoxed = _box(infix->left->staticType, left);
+      if (rightUnboxed)
+        rightBoxed = _box(infix->right->staticType, right);
+      boxed = _evaluateInfixExpression(infix->operator_, leftBoxed, rightBoxed);
+      return false;
+    }
+    auto opcode = loadQuickened(infix->opcode);
+    if (opcode == OP_UNKNOWN) {
+      opcode = lookupInfixOperator(infix->operator_);
+      storeQuickened(infix->opcode, opcode);
+    }
+    switch (opcode) {
+    case OP_PLUS:
+      value = left + right;
+      return true;
+    case OP_MINUS:
+      value = left - right;
+      return true;
+    case OP_ASTERISK:
+      value = left * right;
+      return true;
+    case OP_SLASH:
+      if (right == 0) {
+        boxed = _newError("division by zero");
+        return false;
+      }
+      value = divide(left, right);
+      return true;
+    case OP_LT:
+      value = left < right;
+      return true;
+    case OP_GT:
+      value = left > right;
+      return true;
+    case OP_EQ:
+      value = left == right;
+      return true;
+    case OP_NOT_EQ:
+      value = left != right;
+      return true;
+    default:
+      boxed = _evaluateInfixExpression(infix->operator_,
+                                       _box(infix->left->staticType, left),
+                                       _box(infix->right->staticType, right));
+      return false;
+    }
+  }
+  default:
+    break;
+  }
+
+  boxed = evaluate(expression);
+  if (_isInterrupted())
+    return false;
+  if (expression->staticType == TYPE_INTEGER) {
+    if (auto integer = dynamic_cast<IntegerObject *>(boxed.get())) {
+      value = integer->value;
+      return true;
+    }
+  } else if (expression->staticType == TYPE_BOOLEAN) {
+    if (auto boolean = dynamic_cast<BooleanObject *>(boxed.get())) {
+      value = boolean->value;
+      return true;
+    }
+  }
+  return false;
+}
+
+ObjectPtr Evaluator::_box(StaticType type, int64_t value) {
+  if (type == TYPE_BOOLEAN)
+    return _boolean(value);
+  return makeRef<IntegerObject>(value);
+}
+
+ObjectPtr
 Evaluator::_evaluateInfixExpression(const std::string &op,
-                                    const std::shared_ptr<Object> &left,
-                                    const std::shared_ptr<Object> &right) {
+                                    const ObjectPtr &left,
+                                    const ObjectPtr &right) {
   if (left->type() == INTEGER_OBJ && right->type() == INTEGER_OBJ) {
     return _evaluateIntegerInfixExpression(op, left, right);
+  } else if ((left->type() == ARRAY_OBJ || right->type() == ARRAY_OBJ) &&
+             (op == "+" || op == "-" || op == "*" || op == "/")) {
+    return _evaluateArrayInfixExpression(op, left, right);
   } else if (op == "==") {
-    return left == right ? TRUE_ : FALSE_;
+    return _boolean(_isSame(left, right));
   } else if (op == "!=") {
-    return left != right ? TRUE_ : FALSE_;
+    return _boolean(!_isSame(left, right));
   } else if (left->type() == STRING_OBJ && right->type() == STRING_OBJ) {
     return _evaluateStringInfixExpression(op, left, right);
 
   } else if (left->type() != right->type()) {
-    return _newError("type mismatch: %s %s %s", left->type().c_str(),
-                     op.c_str(), right->type().c_str());
+    return _newError("type mismatch: %s %s %s", left->type(), op,
+                     right->type());
   }
-  return _newError("unknown operator: %s %s %s", left->type().c_str(),
-                   op.c_str(), right->type().c_str());
+  return _newError("unknown operator: %s %s %s", left->type(), op,
+                   right->type());
 }
 
-std::shared_ptr<Object> Evaluator::_evaluateIntegerInfixExpression(
-    const std::string &op, const std::shared_ptr<Object> &left,
-    const std::shared_ptr<Object> &right) {
-  auto leftValue = std::dynamic_pointer_cast<IntegerObject>(left)->value;
-  auto rightValue = std::dynamic_pointer_cast<IntegerObject>(right)->value;
+ObjectPtr Evaluator::_evaluateIntegerInfixExpression(
+    const std::string &op, const ObjectPtr &left,
+    const ObjectPtr &right) {
+  auto leftValue = dynamicRefCast<IntegerObject>(left)->value;
+  auto rightValue = dynamicRefCast<IntegerObject>(right)->value;
 
   if (op == "+") {
-    return std::make_shared<IntegerObject>(leftValue + rightValue);
+    return makeRef<IntegerObject>(leftValue + rightValue);
   } else if (op == "-") {
-    return std::make_shared<IntegerObject>(leftValue - rightValue);
+    return makeRef<IntegerObject>(leftValue - rightValue);
   } else if (op == "*") {
-    return std::make_shared<IntegerObject>(leftValue * rightValue);
+    return makeRef<IntegerObject>(leftValue * rightValue);
   } else if (op == "/") {
-    return std::make_shared<IntegerObject>(leftValue / rightValue);
+    if (rightValue == 0)
+      return _newError("division by zero");
+    return makeRef<IntegerObject>(divide(leftValue, rightValue));
   } else if (op == "<") {
-    return leftValue < rightValue ? TRUE_ : FALSE_;
+    return _boolean(leftValue < rightValue);
   } else if (op == ">") {
-    return leftValue > rightValue ? TRUE_ : FALSE_;
+    return _boolean(leftValue > rightValue);
   } else if (op == "==") {
-    return leftValue == rightValue ? TRUE_ : FALSE_;
+    return _boolean(leftValue == rightValue);
   } else if (op == "!=") {
-    return leftValue != rightValue ? TRUE_ : FALSE_;
+    return _boolean(leftValue != rightValue);
+  }
+  return _newError("unknown operator: %s %s %s", left, op, right);
+}
+
+// Arithmetic operators on arrays apply element-wise, pairing up the elements
+// of two arrays of the same length or each element of one array with a value
+// on the other side. Integers run through the kernels without being boxed;
+// any other elements are combined one pair at a time. Comparisons stay
+// scalar: `==` and `!=` compare arrays by identity, `<` and `>` are not
+// defined on them, and the pairwise builtins compare elements instead.
+ObjectPtr Evaluator::_evaluateArrayInfixExpression(const std::string &op,
+                                                   const ObjectPtr &left,
+                                                   const ObjectPtr &right) {
+  auto leftArray = dynamic_cast<ArrayObject *>(left.get());
+  auto rightArray = dynamic_cast<ArrayObject *>(right.get());
+  if (leftArray != nullptr && rightArray != nullptr &&
+      leftArray->size() != rightArray->size())
+    return _newError("length mismatch: %d %s %d", leftArray->size(), op,
+                     rightArray->size());
+  auto size = leftArray != nullptr ? leftArray->size() : rightArray->size();
+
+  auto opcode = lookupInfixOperator(op);
+  auto leftInteger = dynamic_cast<IntegerObject *>(left.get());
+  auto rightInteger = dynamic_cast<IntegerObject *>(right.get());
+  ArrayObject::Integers leftIntegers, rightIntegers;
+  auto unboxes = [](ArrayObject *array, ArrayObject::Integers &integers) {
+    return array != nullptr && array->toIntegers(integers);
+  };
+  if (opcode != OP_UNKNOWN &&
+      (leftInteger != nullptr || unboxes(leftArray, leftIntegers)) &&
+      (rightInteger != nullptr || unboxes(rightArray, rightIntegers))) {
+    if (opcode == OP_SLASH &&
+        (rightInteger != nullptr ? rightInteger->value == 0
+                                 : IntegerKernels::contains(rightIntegers, 0)))
+      return _newError("division by zero");
+    return makeRef<ArrayObject>(
+        leftInteger != nullptr
+            ? IntegerKernels::apply(opcode, leftInteger->value, rightIntegers)
+        : rightInteger != nullptr
+            ? IntegerKernels::apply(opcode, leftIntegers, rightInteger->value)
+            : IntegerKernels::apply(opcode, leftIntegers, rightIntegers));
+  }
+
+  for (auto array : {leftArray, rightArray}) {
+    if (array != nullptr && std::find(_combining.begin(), _combining.end(),
+                                      array) != _combining.end())
+      return _newError("cannot apply %s to an array that contains itself", op);
+  }
+  ObjectPtrVec elements;
+  elements.reserve(size);
+  _combining.push_back(leftArray);
+  _combining.push_back(rightArray);
+  ObjectPtr failed;
+  for (size_t i = 0; i < size; i++) {
+    auto element = _evaluateInfixExpression(
+        op, leftArray != nullptr ? leftArray->at(i) : left,
+        rightArray != nullptr ? rightArray->at(i) : right);
+    if (_isInterrupted()) {
+      failed = std::move(element);
+      break;
+    }
+    elements.push_back(std::move(element));
   }
-  return _newError("unknown operator: %s %s %s", left->inspect().c_str(),
-                   op.c_str(), right->inspect().c_str());
+  _combining.resize(_combining.size() - 2);
+  if (failed != nullptr)
+    return failed;
+  return makeRef<ArrayObject>(elements);
 }
 
-std::shared_ptr<Object> Evaluator::_evaluateStringInfixExpression(
-    const std::string &op, const std::shared_ptr<Object> &left,
-    const std::shared_ptr<Object> &right) {
+ObjectPtr Evaluator::_evaluateStringInfixExpression(
+    const std::string &op, const ObjectPtr &left,
+    const ObjectPtr &right) {
   if (op != "+") {
-    return _newError("unknown operator: %s %s %s", left->type().c_str(),
-                     op.c_str(), right->type().c_str());
+    return _newError("unknown operator: %s %s %s", left->type(), op,
+                     right->type());
   }
-  auto leftValue = std::dynamic_pointer_cast<StringObject>(left)->value;
-  auto rightValue = std::dynamic_pointer_cast<StringObject>(right)->value;
-  return std::make_shared<StringObject>(leftValue + rightValue);
+  return _concatenate(staticRefCast<StringObject>(left),
+                      staticRefCast<StringObject>(right));
 }
 
-std::shared_ptr<Object>
+// Short results are interned, so building a string that exists already
+// allocates nothing.
+ObjectPtr Evaluator::_concatenate(const Ref<StringObject> &left,
+                                  const Ref<StringObject> &right) {
+  auto length = left->length() + right->length();
+  if (length > _maxInternedLength)
+    return StringObject::concat(left, right);
+  char buffer[_maxInternedLength];
+  std::memcpy(buffer, left->value().data(), left->length());
+  std::memcpy(buffer + left->length(), right->value().data(), right->length());
+  return _strings.intern(std::string_view(buffer, length));
+}
+
+ObjectPtr
 Evaluator::_evaluateIfExpression(const IfExpressionPtr &ie) {
   auto condition = evaluate(ie->condition);
-  if (_isError(condition))
+  if (_isInterrupted())
     return condition;
   if (_isTruthy(condition)) {
     return evaluate(ie->consequence);
   } else if (ie->alternative != nullptr) {
     return evaluate(ie->alternative);
   }
-  return NULL_;
+  return _null;
+}
+
+// Loops run their bodies in the current environment rather than opening a
+// scope per iteration, so an iteration allocates nothing of its own.
+ObjectPtr Evaluator::_evaluateWhileExpression(const WhileExpressionPtr &node) {
+  while (true) {
+    auto condition = evaluate(node->condition);
+    if (_isInterrupted())
+      return condition;
+    if (!_isTruthy(condition))
+      return _null;
+    auto result = _evaluateBlockStatement(node->body);
+    if (_isInterrupted())
+      return result;
+  }
+}
+
+ObjectPtr Evaluator::_evaluateForExpression(const ForExpressionPtr &node) {
+  auto iterable = evaluate(node->iterable);
+  if (_isInterrupted())
+    return iterable;
+  if (iterable->type() != ARRAY_OBJ)
+    return _newError("cannot iterate over %s", iterable->type());
+
+  // Iterates over the elements the array had when the loop started; stores
+  // into it from the body copy the changed paths instead.
+  auto array = static_cast<ArrayObject *>(iterable.get());
+  auto elements = array->slice(0, array->size());
+  for (size_t i = 0; i < elements->size(); i++) {
+    _environment->set(node->variable->value, elements->at(i));
+    auto result = _evaluateBlockStatement(node->body);
+    if (_isInterrupted())
+      return result;
+  }
+  return _null;
 }
 
-std::shared_ptr<Object> Evaluator::_evaluateBlockStatement(
+ObjectPtr Evaluator::_evaluateBlockStatement(
     const BlockStatementPtr &block) {
-  std::shared_ptr<Object> result;
+  ObjectPtr result;
   for (const auto &statement : block->statements) {
     result = evaluate(statement);
-    if (result->type() == RETURN_VALUE_OBJ || result->type() == ERROR_OBJ) {
+    if (_isInterrupted()) {
       return result;
     }
   }
   return result;
 }
 
-std::shared_ptr<Object>
+ObjectPtr
 Evaluator::_evaluateIdentifier(const IdentifierPtr &node) {
   auto value = _environment->get(node->value);
   if (value->type() != NULL_OBJ) {
     return value;
   }
 
-  if (builtins.contains(node->value)){
-    return std::make_shared<BuiltinObject>(builtins.at(node->value));
+  // The environment is still consulted first so that a later binding can
+  // shadow the builtin; only the builtin lookup and allocation are cached.
+  if (loadQuickened(node->specialization) == SPECIALIZED_BUILTIN) {
+    return ObjectPtr(loadQuickened(node->cachedBuiltin));
+  }
+
+  auto builtin = builtins.find(node->value);
+  if (builtin != builtins.end()) {
+    storeQuickened(node->cachedBuiltin,
+                   static_cast<Object *>(builtin->second.get()));
+    storeQuickened(node->specialization, SPECIALIZED_BUILTIN);
+    return builtin->second;
   }
 
-  return _newError("identifier not found: %s", node->value.c_str());
+  return _newError("identifier not found: %s", node->value);
 }
 
-std::shared_ptr<Object> Evaluator::_evaluateFunctionLiteral(
+ObjectPtr Evaluator::_evaluateFunctionLiteral(
     const FunctionLiteralExpressionPtr &node) {
-  return std::make_shared<FunctionObject>(node->parameters, node->body,
-                                          _environment);
+  auto environment = _environment;
+  if (node->captureMode == CAPTURE_NONE)
+    environment = _globals;
+  else if (node->captureMode == CAPTURE_FLAT)
+    environment = _captureEnvironment(node);
+
+  if (node->prototype == nullptr)
+    node->prototype = newPrototype(node.get());
+  if (_tracksCaptures && environment != _globals)
+    _noteCaptured(environment);
+  return makeRef<FunctionObject>(node->prototype, environment);
+}
+
+// Closures made in a loop capture the same environment over and over; it is
+// kept once. Environments freed meanwhile are pruned before the list grows.
+void Evaluator::_noteCaptured(
+    const std::shared_ptr<Environment> &environment) {
+  if (!_captured.empty() && !_captured.back().owner_before(environment) &&
+      !environment.owner_before(_captured.back()))
+    return;
+  if (_captured.size() == _captured.capacity()) {
+    std::erase_if(_captured,
+                  [](const auto &captured) { return captured.expired(); });
+    if (_captured.size() > _captured.capacity() / 2)
+      _captured.reserve(_captured.capacity() * 2);
+  }
+  _captured.push_back(environment);
 }
 
-std::vector<std::shared_ptr<Object>> Evaluator::_evaluateExpressions(
+// Finds the captured frames that only closures bound in captured frames, and
+// frames they enclose, refer to, and drops their bindings. A frame referred
+// to from anywhere else, directly or through such closures, stays intact, as
+// does everything it reaches. Closures held by anything but a binding, an
+// array for instance, count as references from elsewhere.
+void Evaluator::_breakCycles() {
+  std::unordered_map<Environment *, std::shared_ptr<Environment>> frames;
+  for (const auto &captured : _captured) {
+    if (auto frame = captured.lock())
+      frames.emplace(frame.get(), std::move(frame));
+  }
+  _captured.clear();
+  if (frames.empty())
+    return;
+
+  std::unordered_map<Environment *, long> internal;
+  std::unordered_map<FunctionObject *, uint32_t> bound;
+  for (const auto &[environment, frame] : frames) {
+    if (frames.contains(frame->outer().get()))
+      internal[frame->outer().get()]++;
+    frame->forEachValue([&](const ObjectPtr &value) {
+      if (auto function = dynamic_cast<FunctionObject *>(value.get()))
+        bound[function]++;
+    });
+  }
+  for (const auto &[function, bindings] : bound) {
+    if (function->refCount() == bindings &&
+        frames.contains(function->environment.get()))
+      internal[function->environment.get()]++;
+  }
+
+  // The map holds one reference to every frame.
+  std::unordered_set<Environment *> live;
+  std::vector<Environment *> pending;
+  for (const auto &[environment, frame] : frames) {
+    if (frame.use_count() - 1 > internal[environment]) {
+      live.insert(environment);
+      pending.push_back(environment);
+    }
+  }
+  auto reach = [&](Environment *environment) {
+    if (frames.contains(environment) && live.insert(environment).second)
+      pending.push_back(environment);
+  };
+  while (!pending.empty()) {
+    auto environment = pending.back();
+    pending.pop_back();
+    reach(environment->outer().get());
+    environment->forEachValue([&](const ObjectPtr &value) {
+      if (auto function = dynamic_cast<FunctionObject *>(value.get()))
+        reach(function->environment.get());
+    });
+  }
+
+  for (const auto &[environment, frame] : frames) {
+    if (!live.contains(environment))
+      frame->reset(nullptr);
+  }
+}
+
+// Threads of a parallel evaluation must not race to build the prototypes of
+// the literals they share, so all of them are built up front.
+void Evaluator::_preparePrototypes(const NodePtr &node) {
+  if (node->nodeType() == FUNCTION_LITERAL) {
+    auto function = static_cast<FunctionLiteralExpression *>(node.get());
+    if (function->prototype == nullptr)
+      function->prototype = newPrototype(function);
+  }
+  forEachChild(node,
+               [this](const NodePtr &child) { _preparePrototypes(child); });
+}
+
+// Copies the captured variables out of the enclosing call frames. A name that
+// is not bound yet (its let was skipped by a branch) falls back to keeping
+// the chain, which is what a lookup at call time would have seen.
+std::shared_ptr<Environment>
+Evaluator::_captureEnvironment(const FunctionLiteralExpressionPtr &node) {
+  auto captured = _globals->createEnclosedEnvironment();
+  for (const auto &name : node->captures) {
+    auto value = _environment->getUntil(name, _globals.get());
+    if (value == nullptr)
+      return _environment;
+    captured->set(name, value);
+  }
+  return captured;
+}
+
+ObjectPtrVec Evaluator::_evaluateExpressions(
     ExpressionPtrVec arguments) {
-  std::vector<std::shared_ptr<Object>> result;
+  if (_mode == RUNTIME_PARALLEL && _shouldForkCalls(arguments))
+    return _evaluateConcurrently(arguments);
+
+  ObjectPtrVec result;
 
   for (auto &argument : arguments) {
     auto evaluated = evaluate(argument);
-    if (_isError(evaluated))
+    if (_isInterrupted())
       return {evaluated};
     result.push_back(evaluated);
   }
@@ -355,81 +1530,393 @@ std::vector<std::shared_ptr<Object>> Evaluator::_evaluateExpressions(
   return result;
 }
 
-std::shared_ptr<Object> Evaluator::_evaluateCallExpression(
+// Forking pays off when there are at least two calls to run side by side and
+// the pool is not saturated already. All expressions must be pure so that
+// evaluating them out of order cannot be observed.
+bool Evaluator::_shouldForkCalls(const ExpressionPtrVec &expressions) const {
+  size_t calls = 0;
+  for (const auto &expression : expressions) {
+    if (!expression->pure)
+      return false;
+    if (expression->nodeType() == CALL_EXPRESSION)
+      calls++;
+  }
+  auto &pool = WorkStealingPool::shared();
+  return calls >= 2 && pool.pendingTasks() < pool.size();
+}
+
+// Runs every call but the first on the pool, each in an evaluator of its own
+// that shares the environment, and evaluates the rest on this thread. The
+// first interrupted expression in source order decides the outcome, as it
+// would sequentially.
+ObjectPtrVec
+Evaluator::_evaluateConcurrently(const ExpressionPtrVec &expressions) {
+  ObjectPtrVec results(expressions.size());
+  std::vector<Completion> completions(expressions.size(), COMPLETION_NORMAL);
+  {
+    TaskGroup tasks(WorkStealingPool::shared());
+    bool first = true;
+    for (size_t i = 0; i < expressions.size(); i++) {
+      if (expressions[i]->nodeType() != CALL_EXPRESSION)
+        continue;
+      if (first) {
+        first = false;
+        continue;
+      }
+      tasks.run([this, environment = _environment, &expressions, &results,
+                 &completions, i] {
+        Evaluator worker(_globals, RUNTIME_PARALLEL);
+        worker._environment = environment;
+        worker._tracksCaptures = false;
+        results[i] = worker.evaluate(expressions[i]);
+        completions[i] = worker._completion;
+      });
+    }
+
+    first = true;
+    for (size_t i = 0; i < expressions.size(); i++) {
+      if (expressions[i]->nodeType() == CALL_EXPRESSION) {
+        if (!first)
+          continue;
+        first = false;
+      }
+      results[i] = evaluate(expressions[i]);
+      completions[i] = _completion;
+      if (_isInterrupted())
+        break;
+    }
+  }
+
+  for (size_t i = 0; i < expressions.size(); i++) {
+    if (completions[i] != COMPLETION_NORMAL) {
+      _completion = completions[i];
+      return {results[i]};
+    }
+  }
+  return results;
+}
+
+ObjectPtr Evaluator::_evaluateCallExpression(
     const CallExpressionPtr &node) {
   auto function = evaluate(node->function);
-  if (_isError(function))
+  if (_isInterrupted())
     return function;
   auto arguments = _evaluateExpressions(node->arguments);
-  if (arguments.size() == 1 && _isError(arguments[0]))
+  if (_isInterrupted())
     return arguments[0];
+
+  switch (loadQuickened(node->specialization)) {
+  case SPECIALIZED_FUNCTION:
+    if (auto fn = dynamicRefCast<FunctionObject>(function))
+      return _applyFunctionObject(fn, arguments);
+    storeQuickened(node->specialization, GENERIC);
+    break;
+  case SPECIALIZED_BUILTIN:
+    if (auto builtin = dynamic_cast<BuiltinObject *>(function.get()))
+      return _applyBuiltin(*builtin, arguments);
+    storeQuickened(node->specialization, GENERIC);
+    break;
+  case UNSPECIALIZED:
+    if (function->type() == FUNCTION_OBJ) {
+      storeQuickened(node->specialization, SPECIALIZED_FUNCTION);
+    } else if (function->type() == BUILTIN_OBJ) {
+      storeQuickened(node->specialization, SPECIALIZED_BUILTIN);
+    } else {
+      storeQuickened(node->specialization, GENERIC);
+    }
+    break;
+  default:
+    break;
+  }
   return _applyFunction(function, arguments);
 }
 
-std::shared_ptr<Object> Evaluator::_evaluateIndexExpression(std::shared_ptr<Object> left, std::shared_ptr<Object> index){
+ObjectPtr Evaluator::_evaluateIndexExpression(ObjectPtr left, ObjectPtr index){
   if (left->type() == ARRAY_OBJ && index->type() == INTEGER_OBJ) {
     return _evaluateArrayIndexExpression(left, index);
   }
-  return _newError("index operator not supported: %s", left->type().c_str());
+  if (left->type() == HASH_OBJ) {
+    return _evaluateHashIndexExpression(left, index);
+  }
+  if (left->type() == STRING_OBJ && index->type() == INTEGER_OBJ) {
+    return _evaluateStringIndexExpression(left, index);
+  }
+  return _newError("index operator not supported: %s", left->type());
 }
 
-std::shared_ptr<Object> Evaluator::_evaluateArrayIndexExpression(std::shared_ptr<Object> array, std::shared_ptr<Object> index) {
-  auto arrayObject = std::dynamic_pointer_cast<ArrayObject>(array);
-  auto indexObject = std::dynamic_pointer_cast<IntegerObject>(index);
+ObjectPtr
+Evaluator::_evaluateAssignExpression(const AssignExpressionPtr &node) {
+  if (node->target->nodeType() == IDENTIFIER) {
+    auto value = evaluate(node->value);
+    if (_isInterrupted())
+      return value;
+    auto &name = static_cast<Identifier *>(node->target.get())->value;
+    if (!_environment->assign(name, value))
+      return _newError("identifier not found: %s", name);
+    return value;
+  }
+
+  if (node->target->nodeType() == FIELD_EXPRESSION)
+    return _evaluateFieldAssignment(node);
+
+  // Elements are stored in place, so every holder of the array or hash sees
+  // them.
+  auto target = static_cast<IndexExpression *>(node->target.get());
+  auto array = evaluate(target->left);
+  if (_isInterrupted())
+    return array;
+  auto index = evaluate(target->index);
+  if (_isInterrupted())
+    return index;
+  auto value = evaluate(node->value);
+  if (_isInterrupted())
+    return value;
+  if (array->type() == HASH_OBJ) {
+    if (!HashObject::isHashable(index))
+      return _newError("unusable as hash key: %s", index->type());
+    static_cast<HashObject *>(array.get())
+        ->pairs.insert_or_assign(index, value);
+    return value;
+  }
+  if (array->type() != ARRAY_OBJ || index->type() != INTEGER_OBJ)
+    return _newError("index assignment not supported: %s[%s]", array->type(),
+                     index->type());
+  auto arrayObject = static_cast<ArrayObject *>(array.get());
+  auto i = static_cast<IntegerObject *>(index.get())->value;
+  if (i < 0 || static_cast<size_t>(i) >= arrayObject->size())
+    return _newError("index out of range: %d", i);
+  arrayObject->set(i, value);
+  return value;
+}
+
+ObjectPtr Evaluator::_evaluateArrayIndexExpression(ObjectPtr array,
+                                                   ObjectPtr index) {
+  auto arrayObject = dynamicRefCast<ArrayObject>(array);
+  auto indexObject = dynamicRefCast<IntegerObject>(index);
   auto idx = indexObject->value;
-  auto max = arrayObject->elements.size() - 1;
 
-  if (idx < 0 || idx > max) return NULL_;
-  return arrayObject->elements[idx];
+  if (idx < 0 || static_cast<size_t>(idx) >= arrayObject->size())
+    return _null;
+  return arrayObject->at(idx);
+}
+
+// The code point at the index, as a string of its own.
+ObjectPtr Evaluator::_evaluateStringIndexExpression(ObjectPtr string,
+                                                    ObjectPtr index) {
+  auto stringObject = static_cast<StringObject *>(string.get());
+  auto i = static_cast<IntegerObject *>(index.get())->value;
+  if (i < 0 || static_cast<size_t>(i) >= stringObject->codePoints())
+    return _null;
+  auto start = stringObject->byteOffset(i);
+  return _strings.intern(stringObject->value().substr(
+      start, stringObject->byteOffset(i + 1) - start));
+}
+
+ObjectPtr
+Evaluator::_evaluateHashLiteral(const HashLiteralExpressionPtr &node) {
+  auto hash = makeRef<HashObject>();
+  for (const auto &[keyNode, valueNode] : node->pairs) {
+    auto key = evaluate(keyNode);
+    if (_isInterrupted())
+      return key;
+    if (!HashObject::isHashable(key))
+      return _newError("unusable as hash key: %s", key->type());
+    auto value = evaluate(valueNode);
+    if (_isInterrupted())
+      return value;
+    hash->pairs.insert_or_assign(std::move(key), std::move(value));
+  }
+  return hash;
+}
+
+ObjectPtr Evaluator::_evaluateHashIndexExpression(ObjectPtr hash,
+                                                  ObjectPtr index) {
+  if (!HashObject::isHashable(index))
+    return _newError("unusable as hash key: %s", index->type());
+  auto value = static_cast<HashObject *>(hash.get())->pairs.find(index);
+  return value != nullptr ? *value : _null;
+}
+
+ObjectPtr
+Evaluator::_evaluateRecordLiteral(const RecordLiteralExpressionPtr &node) {
+  auto shape = loadQuickened(node->shape);
+  if (shape == nullptr) {
+    shape = Shape::empty();
+    for (const auto &name : node->names)
+      shape = shape->with(name);
+    storeQuickened(node->shape, shape);
+  }
+  auto values = _evaluateExpressions(node->values);
+  if (_isInterrupted())
+    return values[0];
+  return makeRef<RecordObject>(shape, std::move(values));
+}
+
+// The field `node` names in `record`, or nullptr. A field expression caches
+// the field it found last, which a record of the same shape has in the same
+// slot; other shapes replace it, so a site seeing several keeps up with the
+// latest.
+static const ShapeField *lookupField(FieldExpression &node,
+                                     const RecordObject &record) {
+  auto cached = loadQuickened(node.cachedField);
+  if (cached != nullptr && cached->shape == record.shape)
+    return cached;
+  auto field = record.shape->find(node.name);
+  if (field != nullptr)
+    storeQuickened(node.cachedField, field);
+  return field;
+}
+
+ObjectPtr Evaluator::_evaluateFieldExpression(const FieldExpressionPtr &node) {
+  auto left = evaluate(node->left);
+  if (_isInterrupted())
+    return left;
+  if (left->type() != RECORD_OBJ)
+    return _newError("field access not supported: %s", left->type());
+  auto record = static_cast<RecordObject *>(left.get());
+  auto field = lookupField(*node, *record);
+  if (field == nullptr)
+    return _newError("record has no field: %s", node->name);
+  return record->values[field->slot];
+}
+
+// Fields are stored in place, like array elements.
+ObjectPtr
+Evaluator::_evaluateFieldAssignment(const AssignExpressionPtr &node) {
+  auto target = static_cast<FieldExpression *>(node->target.get());
+  auto left = evaluate(target->left);
+  if (_isInterrupted())
+    return left;
+  auto value = evaluate(node->value);
+  if (_isInterrupted())
+    return value;
+  if (left->type() != RECORD_OBJ)
+    return _newError("field assignment not supported: %s", left->type());
+  auto record = static_cast<RecordObject *>(left.get());
+  auto field = lookupField(*target, *record);
+  if (field == nullptr)
+    return _newError("record has no field: %s", target->name);
+  record->values[field->slot] = value;
+  return value;
 }
 
-std::shared_ptr<Object> Evaluator::_applyFunction(
-    const std::shared_ptr<Object> &function,
-    const std::vector<std::shared_ptr<Object>> &arguments) {
+ObjectPtr Evaluator::_applyFunction(
+    const ObjectPtr &function,
+    const ObjectPtrVec &arguments) {
   if (function->type() == FUNCTION_OBJ) {
-    auto fn = std::dynamic_pointer_cast<FunctionObject>(function);
-    auto extendedEnv = _extendFunctionEnvironment(fn, arguments);
-    Evaluator _evaluator(extendedEnv);
-    auto evaluated = _evaluator.evaluate(fn->body);
-    return _unwrapReturnValue(evaluated);
+    return _applyFunctionObject(
+        dynamicRefCast<FunctionObject>(function), arguments);
   }
   if (function->type() == BUILTIN_OBJ) {
-    auto builtin = std::dynamic_pointer_cast<BuiltinObject>(function);
-    return builtin->value(arguments);
+    auto builtin = dynamicRefCast<BuiltinObject>(function);
+    return _applyBuiltin(*builtin, arguments);
   }
-  return _newError("not a function: %s", function->type().c_str());
+  if (function->type() == MEMO_OBJ)
+    return _applyMemo(*static_cast<MemoObject *>(function.get()), arguments);
+  return _newError("not a function: %s", function->type());
+}
+
+// Only completed results are cached; errors are recomputed on every call.
+ObjectPtr Evaluator::_applyMemo(MemoObject &memo,
+                                const ObjectPtrVec &arguments) {
+  std::string key;
+  if (!MemoObject::key(arguments, key))
+    return _applyFunctionObject(memo.function, arguments);
+  if (auto cached = memo.lookup(key))
+    return cached;
+  auto result = _applyFunctionObject(memo.function, arguments);
+  if (!_isInterrupted())
+    memo.store(std::move(key), result);
+  return result;
+}
+
+// Builtins report errors by value; turn those into an error completion.
+ObjectPtr
+Evaluator::_applyBuiltin(const BuiltinObject &builtin,
+                         const ObjectPtrVec &arguments) {
+  auto result = builtin.value(arguments);
+  if (result->type() == ERROR_OBJ)
+    _completion = COMPLETION_ERROR;
+  return result;
+}
+
+ObjectPtr Evaluator::_applyFunctionObject(
+    const Ref<FunctionObject> &function,
+    const ObjectPtrVec &arguments) {
+  auto extendedEnv = _extendFunctionEnvironment(function, arguments);
+  auto callerEnv = _environment;
+  _environment = extendedEnv;
+  auto evaluated = evaluate(function->prototype->body);
+  _environment = callerEnv;
+  if (function->prototype->reusesFrames)
+    _releaseFrame(std::move(extendedEnv));
+  if (_completion == COMPLETION_RETURN)
+    _completion = COMPLETION_NORMAL;
+  return evaluated;
 }
 
 std::shared_ptr<Environment> Evaluator::_extendFunctionEnvironment(
-    const std::shared_ptr<FunctionObject> &function,
-    const std::vector<std::shared_ptr<Object>> &arguments) {
+    const Ref<FunctionObject> &function,
+    const ObjectPtrVec &arguments) {
 
-  auto environment = function->environment->createEnclosedEnvironment();
-  for (size_t i = 0; i < function->parameters.size(); i++) {
-    function->environment->set(function->parameters[i]->value, arguments[i]);
+  const auto &prototype = *function->prototype;
+  auto environment = prototype.reusesFrames
+                         ? _acquireFrame(function->environment)
+                         : function->environment->createEnclosedEnvironment();
+  environment->reserve(prototype.frameSize);
+  for (size_t i = 0; i < prototype.arity; i++) {
+    environment->set(prototype.parameters[i]->value, arguments[i]);
   }
   return environment;
 }
 
-std::shared_ptr<Object>
-Evaluator::_unwrapReturnValue(const std::shared_ptr<Object> &object) {
-  if (object->type() == RETURN_VALUE_OBJ) {
-    return std::dynamic_pointer_cast<ReturnValueObject>(object)->value;
+std::shared_ptr<Environment>
+Evaluator::_acquireFrame(const std::shared_ptr<Environment> &outer) {
+  if (_frames.empty()) {
+    auto frame = std::allocate_shared<Environment>(
+        RuntimeStlAllocator<Environment, Environment>());
+    frame->reset(outer);
+    return frame;
   }
-  return object;
+  auto frame = std::move(_frames.back());
+  _frames.pop_back();
+  frame->reset(outer);
+  return frame;
+}
+
+void Evaluator::_releaseFrame(std::shared_ptr<Environment> frame) {
+  // A frame still referenced elsewhere is left to its owners rather than
+  // recycled under them.
+  if (frame.use_count() != 1 || _frames.size() >= _maxPooledFrames)
+    return;
+  frame->reset(nullptr);
+  _frames.push_back(std::move(frame));
 }
 
-bool Evaluator::_isTruthy(const std::shared_ptr<Object> &obj) {
-  return !(obj == NULL_ || obj == FALSE_);
+ObjectPtr Evaluator::_boolean(bool value) { return value ? _true : _false; }
+
+bool Evaluator::_isTruthy(const ObjectPtr &obj) {
+  if (obj == _true)
+    return true;
+  if (obj == _false || obj == _null)
+    return false;
+  // Builtins and unbound lookups hand out the process-wide singletons.
+  if (auto boolean = dynamic_cast<BooleanObject *>(obj.get()))
+    return boolean->value;
+  return obj->type() != NULL_OBJ;
+}
+
+bool Evaluator::_isSame(const ObjectPtr &left, const ObjectPtr &right) {
+  return isSame(left, right);
 }
 
 template <typename... Args>
-std::shared_ptr<Object> Evaluator::_newError(const std::string &format_,
+ObjectPtr Evaluator::_newError(const char *format,
                                              Args &&...args) {
-
-  return std::make_shared<ErrorObject>(string_format(format_, args...));
+  _completion = COMPLETION_ERROR;
+  return newError(format, std::forward<Args>(args)...);
 }
 
-bool Evaluator::_isError(const std::shared_ptr<Object> &obj) {
-  return obj->type() == ERROR_OBJ;
+bool Evaluator::_isInterrupted() const {
+  return _completion != COMPLETION_NORMAL;
 }
\ No newline at end of file
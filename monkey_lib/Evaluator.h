@@ -8,68 +8,167 @@
 #include <unordered_map>
 
 
-extern const std::unordered_map<std::string, BuiltinObject> builtins;
+extern const std::unordered_map<std::string, Ref<BuiltinObject>> builtins;
 
 
+enum Completion { COMPLETION_NORMAL, COMPLETION_RETURN, COMPLETION_ERROR };
+
+// A single-threaded evaluator (an isolate confined to its thread) counts
+// references to the objects it creates without atomics and has its own null
+// and boolean singletons. Multi-threaded evaluators share the process-wide
+// ones. A parallel evaluator is multi-threaded and in addition evaluates
+// independent pure calls among call arguments and array elements
+// concurrently on the shared WorkStealingPool.
+enum RuntimeMode {
+  RUNTIME_SINGLE_THREADED,
+  RUNTIME_MULTI_THREADED,
+  RUNTIME_PARALLEL
+};
+
+// An evaluator given an allocator makes it current while it evaluates, so the
+// objects, frames and strings of its scripts come from that heap. A region
+// has to outlive the evaluator and every value taken out of it.
+//
+// A closure bound in the call frame it captures keeps both alive. When an
+// evaluator is destroyed it drops the bindings of the frames it created that
+// nothing but such cycles refers to any more. The environment it was given is
+// never touched: closures bound there keep it alive until the host clears it.
 class Evaluator {
 public:
-  explicit Evaluator(const std::shared_ptr<Environment> &environment);
-  std::shared_ptr<Object> evaluate(const NodePtr &node);
+  explicit Evaluator(const std::shared_ptr<Environment> &environment,
+                     RuntimeMode mode = RUNTIME_SINGLE_THREADED,
+                     Allocator *allocator = nullptr);
+  ~Evaluator();
+  ObjectPtr evaluate(const NodePtr &node);
 
 private:
-  std::shared_ptr<Object>
+  ObjectPtr
   _evaluateProgram(const StatementPtrVec &statements);
-  std::shared_ptr<Object>
+  ObjectPtr
   _evaluatePrefixExpression(const std::string &op,
-                            const std::shared_ptr<Object> &right);
-  std::shared_ptr<Object>
-  _evaluateBangOperatorExpression(const std::shared_ptr<Object> &right);
-  std::shared_ptr<Object>
-  _evaluateMinusPrefixOperatorExpression(const std::shared_ptr<Object> &right);
-  std::shared_ptr<Object>
+                            const ObjectPtr &right);
+  ObjectPtr
+  _evaluateBangOperatorExpression(const ObjectPtr &right);
+  ObjectPtr
+  _evaluateMinusPrefixOperatorExpression(const ObjectPtr &right);
+  ObjectPtr
+  _evaluateUnboxedExpression(const ExpressionPtr &expression);
+  bool _evaluateUnboxed(const ExpressionPtr &expression, int64_t &value,
+                        ObjectPtr &boxed);
+  ObjectPtr _box(StaticType type, int64_t value);
+  ObjectPtr _boolean(bool value);
+  ObjectPtr _evaluateInfixNode(const InfixExpressionPtr &node);
+  void _quickenInfixExpression(const InfixExpressionPtr &node,
+                               const ObjectPtr &left,
+                               const ObjectPtr &right);
+  ObjectPtr
+  _evaluateIntegerOperation(InfixOperator op, int64_t left, int64_t right);
+  ObjectPtr
   _evaluateInfixExpression(const std::string &op,
-                           const std::shared_ptr<Object> &left,
-                           const std::shared_ptr<Object> &right);
-  std::shared_ptr<Object>
+                           const ObjectPtr &left,
+                           const ObjectPtr &right);
+  ObjectPtr
   _evaluateIntegerInfixExpression(const std::string &op,
-                                  const std::shared_ptr<Object> &left,
-                                  const std::shared_ptr<Object> &right);
-  std::shared_ptr<Object>
+                                  const ObjectPtr &left,
+                                  const ObjectPtr &right);
+  ObjectPtr
+  _evaluateArrayInfixExpression(const std::string &op,
+                                const ObjectPtr &left,
+                                const ObjectPtr &right);
+  ObjectPtr _concatenate(const Ref<StringObject> &left,
+                         const Ref<StringObject> &right);
+  ObjectPtr
   _evaluateStringInfixExpression(const std::string &op,
-                                 const std::shared_ptr<Object> &left,
-                                 const std::shared_ptr<Object> &right);
-  std::shared_ptr<Object>
+                                 const ObjectPtr &left,
+                                 const ObjectPtr &right);
+  ObjectPtr
   _evaluateIfExpression(const IfExpressionPtr &ie);
-  std::shared_ptr<Object>
+  ObjectPtr _evaluateAssignExpression(const AssignExpressionPtr &node);
+  ObjectPtr _evaluateWhileExpression(const WhileExpressionPtr &node);
+  ObjectPtr _evaluateForExpression(const ForExpressionPtr &node);
+  ObjectPtr
   _evaluateBlockStatement(const BlockStatementPtr &block);
-  std::shared_ptr<Object>
+  ObjectPtr
   _evaluateIdentifier(const IdentifierPtr &node);
-  std::shared_ptr<Object> _evaluateFunctionLiteral(
+  ObjectPtr _evaluateFunctionLiteral(
       const FunctionLiteralExpressionPtr &node);
-  std::shared_ptr<Object>
+  ObjectPtr
   _evaluateCallExpression(const CallExpressionPtr &node);
-  std::shared_ptr<Object> 
-      _evaluateIndexExpression(std::shared_ptr<Object> left, std::shared_ptr<Object> index);
-  std::vector<std::shared_ptr<Object>>
+  ObjectPtr 
+      _evaluateIndexExpression(ObjectPtr left, ObjectPtr index);
+  ObjectPtrVec
   _evaluateExpressions(ExpressionPtrVec arguments);
-  std::shared_ptr<Object>
-  _evaluateArrayIndexExpression(std::shared_ptr<Object> array, std::shared_ptr<Object> index);
-  std::shared_ptr<Object>
-  _applyFunction(const std::shared_ptr<Object> &function,
-                 const std::vector<std::shared_ptr<Object>> &arguments);
+  bool _shouldForkCalls(const ExpressionPtrVec &expressions) const;
+  ObjectPtrVec _evaluateConcurrently(const ExpressionPtrVec &expressions);
+  void _preparePrototypes(const NodePtr &node);
+  ObjectPtr
+  _evaluateArrayIndexExpression(ObjectPtr array, ObjectPtr index);
+  ObjectPtr _evaluateHashLiteral(const HashLiteralExpressionPtr &node);
+  ObjectPtr _evaluateHashIndexExpression(ObjectPtr hash, ObjectPtr index);
+  ObjectPtr _evaluateStringIndexExpression(ObjectPtr string, ObjectPtr index);
+  ObjectPtr _evaluateRecordLiteral(const RecordLiteralExpressionPtr &node);
+  ObjectPtr _evaluateFieldExpression(const FieldExpressionPtr &node);
+  ObjectPtr _evaluateFieldAssignment(const AssignExpressionPtr &node);
+  ObjectPtr
+  _applyFunction(const ObjectPtr &function,
+                 const ObjectPtrVec &arguments);
+  ObjectPtr
+  _applyBuiltin(const BuiltinObject &builtin,
+                const ObjectPtrVec &arguments);
+  ObjectPtr _applyMemo(MemoObject &memo, const ObjectPtrVec &arguments);
+  ObjectPtr
+  _applyFunctionObject(const Ref<FunctionObject> &function,
+                       const ObjectPtrVec &arguments);
+  std::shared_ptr<Environment>
+  _captureEnvironment(const FunctionLiteralExpressionPtr &node);
+  void _noteCaptured(const std::shared_ptr<Environment> &environment);
+  void _breakCycles();
   std::shared_ptr<Environment> _extendFunctionEnvironment(
-      const std::shared_ptr<FunctionObject> &function,
-      const std::vector<std::shared_ptr<Object>> &arguments);
-  std::shared_ptr<Object>
-  _unwrapReturnValue(const std::shared_ptr<Object> &object);
+      const Ref<FunctionObject> &function,
+      const ObjectPtrVec &arguments);
+  std::shared_ptr<Environment>
+  _acquireFrame(const std::shared_ptr<Environment> &outer);
+  void _releaseFrame(std::shared_ptr<Environment> frame);
 
-  static bool _isTruthy(const std::shared_ptr<Object> &obj);
+  bool _isTruthy(const ObjectPtr &obj);
+  bool _isSame(const ObjectPtr &left, const ObjectPtr &right);
 
   template <typename... Args>
-  std::shared_ptr<Object> _newError(const std::string &format, Args &&...args);
-  static bool _isError(const std::shared_ptr<Object> &obj);
+  ObjectPtr _newError(const char *format, Args &&...args);
+  // Whether a return or an error is unwinding the evaluation, in which case
+  // the value just produced must be passed up unchanged.
+  bool _isInterrupted() const;
+
+  RuntimeMode _mode;
+  Allocator *_allocator;
+  ObjectPtr _null;
+  ObjectPtr _true;
+  ObjectPtr _false;
+  // Holds string literals and strings built at runtime that are at most
+  // _maxInternedLength long.
+  StringTable _strings;
+  static constexpr size_t _maxInternedLength = 32;
 
   std::shared_ptr<Environment> _environment;
+  // How the last evaluated node completed. `return` and errors pass their
+  // value up the ordinary return path and set this instead of wrapping it.
+  Completion _completion = COMPLETION_NORMAL;
+  // The environment programs are evaluated in; closures that capture nothing
+  // from enclosing functions are lifted to it.
+  std::shared_ptr<Environment> _globals;
+
+  // Call frames of functions whose environment cannot escape are taken from
+  // and returned to this stack instead of being allocated per call.
+  static constexpr size_t _maxPooledFrames = 256;
+  std::vector<std::shared_ptr<Environment>> _frames;
+  // The arrays an element-wise operator is being applied to, outermost
+  // first, to stop at an array that holds itself.
+  std::vector<const ArrayObject *> _combining;
+  // The frames this evaluator created that closures captured, to break the
+  // cycles among them once it is done. Workers of a parallel evaluation
+  // share their frames with other threads and keep none.
+  std::vector<std::weak_ptr<Environment>> _captured;
+  bool _tracksCaptures = true;
 };
 
 #endif // MONKEY_EVALUATOR_H
@@ -2,6 +2,7 @@
 #include "Evaluator.h"
 #include "Lexer.h"
 #include "Object.h"
+#include "Optimizer.h"
 #include "Parser.h"
 #include "REPL.h"
 
@@ -9,7 +10,8 @@
 #include <iostream>
 #include <sstream>
 
-int FileRunner::run(const std::string &path) {
+int FileRunner::run(const std::string &path, OptimizationLevel level,
+                    RuntimeMode mode) {
   std::ifstream in(path);
   if (!in) {
     std::cerr << "monkey: could not open file: " << path << std::endl;
@@ -19,7 +21,7 @@ int FileRunner::run(const std::string &path) {
   buf << in.rdbuf();
 
   auto environment = std::make_shared<Environment>();
-  Evaluator evaluator(environment);
+  Evaluator evaluator(environment, mode);
 
   auto lexer = new Lexer(buf.str());
   auto parser = new Parser(lexer);
@@ -28,6 +30,7 @@ int FileRunner::run(const std::string &path) {
     REPL::printParseErrors(parser->errors());
     return 1;
   }
+  Optimizer(level).optimize(program);
 
   auto evaluated = evaluator.evaluate(program);
   if (evaluated != nullptr && evaluated->type() == ERROR_OBJ) {
@@ -1,11 +1,14 @@
 #ifndef MONKEY_FILERUNNER_H
 #define MONKEY_FILERUNNER_H
 
+#include "Evaluator.h"
+#include "Optimizer.h"
 #include <string>
 
 class FileRunner {
 public:
-  static int run(const std::string &path);
+  static int run(const std::string &path, OptimizationLevel level = O1,
+                 RuntimeMode mode = RUNTIME_SINGLE_THREADED);
 };
 
 #endif // MONKEY_FILERUNNER_H
@@ -0,0 +1,239 @@
+#ifndef MONKEY_HASHTABLE_H
+#define MONKEY_HASHTABLE_H
+
+#include "Allocator.h"
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// An open-addressing hash table laid out like a Swiss table. Slots come in
+// groups of 16, each with a control byte holding 7 bits of the hash of the
+// key in it, so a probe compares a whole group against the key's hash at once
+// and only looks at the keys whose bits match. Probing stops at the first
+// group with an empty slot.
+//
+// Slots refer to entries kept in a separate array in insertion order, so
+// iteration follows insertion order and does not touch the slots. Removed
+// entries are skipped until the table is rebuilt.
+template <typename K, typename V, typename Hash = std::hash<K>,
+          typename Equal = std::equal_to<K>>
+class HashTable {
+  static constexpr size_t _groupSize = 16;
+  static constexpr int8_t _empty = -128;
+  static constexpr int8_t _deleted = -2;
+  static constexpr size_t _none = SIZE_MAX;
+
+public:
+  struct Entry {
+    K key;
+    V value;
+  };
+
+private:
+  struct Stored {
+    Entry entry;
+    size_t hash;
+    bool removed;
+  };
+  typedef std::vector<Stored, RuntimeStlAllocator<Stored>> StoredVec;
+
+public:
+  class const_iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Entry;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Entry *;
+    using reference = const Entry &;
+
+    const_iterator() = default;
+
+    reference operator*() const { return _stored->entry; }
+    pointer operator->() const { return &_stored->entry; }
+    const_iterator &operator++() {
+      ++_stored;
+      _skipRemoved();
+      return *this;
+    }
+    const_iterator operator++(int) {
+      auto previous = *this;
+      ++*this;
+      return previous;
+    }
+    bool operator==(const const_iterator &other) const {
+      return _stored == other._stored;
+    }
+
+  private:
+    friend class HashTable;
+
+    const_iterator(const Stored *stored, const Stored *end)
+        : _stored(stored), _end(end) {
+      _skipRemoved();
+    }
+    void _skipRemoved() {
+      while (_stored != _end && _stored->removed)
+        ++_stored;
+    }
+
+    const Stored *_stored = nullptr;
+    const Stored *_end = nullptr;
+  };
+
+  size_t size() const { return _size; }
+  bool empty() const { return _size == 0; }
+
+  const V *find(const K &key) const {
+    auto slot = _find(key, Hash{}(key));
+    return slot == _none ? nullptr : &_entries[_slots[slot]].entry.value;
+  }
+  V *find(const K &key) {
+    return const_cast<V *>(std::as_const(*this).find(key));
+  }
+  bool contains(const K &key) const { return find(key) != nullptr; }
+
+  // Returns true if `key` was not in the table yet.
+  bool insert_or_assign(K key, V value) {
+    auto hash = Hash{}(key);
+    auto slot = _find(key, hash);
+    if (slot != _none) {
+      _entries[_slots[slot]].entry.value = std::move(value);
+      return false;
+    }
+
+    if ((_used + 1) * 8 > _control.size() * 7)
+      _rehash(_size + 1 > _control.size() / 2 ? _control.size() * 2 : 0);
+    slot = _freeSlot(hash);
+    if (_control[slot] == _empty)
+      _used++;
+    _control[slot] = _tag(hash);
+    _slots[slot] = static_cast<uint32_t>(_entries.size());
+    _entries.push_back({{std::move(key), std::move(value)}, hash, false});
+    _size++;
+    return true;
+  }
+
+  // Returns false if `key` was not in the table.
+  bool erase(const K &key) {
+    auto slot = _find(key, Hash{}(key));
+    if (slot == _none)
+      return false;
+    auto &stored = _entries[_slots[slot]];
+    stored.entry = Entry();
+    stored.removed = true;
+    _control[slot] = _deleted;
+    _size--;
+    // Compacts the entries once most of them are removed.
+    if (_entries.size() > 2 * _size + _groupSize)
+      _rehash(0);
+    return true;
+  }
+
+  const_iterator begin() const {
+    return const_iterator(_entries.data(), _entries.data() + _entries.size());
+  }
+  const_iterator end() const {
+    auto end = _entries.data() + _entries.size();
+    return const_iterator(end, end);
+  }
+
+private:
+  // The 7 bits of a hash kept in the control byte, and the rest, which picks
+  // the group to start probing at.
+  static int8_t _tag(size_t hash) { return static_cast<int8_t>(hash & 0x7f); }
+  static size_t _start(size_t hash) { return hash >> 7; }
+
+  // A bit for each slot of the group at `control` whose control byte is
+  // `byte`.
+  static uint32_t _match(const int8_t *control, int8_t byte) {
+#ifdef __SSE2__
+    auto group = _mm_loadu_si128(reinterpret_cast<const __m128i *>(control));
+    return static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(byte))));
+#else
+    uint32_t matches = 0;
+    for (size_t i = 0; i < _groupSize; i++)
+      matches |= uint32_t(control[i] == byte) << i;
+    return matches;
+#endif
+  }
+
+  // Groups are probed in triangular order, which reaches each of them once
+  // since their number is a power of two.
+  size_t _find(const K &key, size_t hash) const {
+    if (_size == 0)
+      return _none;
+    auto mask = _control.size() / _groupSize - 1;
+    auto group = _start(hash) & mask;
+    for (size_t step = 1;; step++) {
+      auto first = group * _groupSize;
+      auto control = _control.data() + first;
+      for (auto matches = _match(control, _tag(hash)); matches != 0;
+           matches &= matches - 1) {
+        auto slot = first + std::countr_zero(matches);
+        auto &stored = _entries[_slots[slot]];
+        if (stored.hash == hash && Equal{}(stored.entry.key, key))
+          return slot;
+      }
+      if (_match(control, _empty) != 0)
+        return _none;
+      group = (group + step) & mask;
+    }
+  }
+
+  // The first empty or deleted slot along the probe sequence of `hash`.
+  size_t _freeSlot(size_t hash) const {
+    auto mask = _control.size() / _groupSize - 1;
+    auto group = _start(hash) & mask;
+    for (size_t step = 1;; step++) {
+      auto control = _control.data() + group * _groupSize;
+      auto free = _match(control, _empty) | _match(control, _deleted);
+      if (free != 0)
+        return group * _groupSize + std::countr_zero(free);
+      group = (group + step) & mask;
+    }
+  }
+
+  // Drops removed entries and rebuilds the slots with `capacity` of them, or
+  // as many as there are now if it is 0.
+  void _rehash(size_t capacity) {
+    if (capacity == 0)
+      capacity = _control.size();
+    if (capacity < _groupSize)
+      capacity = _groupSize;
+
+    StoredVec entries;
+    entries.reserve(_size);
+    for (auto &stored : _entries) {
+      if (!stored.removed)
+        entries.push_back(std::move(stored));
+    }
+    _entries = std::move(entries);
+    _control.assign(capacity, _empty);
+    _slots.assign(capacity, 0);
+    for (size_t i = 0; i < _entries.size(); i++) {
+      auto hash = _entries[i].hash;
+      auto slot = _freeSlot(hash);
+      _control[slot] = _tag(hash);
+      _slots[slot] = static_cast<uint32_t>(i);
+    }
+    _used = _entries.size();
+  }
+
+  std::vector<int8_t, RuntimeStlAllocator<int8_t>> _control;
+  std::vector<uint32_t, RuntimeStlAllocator<uint32_t>> _slots;
+  StoredVec _entries;
+  size_t _size = 0;
+  // Slots that are full or deleted; probing needs some to stay empty.
+  size_t _used = 0;
+};
+
+#endif // MONKEY_HASHTABLE_H
@@ -0,0 +1,401 @@
+#include "IntegerKernels.h"
+
+#include <algorithm>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MONKEY_AVX2_KERNELS
+#endif
+
+namespace {
+
+#ifdef MONKEY_AVX2_KERNELS
+#define AVX2 __attribute__((target("avx2")))
+#endif
+
+// Stores `left[i] op right[i]` in `result[i]` for each of `count` elements.
+typedef void (*ElementWise)(const int64_t *left, const int64_t *right,
+                            int64_t *result, size_t count);
+
+// The loops over a single run of elements. Sums and products are taken over
+// unsigned integers, whose overflow is defined to wrap.
+struct Kernels {
+  uint64_t (*sum)(const int64_t *values, size_t count);
+  int64_t (*min)(const int64_t *values, size_t count);
+  int64_t (*max)(const int64_t *values, size_t count);
+  uint64_t (*dot)(const int64_t *left, const int64_t *right, size_t count);
+  bool (*contains)(const int64_t *values, size_t count, int64_t value);
+  // Indexed by operator.
+  ElementWise elementWise[OP_NOT_EQ + 1];
+};
+
+// The operators on one pair of elements, and on four pairs at once where
+// AVX2 has an instruction for them.
+struct Add {
+  static int64_t apply(int64_t left, int64_t right) {
+    return static_cast<int64_t>(static_cast<uint64_t>(left) +
+                                static_cast<uint64_t>(right));
+  }
+#ifdef MONKEY_AVX2_KERNELS
+  AVX2 static __m256i apply(__m256i left, __m256i right) {
+    return _mm256_add_epi64(left, right);
+  }
+#endif
+};
+
+struct Subtract {
+  static int64_t apply(int64_t left, int64_t right) {
+    return static_cast<int64_t>(static_cast<uint64_t>(left) -
+                                static_cast<uint64_t>(right));
+  }
+#ifdef MONKEY_AVX2_KERNELS
+  AVX2 static __m256i apply(__m256i left, __m256i right) {
+    return _mm256_sub_epi64(left, right);
+  }
+#endif
+};
+
+struct Multiply {
+  static int64_t apply(int64_t left, int64_t right) {
+    return static_cast<int64_t>(static_cast<uint64_t>(left) *
+                                static_cast<uint64_t>(right));
+  }
+#ifdef MONKEY_AVX2_KERNELS
+  AVX2 static __m256i apply(__m256i left, __m256i right);
+#endif
+};
+
+// AVX2 cannot divide integers.
+struct Divide {
+  static int64_t apply(int64_t left, int64_t right) {
+    // The one quotient that does not fit wraps like the other operators.
+    if (right == -1)
+      return Subtract::apply(0, left);
+    return left / right;
+  }
+};
+
+struct Less {
+  static int64_t apply(int64_t left, int64_t right) { return left < right; }
+#ifdef MONKEY_AVX2_KERNELS
+  AVX2 static __m256i apply(__m256i left, __m256i right) {
+    return _mm256_and_si256(_mm256_cmpgt_epi64(right, left),
+                            _mm256_set1_epi64x(1));
+  }
+#endif
+};
+
+struct Greater {
+  static int64_t apply(int64_t left, int64_t right) { return left > right; }
+#ifdef MONKEY_AVX2_KERNELS
+  AVX2 static __m256i apply(__m256i left, __m256i right) {
+    return _mm256_and_si256(_mm256_cmpgt_epi64(left, right),
+                            _mm256_set1_epi64x(1));
+  }
+#endif
+};
+
+struct Equal {
+  static int64_t apply(int64_t left, int64_t right) { return left == right; }
+#ifdef MONKEY_AVX2_KERNELS
+  AVX2 static __m256i apply(__m256i left, __m256i right) {
+    return _mm256_and_si256(_mm256_cmpeq_epi64(left, right),
+                            _mm256_set1_epi64x(1));
+  }
+#endif
+};
+
+struct NotEqual {
+  static int64_t apply(int64_t left, int64_t right) { return left != right; }
+#ifdef MONKEY_AVX2_KERNELS
+  AVX2 static __m256i apply(__m256i left, __m256i right) {
+    return _mm256_andnot_si256(_mm256_cmpeq_epi64(left, right),
+                               _mm256_set1_epi64x(1));
+  }
+#endif
+};
+
+template <typename Operator>
+void elementWiseScalar(const int64_t *left, const int64_t *right,
+                       int64_t *result, size_t count) {
+  for (size_t i = 0; i < count; i++)
+    result[i] = Operator::apply(left[i], right[i]);
+}
+
+uint64_t sumScalar(const int64_t *values, size_t count) {
+  uint64_t total = 0;
+  for (size_t i = 0; i < count; i++)
+    total += static_cast<uint64_t>(values[i]);
+  return total;
+}
+
+int64_t minScalar(const int64_t *values, size_t count) {
+  return *std::min_element(values, values + count);
+}
+
+int64_t maxScalar(const int64_t *values, size_t count) {
+  return *std::max_element(values, values + count);
+}
+
+uint64_t dotScalar(const int64_t *left, const int64_t *right, size_t count) {
+  uint64_t total = 0;
+  for (size_t i = 0; i < count; i++)
+    total += static_cast<uint64_t>(left[i]) * static_cast<uint64_t>(right[i]);
+  return total;
+}
+
+bool containsScalar(const int64_t *values, size_t count, int64_t value) {
+  return std::find(values, values + count, value) != values + count;
+}
+
+constexpr Kernels scalarKernels = {
+    sumScalar,
+    minScalar,
+    maxScalar,
+    dotScalar,
+    containsScalar,
+    {nullptr, elementWiseScalar<Add>, elementWiseScalar<Subtract>,
+     elementWiseScalar<Multiply>, elementWiseScalar<Divide>,
+     elementWiseScalar<Less>, elementWiseScalar<Greater>,
+     elementWiseScalar<Equal>, elementWiseScalar<NotEqual>}};
+
+#ifdef MONKEY_AVX2_KERNELS
+
+// Four elements per vector.
+constexpr size_t lanes = 4;
+
+AVX2 __m256i load(const int64_t *values) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values));
+}
+
+AVX2 void store(int64_t *values, __m256i vector) {
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(values), vector);
+}
+
+// The low 64 bits of each product; AVX2 only multiplies 32-bit halves.
+AVX2 __m256i multiply(__m256i left, __m256i right) {
+  auto low = _mm256_mul_epu32(left, right);
+  auto cross =
+      _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(left, 32), right),
+                       _mm256_mul_epu32(left, _mm256_srli_epi64(right, 32)));
+  return _mm256_add_epi64(low, _mm256_slli_epi64(cross, 32));
+}
+
+AVX2 __m256i Multiply::apply(__m256i left, __m256i right) {
+  return multiply(left, right);
+}
+
+AVX2 uint64_t sumLanes(__m256i vector) {
+  int64_t values[lanes];
+  store(values, vector);
+  return sumScalar(values, lanes);
+}
+
+AVX2 uint64_t sumAvx2(const int64_t *values, size_t count) {
+  auto total = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + lanes <= count; i += lanes)
+    total = _mm256_add_epi64(total, load(values + i));
+  return sumLanes(total) + sumScalar(values + i, count - i);
+}
+
+AVX2 int64_t minAvx2(const int64_t *values, size_t count) {
+  if (count < lanes)
+    return minScalar(values, count);
+  auto least = load(values);
+  size_t i = lanes;
+  for (; i + lanes <= count; i += lanes) {
+    auto next = load(values + i);
+    least = _mm256_blendv_epi8(least, next, _mm256_cmpgt_epi64(least, next));
+  }
+  int64_t candidates[lanes];
+  store(candidates, least);
+  auto result = minScalar(candidates, lanes);
+  return i == count ? result
+                    : std::min(result, minScalar(values + i, count - i));
+}
+
+AVX2 int64_t maxAvx2(const int64_t *values, size_t count) {
+  if (count < lanes)
+    return maxScalar(values, count);
+  auto greatest = load(values);
+  size_t i = lanes;
+  for (; i + lanes <= count; i += lanes) {
+    auto next = load(values + i);
+    greatest =
+        _mm256_blendv_epi8(greatest, next, _mm256_cmpgt_epi64(next, greatest));
+  }
+  int64_t candidates[lanes];
+  store(candidates, greatest);
+  auto result = maxScalar(candidates, lanes);
+  return i == count ? result
+                    : std::max(result, maxScalar(values + i, count - i));
+}
+
+AVX2 uint64_t dotAvx2(const int64_t *left, const int64_t *right, size_t count) {
+  auto total = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + lanes <= count; i += lanes)
+    total = _mm256_add_epi64(total, multiply(load(left + i), load(right + i)));
+  return sumLanes(total) + dotScalar(left + i, right + i, count - i);
+}
+
+AVX2 bool containsAvx2(const int64_t *values, size_t count, int64_t value) {
+  auto needle = _mm256_set1_epi64x(value);
+  size_t i = 0;
+  for (; i + lanes <= count; i += lanes) {
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi64(load(values + i), needle)))
+      return true;
+  }
+  return containsScalar(values + i, count - i, value);
+}
+
+template <typename Operator>
+AVX2 void elementWiseAvx2(const int64_t *left, const int64_t *right,
+                          int64_t *result, size_t count) {
+  size_t i = 0;
+  for (; i + lanes <= count; i += lanes)
+    store(result + i, Operator::apply(load(left + i), load(right + i)));
+  elementWiseScalar<Operator>(left + i, right + i, result + i, count - i);
+}
+
+constexpr Kernels avx2Kernels = {
+    sumAvx2,
+    minAvx2,
+    maxAvx2,
+    dotAvx2,
+    containsAvx2,
+    {nullptr, elementWiseAvx2<Add>, elementWiseAvx2<Subtract>,
+     elementWiseAvx2<Multiply>, elementWiseScalar<Divide>,
+     elementWiseAvx2<Less>, elementWiseAvx2<Greater>, elementWiseAvx2<Equal>,
+     elementWiseAvx2<NotEqual>}};
+
+bool supportsAvx2() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+const Kernels *kernels = supportsAvx2() ? &avx2Kernels : &scalarKernels;
+
+#else
+
+const Kernels *kernels = &scalarKernels;
+
+#endif // MONKEY_AVX2_KERNELS
+
+// Calls `visit(values, count)` on each run of adjacent elements in order.
+template <typename F>
+void forEachRun(const IntegerKernels::Integers &vector, F visit) {
+  for (size_t i = 0; i < vector.size();) {
+    auto [values, count] = vector.run(i);
+    visit(values, count);
+    i += count;
+  }
+}
+
+// A run of one number, standing in for an array of it.
+struct Broadcast {
+  explicit Broadcast(int64_t value) { std::fill_n(values, size, value); }
+  std::pair<const int64_t *, size_t> run(size_t) const {
+    return {values, size};
+  }
+
+  static constexpr size_t size = 32;
+  int64_t values[size];
+};
+
+// Applies `op` over `size` elements, taking runs from `left` and `right`
+// until one of them or the leaf being written ends.
+template <typename Left, typename Right>
+IntegerKernels::Integers elementWise(InfixOperator op, size_t size,
+                                     const Left &left, const Right &right) {
+  auto kernel = kernels->elementWise[op];
+  return IntegerKernels::Integers::generate(
+      size, [&](int64_t *result, size_t index, size_t count) {
+        for (size_t done = 0; done < count;) {
+          auto [leftValues, leftCount] = left.run(index + done);
+          auto [rightValues, rightCount] = right.run(index + done);
+          auto next = std::min({leftCount, rightCount, count - done});
+          kernel(leftValues, rightValues, result + done, next);
+          done += next;
+        }
+      });
+}
+
+} // namespace
+
+int64_t IntegerKernels::sum(const Integers &values) {
+  uint64_t total = 0;
+  forEachRun(values, [&total](const int64_t *run, size_t count) {
+    total += kernels->sum(run, count);
+  });
+  return static_cast<int64_t>(total);
+}
+
+int64_t IntegerKernels::min(const Integers &values) {
+  auto result = values.front();
+  forEachRun(values, [&result](const int64_t *run, size_t count) {
+    result = std::min(result, kernels->min(run, count));
+  });
+  return result;
+}
+
+int64_t IntegerKernels::max(const Integers &values) {
+  auto result = values.front();
+  forEachRun(values, [&result](const int64_t *run, size_t count) {
+    result = std::max(result, kernels->max(run, count));
+  });
+  return result;
+}
+
+int64_t IntegerKernels::dot(const Integers &left, const Integers &right) {
+  // The vectors may be windows starting at different places in their leaves,
+  // so a run ends where either side's does.
+  uint64_t total = 0;
+  for (size_t i = 0; i < left.size();) {
+    auto [leftValues, leftCount] = left.run(i);
+    auto [rightValues, rightCount] = right.run(i);
+    auto count = std::min(leftCount, rightCount);
+    total += kernels->dot(leftValues, rightValues, count);
+    i += count;
+  }
+  return static_cast<int64_t>(total);
+}
+
+bool IntegerKernels::contains(const Integers &values, int64_t value) {
+  for (size_t i = 0; i < values.size();) {
+    auto [run, count] = values.run(i);
+    if (kernels->contains(run, count, value))
+      return true;
+    i += count;
+  }
+  return false;
+}
+
+IntegerKernels::Integers IntegerKernels::apply(InfixOperator op,
+                                               const Integers &left,
+                                               const Integers &right) {
+  return elementWise(op, left.size(), left, right);
+}
+
+IntegerKernels::Integers
+IntegerKernels::apply(InfixOperator op, const Integers &left, int64_t right) {
+  return elementWise(op, left.size(), left, Broadcast(right));
+}
+
+IntegerKernels::Integers
+IntegerKernels::apply(InfixOperator op, int64_t left, const Integers &right) {
+  return elementWise(op, right.size(), Broadcast(left), right);
+}
+
+bool IntegerKernels::vectorized() { return kernels != &scalarKernels; }
+
+bool IntegerKernels::useVectorized(bool enabled) {
+#ifdef MONKEY_AVX2_KERNELS
+  kernels = enabled && supportsAvx2() ? &avx2Kernels : &scalarKernels;
+#else
+  (void)enabled;
+#endif
+  return vectorized();
+}
@@ -0,0 +1,42 @@
+#ifndef MONKEY_INTEGERKERNELS_H
+#define MONKEY_INTEGERKERNELS_H
+
+#include "AST.h"
+#include "PersistentVector.h"
+#include <cstddef>
+#include <cstdint>
+
+// Loops over unboxed integer arrays. They visit a vector one leaf at a time,
+// since a leaf keeps its elements next to each other in memory, and use AVX2
+// when the processor has it, plain loops otherwise. Arithmetic wraps around
+// on overflow either way.
+class IntegerKernels {
+public:
+  typedef PersistentVector<int64_t> Integers;
+
+  static int64_t sum(const Integers &values);
+  // `values` must not be empty.
+  static int64_t min(const Integers &values);
+  static int64_t max(const Integers &values);
+  // `left` and `right` must be the same size.
+  static int64_t dot(const Integers &left, const Integers &right);
+  static bool contains(const Integers &values, int64_t value);
+
+  // Applies the arithmetic or comparison operator `op` to each pair of
+  // elements at the same index, or to each element and a number on the
+  // other side; comparisons give 1 or 0. Arrays must be the same size, and
+  // it is up to the caller to rule out division by zero.
+  static Integers apply(InfixOperator op, const Integers &left,
+                        const Integers &right);
+  static Integers apply(InfixOperator op, const Integers &left, int64_t right);
+  static Integers apply(InfixOperator op, int64_t left, const Integers &right);
+
+  // Whether the AVX2 loops are in use.
+  static bool vectorized();
+  // Switches between the AVX2 and the plain loops, so that both can be
+  // tested on one machine. AVX2 is only used where it is supported; returns
+  // whether it is.
+  static bool useVectorized(bool enabled);
+};
+
+#endif // MONKEY_INTEGERKERNELS_H
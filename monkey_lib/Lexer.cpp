@@ -29,6 +29,12 @@ Token Lexer::nextToken() {
   case ';':
     token.type = SEMICOLON;
     break;
+  case ':':
+    token.type = COLON;
+    break;
+  case '.':
+    token.type = DOT;
+    break;
   case '(':
     token.type = LPAREN;
     break;
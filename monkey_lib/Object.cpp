@@ -1,19 +1,267 @@
 #include "Object.h"
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <string_view>
 #include <utility>
 
-ErrorObject::ErrorObject(std::string message) : message(std::move(message)) {}
+#include "StringKernels.h"
+
+void ErrorArgument::appendTo(std::string &message) const {
+  if (auto integer = std::get_if<int64_t>(&_value))
+    message += std::to_string(*integer);
+  else if (auto text = std::get_if<RuntimeString>(&_value))
+    message += *text;
+  else
+    message += std::get<ObjectPtr>(_value)->inspect();
+}
+
+ErrorObject::ErrorObject(std::string message) : _message(std::move(message)) {}
+ErrorObject::ErrorObject(const char *format,
+                         std::initializer_list<ErrorArgument> arguments)
+    : _format(format) {
+  for (const auto &argument : arguments)
+    _arguments[_argumentCount++] = argument;
+}
 ObjectType ErrorObject::type() { return ERROR_OBJ; }
-std::string ErrorObject::inspect() { return "ERROR: " + message; }
+std::string ErrorObject::inspect() { return "ERROR: " + message(); }
+
+const std::string &ErrorObject::message() {
+  if (_format == nullptr)
+    return _message;
+  size_t next = 0;
+  for (auto c = _format; *c != '\0'; c++) {
+    if (c[0] == '%' && (c[1] == 's' || c[1] == 'd') &&
+        next < _argumentCount) {
+      _arguments[next++].appendTo(_message);
+      c++;
+    } else {
+      _message += *c;
+    }
+  }
+  _format = nullptr;
+  _arguments = {};
+  _argumentCount = 0;
+  return _message;
+}
 
 IntegerObject::IntegerObject(int64_t value) : value(value) {}
 ObjectType IntegerObject::type() { return INTEGER_OBJ; }
 std::string IntegerObject::inspect() { return std::to_string(value); }
 
-StringObject::StringObject(std::string value) : value(std::move(value)) {}
+StringObject::StringObject(std::string_view value)
+    : _value(value), _length(value.size()),
+      _codePoints(StringKernels::countCodePoints(value)) {}
+StringObject::StringObject(RuntimeString &&value)
+    : _value(std::move(value)), _length(_value.size()),
+      _codePoints(StringKernels::countCodePoints(_value)) {}
+
+// Releasing a long chain of appends half by half would recurse as deep as
+// the chain, so the halves nobody else holds are taken apart here instead.
+StringObject::~StringObject() {
+  if (_left == nullptr)
+    return;
+  std::vector<Ref<StringObject>> pieces;
+  pieces.push_back(std::move(_left));
+  pieces.push_back(std::move(_right));
+  while (!pieces.empty()) {
+    auto piece = std::move(pieces.back());
+    pieces.pop_back();
+    if (piece->refCount() == 1 && piece->_left != nullptr) {
+      pieces.push_back(std::move(piece->_left));
+      pieces.push_back(std::move(piece->_right));
+    }
+  }
+}
+
 ObjectType StringObject::type() { return STRING_OBJ; }
-std::string StringObject::inspect() { return value; }
+std::string StringObject::inspect() {
+  std::string out;
+  out.reserve(_length);
+  _forEachPiece([&out](std::string_view piece) { out += piece; });
+  return out;
+}
+
+Ref<StringObject> StringObject::concat(const Ref<StringObject> &left,
+                                       const Ref<StringObject> &right) {
+  auto length = left->_length + right->_length;
+  if (length <= _maxCopied) {
+    RuntimeString value;
+    value.reserve(length);
+    value += left->value();
+    value += right->value();
+    return makeRef<StringObject>(std::move(value));
+  }
+  auto rope = makeRef<StringObject>();
+  rope->_left = left;
+  rope->_right = right;
+  rope->_length = length;
+  rope->_codePoints = left->_codePoints + right->_codePoints;
+  rope->_flat = false;
+  return rope;
+}
+
+// A shared rope is flattened, and a shared string indexed, under one of a few
+// locks picked by its address.
+static std::mutex &flattenLock(const void *string) {
+  static std::mutex locks[64];
+  return locks[std::hash<const void *>{}(string) % 64];
+}
+
+Ref<StringObject> StringObject::substring(const Ref<StringObject> &string,
+                                          size_t start, size_t length,
+                                          bool share) {
+  auto characters = string->value().substr(start, length);
+  if (!share || length < _minShared)
+    return makeRef<StringObject>(characters);
+  auto view = makeRef<StringObject>();
+  // A view of a view shares the buffer of the string owning it.
+  view->_parent = string->_parent != nullptr ? string->_parent : string;
+  view->_data = characters.data();
+  view->_length = length;
+  view->_codePoints = StringKernels::countCodePoints(characters);
+  return view;
+}
+
+bool StringObject::worthSharing(size_t used, size_t size) {
+  auto unused = size - used;
+  return unused <= used || unused <= _maxWasted;
+}
+
+std::string_view StringObject::value() const {
+  if (!_isFlat()) {
+    if (isThreadConfined()) {
+      _flatten();
+    } else {
+      std::lock_guard lock(flattenLock(this));
+      if (!std::atomic_ref<bool>(_flat).load(std::memory_order_relaxed))
+        _flatten();
+    }
+  }
+  return _flatValue();
+}
+
+size_t StringObject::byteOffset(size_t codePoint) const {
+  if (codePoint >= _codePoints)
+    return _length;
+  if (_codePoints == _length)
+    return codePoint;
+  // The index is built under the lock, and value() may take it too.
+  auto value = this->value();
+  if (!_isIndexed()) {
+    if (isThreadConfined()) {
+      _buildIndex(value);
+    } else {
+      std::lock_guard lock(flattenLock(this));
+      if (!std::atomic_ref<bool>(_indexed).load(std::memory_order_relaxed))
+        _buildIndex(value);
+    }
+  }
+  auto offset = _offsets[codePoint / _indexStride];
+  for (auto skipped = codePoint % _indexStride; skipped > 0; skipped--) {
+    auto lead = static_cast<unsigned char>(value[offset]);
+    offset += lead < 0xE0 ? (lead < 0x80 ? 1 : 2) : (lead < 0xF0 ? 3 : 4);
+  }
+  return offset;
+}
+
+bool StringObject::_isIndexed() const {
+  if (isThreadConfined())
+    return _indexed;
+  return std::atomic_ref<bool>(_indexed).load(std::memory_order_acquire);
+}
+
+void StringObject::_buildIndex(std::string_view value) const {
+  _offsets.reserve(_codePoints / _indexStride + 1);
+  size_t codePoint = 0;
+  for (size_t i = 0; i < value.size(); i++) {
+    // Continuation bytes are 10xxxxxx.
+    if ((static_cast<unsigned char>(value[i]) & 0xC0) == 0x80)
+      continue;
+    if (codePoint++ % _indexStride == 0)
+      _offsets.push_back(i);
+  }
+  if (isThreadConfined())
+    _indexed = true;
+  else
+    std::atomic_ref<bool>(_indexed).store(true, std::memory_order_release);
+}
+
+bool StringObject::_isFlat() const {
+  if (isThreadConfined())
+    return _flat;
+  return std::atomic_ref<bool>(_flat).load(std::memory_order_acquire);
+}
+
+void StringObject::_flatten() const {
+  RuntimeString value;
+  value.reserve(_length);
+  _forEachPiece([&value](std::string_view piece) { value += piece; });
+  _value = std::move(value);
+  if (!isThreadConfined()) {
+    std::atomic_ref<bool>(_flat).store(true, std::memory_order_release);
+    return;
+  }
+  _flat = true;
+  _left = nullptr;
+  _right = nullptr;
+}
+
+// The halves of a rope never change until it is flattened, and a flat
+// string's buffer never changes after.
+template <typename F> void StringObject::_forEachPiece(F visit) const {
+  std::vector<const StringObject *> pending{this};
+  while (!pending.empty()) {
+    auto string = pending.back();
+    pending.pop_back();
+    if (string->_isFlat()) {
+      visit(string->_flatValue());
+    } else {
+      pending.push_back(string->_right.get());
+      pending.push_back(string->_left.get());
+    }
+  }
+}
+
+// Threads of a parallel evaluation may race to fill in the cache, but they
+// all store the same value.
+size_t StringObject::hash() const {
+  auto cached = std::atomic_ref<size_t>(_hash).load(std::memory_order_relaxed);
+  if (cached != 0)
+    return cached;
+  auto hash = std::hash<std::string_view>{}(value()) | 1;
+  std::atomic_ref<size_t>(_hash).store(hash, std::memory_order_relaxed);
+  return hash;
+}
+
+bool StringObject::equals(const StringObject &other) const {
+  if (this == &other)
+    return true;
+  if (_table != 0 && _table == other._table)
+    return false;
+  if (_length != other._length || hash() != other.hash())
+    return false;
+  return value() == other.value();
+}
+
+StringTable::StringTable() {
+  static std::atomic<uint64_t> ids = 0;
+  _id = ++ids;
+}
+
+Ref<StringObject> StringTable::intern(std::string_view value) {
+  if (auto interned = _strings.find(value))
+    return *interned;
+  auto string = makeRef<StringObject>(value);
+  if (_strings.size() == capacity)
+    return string;
+  string->_table = _id;
+  _strings.insert_or_assign(string->value(), string);
+  return string;
+}
 
 BooleanObject::BooleanObject(bool value) : value(value) {}
 ObjectType BooleanObject::type() { return BOOLEAN_OBJ; }
@@ -22,20 +270,13 @@ std::string BooleanObject::inspect() { return value ? "true" : "false"; }
 ObjectType NullObject::type() { return NULL_OBJ; }
 std::string NullObject::inspect() { return "null"; }
 
-ReturnValueObject::ReturnValueObject(std::shared_ptr<Object> value)
-    : value(std::move(value)) {}
-ObjectType ReturnValueObject::type() { return RETURN_VALUE_OBJ; }
-std::string ReturnValueObject::inspect() { return value->inspect(); }
-
-FunctionObject::FunctionObject(
-    IdentifierPtrVec parameters,
-    BlockStatementPtr body,
-    std::shared_ptr<Environment> environment)
-    : parameters(std::move(parameters)), body(std::move(body)),
-      environment(std::move(environment)) {}
+FunctionObject::FunctionObject(FunctionPrototypePtr prototype,
+                               std::shared_ptr<Environment> environment)
+    : prototype(std::move(prototype)), environment(std::move(environment)) {}
 
 ObjectType FunctionObject::type() { return FUNCTION_OBJ; }
 std::string FunctionObject::inspect() {
+  const auto &parameters = prototype->parameters;
   std::string out = "fn(";
   for (size_t i = 0; i < parameters.size(); i++) {
     out += parameters[i]->string();
@@ -44,7 +285,7 @@ std::string FunctionObject::inspect() {
     }
   }
   out += ") {\n";
-  out += body->string();
+  out += prototype->body->string();
   out += "\n}";
   return out;
 }
@@ -53,14 +294,322 @@ BuiltinObject::BuiltinObject(BuiltinFunction value) : value(std::move(value)) {}
 ObjectType BuiltinObject::type() { return BUILTIN_OBJ; }
 std::string BuiltinObject::inspect() { return "builtin function"; }
 
-ArrayObject::ArrayObject(std::vector<std::shared_ptr<Object>> elements) : elements(std::move(elements)) {}
+ArrayObject::ArrayObject(const ObjectPtrVec &elements)
+    : _unboxed(std::all_of(elements.begin(), elements.end(),
+                           [](const ObjectPtr &element) {
+                             return element->type() == INTEGER_OBJ;
+                           })) {
+  if (!_unboxed) {
+    _elements = Elements(elements.begin(), elements.end());
+    return;
+  }
+  for (const auto &element : elements)
+    _integers.push_back(static_cast<IntegerObject *>(element.get())->value);
+}
+ArrayObject::ArrayObject(Elements elements)
+    : _unboxed(false), _elements(std::move(elements)) {}
+ArrayObject::ArrayObject(Integers integers)
+    : _unboxed(true), _integers(std::move(integers)) {}
 ObjectType ArrayObject::type() { return ARRAY_OBJ; }
+// The containers being inspected on this thread, outermost first. Arrays,
+// hashes and records can hold themselves, directly or through each other;
+// a container met again inside itself prints as [...], {...} or
+// record {...}.
+static thread_local std::vector<const Object *> inspecting;
+
+class InspectScope {
+public:
+  explicit InspectScope(const Object *container)
+      : _cycle(std::find(inspecting.begin(), inspecting.end(), container) !=
+               inspecting.end()) {
+    if (!_cycle)
+      inspecting.push_back(container);
+  }
+  ~InspectScope() {
+    if (!_cycle)
+      inspecting.pop_back();
+  }
+  bool isCycle() const { return _cycle; }
+
+private:
+  bool _cycle;
+};
+
 std::string ArrayObject::inspect() {
+  InspectScope scope(this);
+  if (scope.isCycle())
+    return "[...]";
   std::string out = "[";
-  for (size_t i = 0; i < elements.size(); i++) {
-    out += elements[i]->inspect();
-    if (i != elements.size() -1 ) out += ", ";
+  for (size_t i = 0; i < size(); i++) {
+    out += _unboxed ? std::to_string(_integers[i]) : _elements[i]->inspect();
+    if (i != size() - 1) out += ", ";
   }
   out += "]";
   return out;
-}
\ No newline at end of file
+}
+
+ObjectPtr ArrayObject::at(size_t index) const {
+  if (_unboxed)
+    return makeRef<IntegerObject>(_integers[index]);
+  return _elements[index];
+}
+
+void ArrayObject::push(ObjectPtr element) {
+  if (_unboxed && element->type() == INTEGER_OBJ) {
+    _integers.push_back(static_cast<IntegerObject *>(element.get())->value);
+    return;
+  }
+  _box();
+  _elements.push_back(std::move(element));
+}
+
+void ArrayObject::set(size_t index, ObjectPtr element) {
+  if (_unboxed && element->type() == INTEGER_OBJ) {
+    _integers.set(index, static_cast<IntegerObject *>(element.get())->value);
+    return;
+  }
+  _box();
+  _elements.set(index, std::move(element));
+}
+
+Ref<ArrayObject> ArrayObject::slice(size_t start, size_t end) const {
+  if (_unboxed)
+    return makeRef<ArrayObject>(_integers.slice(start, end));
+  return makeRef<ArrayObject>(_elements.slice(start, end));
+}
+
+// The result shares this array's nodes and copies the other one's elements
+// onto its tail. It stays unboxed only if both arrays are.
+Ref<ArrayObject> ArrayObject::concat(const ArrayObject &other) const {
+  if (_unboxed && other._unboxed) {
+    auto integers = _integers;
+    for (auto value : other._integers)
+      integers.push_back(value);
+    return makeRef<ArrayObject>(std::move(integers));
+  }
+  auto elements = _boxed();
+  for (size_t i = 0; i < other.size(); i++)
+    elements.push_back(other.at(i));
+  return makeRef<ArrayObject>(std::move(elements));
+}
+
+bool ArrayObject::toIntegers(Integers &integers) const {
+  if (_unboxed) {
+    integers = _integers;
+    return true;
+  }
+  integers = Integers();
+  for (const auto &element : _elements) {
+    if (element->type() != INTEGER_OBJ)
+      return false;
+    integers.push_back(static_cast<IntegerObject *>(element.get())->value);
+  }
+  return true;
+}
+
+ArrayObject::Elements ArrayObject::_boxed() const {
+  if (!_unboxed)
+    return _elements;
+  Elements elements;
+  for (auto value : _integers)
+    elements.push_back(makeRef<IntegerObject>(value));
+  return elements;
+}
+
+void ArrayObject::_box() {
+  if (!_unboxed)
+    return;
+  _elements = _boxed();
+  _integers = Integers();
+  _unboxed = false;
+}
+
+// Mixes the bits of `value` so that the low and high bits of the result,
+// which pick the control byte and the group of a slot, both depend on all of
+// them.
+static size_t mix(uint64_t value) {
+  value ^= value >> 33;
+  value *= 0xff51afd7ed558ccdULL;
+  value ^= value >> 33;
+  value *= 0xc4ceb9fe1a85ec53ULL;
+  value ^= value >> 33;
+  return static_cast<size_t>(value);
+}
+
+size_t HashObject::KeyHash::operator()(const ObjectPtr &key) const {
+  if (auto integer = dynamic_cast<IntegerObject *>(key.get()))
+    return mix(static_cast<uint64_t>(integer->value));
+  if (auto string = dynamic_cast<StringObject *>(key.get()))
+    return mix(string->hash());
+  // Kept apart from the integers 0 and 1.
+  auto boolean = static_cast<BooleanObject *>(key.get());
+  return mix(boolean->value ? 0x9e3779b9 : 0x7f4a7c15);
+}
+
+bool HashObject::KeyEqual::operator()(const ObjectPtr &left,
+                                      const ObjectPtr &right) const {
+  if (left->type() != right->type())
+    return false;
+  if (auto integer = dynamic_cast<IntegerObject *>(left.get()))
+    return integer->value == static_cast<IntegerObject *>(right.get())->value;
+  if (auto string = dynamic_cast<StringObject *>(left.get()))
+    return string->equals(*static_cast<StringObject *>(right.get()));
+  return static_cast<BooleanObject *>(left.get())->value ==
+         static_cast<BooleanObject *>(right.get())->value;
+}
+
+bool HashObject::isHashable(const ObjectPtr &key) {
+  auto type = key->type();
+  return type == INTEGER_OBJ || type == STRING_OBJ || type == BOOLEAN_OBJ;
+}
+
+ObjectType HashObject::type() { return HASH_OBJ; }
+std::string HashObject::inspect() {
+  InspectScope scope(this);
+  if (scope.isCycle())
+    return "{...}";
+  std::string out = "{";
+  size_t i = 0;
+  for (const auto &[key, value] : pairs) {
+    out += key->inspect() + ": " + value->inspect();
+    if (++i != pairs.size())
+      out += ", ";
+  }
+  out += "}";
+  return out;
+}
+
+RecordObject::RecordObject(const Shape *shape, ObjectPtrVec values)
+    : shape(shape), values(std::move(values)) {}
+ObjectType RecordObject::type() { return RECORD_OBJ; }
+std::string RecordObject::inspect() {
+  InspectScope scope(this);
+  if (scope.isCycle())
+    return "record {...}";
+  std::string out = "record {";
+  for (size_t i = 0; i < values.size(); i++) {
+    out += shape->field(i).name + ": " + values[i]->inspect();
+    if (i != values.size() - 1)
+      out += ", ";
+  }
+  out += "}";
+  return out;
+}
+
+MemoObject::MemoObject(Ref<FunctionObject> function, size_t capacity)
+    : function(std::move(function)), _capacity(capacity) {}
+ObjectType MemoObject::type() { return MEMO_OBJ; }
+std::string MemoObject::inspect() { return "memo(" + function->inspect() + ")"; }
+
+// Appends a self-delimiting encoding of `value`, so that the keys of two
+// argument lists are equal exactly when the arguments are. `enclosing` holds
+// the containers being encoded around `value`; one holding itself cannot be
+// encoded.
+static bool appendKey(std::string &key, Object *value,
+                      std::vector<const Object *> &enclosing) {
+  if (std::find(enclosing.begin(), enclosing.end(), value) != enclosing.end())
+    return false;
+  if (auto integer = dynamic_cast<IntegerObject *>(value)) {
+    key += 'i';
+    key.append(reinterpret_cast<const char *>(&integer->value),
+               sizeof(integer->value));
+    return true;
+  }
+  if (auto string = dynamic_cast<StringObject *>(value)) {
+    auto length = string->length();
+    key += 's';
+    key.append(reinterpret_cast<const char *>(&length), sizeof(length));
+    key.append(string->value());
+    return true;
+  }
+  if (auto boolean = dynamic_cast<BooleanObject *>(value)) {
+    key += boolean->value ? 't' : 'f';
+    return true;
+  }
+  if (auto array = dynamic_cast<ArrayObject *>(value)) {
+    auto length = array->size();
+    key += 'a';
+    key.append(reinterpret_cast<const char *>(&length), sizeof(length));
+    enclosing.push_back(array);
+    // Unboxed elements are encoded like boxed integers.
+    for (auto element : array->integers()) {
+      key += 'i';
+      key.append(reinterpret_cast<const char *>(&element), sizeof(element));
+    }
+    for (const auto &element : array->elements()) {
+      if (!appendKey(key, element.get(), enclosing))
+        return false;
+    }
+    enclosing.pop_back();
+    return true;
+  }
+  // Pairs are encoded in insertion order, so the same pairs inserted in
+  // another order only miss the cache.
+  if (auto hash = dynamic_cast<HashObject *>(value)) {
+    auto size = hash->pairs.size();
+    key += 'h';
+    key.append(reinterpret_cast<const char *>(&size), sizeof(size));
+    enclosing.push_back(hash);
+    for (const auto &[pairKey, pairValue] : hash->pairs) {
+      if (!appendKey(key, pairKey.get(), enclosing) ||
+          !appendKey(key, pairValue.get(), enclosing))
+        return false;
+    }
+    enclosing.pop_back();
+    return true;
+  }
+  // Records with the same fields share their shape, which lives as long as
+  // the program.
+  if (auto record = dynamic_cast<RecordObject *>(value)) {
+    key += 'r';
+    key.append(reinterpret_cast<const char *>(&record->shape),
+               sizeof(record->shape));
+    enclosing.push_back(record);
+    for (const auto &field : record->values) {
+      if (!appendKey(key, field.get(), enclosing))
+        return false;
+    }
+    enclosing.pop_back();
+    return true;
+  }
+  if (dynamic_cast<NullObject *>(value) != nullptr) {
+    key += 'n';
+    return true;
+  }
+  return false;
+}
+
+bool MemoObject::key(const ObjectPtrVec &arguments, std::string &key) {
+  std::vector<const Object *> enclosing;
+  for (const auto &argument : arguments) {
+    if (!appendKey(key, argument.get(), enclosing))
+      return false;
+  }
+  return true;
+}
+
+ObjectPtr MemoObject::lookup(const std::string &key) {
+  auto it = _index.find(key);
+  if (it == _index.end()) {
+    _misses++;
+    return nullptr;
+  }
+  _hits++;
+  _entries.splice(_entries.begin(), _entries, it->second);
+  return it->second->result;
+}
+
+void MemoObject::store(std::string key, ObjectPtr result) {
+  // A recursive call may have stored the same key in the meantime.
+  if (auto it = _index.find(key); it != _index.end()) {
+    it->second->result = std::move(result);
+    _entries.splice(_entries.begin(), _entries, it->second);
+    return;
+  }
+  if (_entries.size() == _capacity) {
+    _index.erase(_entries.back().key);
+    _entries.pop_back();
+  }
+  _entries.push_front({std::move(key), std::move(result)});
+  _index.emplace(_entries.front().key, _entries.begin());
+}
@@ -1,11 +1,24 @@
 #ifndef MONKEY_OBJECT_H
 #define MONKEY_OBJECT_H
 
+#include <array>
+#include <initializer_list>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <functional>
+#include <list>
+#include <type_traits>
+#include <unordered_map>
+#include <variant>
+#include <vector>
 
 #include "AST.h"
+#include "Ref.h"
+#include "Allocator.h"
+#include "HashTable.h"
+#include "PersistentVector.h"
+#include "Shape.h"
 
 class Environment;
 
@@ -13,25 +26,70 @@ typedef std::string ObjectType;
 
 const ObjectType ERROR_OBJ = "ERROR", INTEGER_OBJ = "INTEGER",
                  STRING_OBJ = "STRING", BOOLEAN_OBJ = "BOOLEAN",
-                 NULL_OBJ = "NULL", RETURN_VALUE_OBJ = "RETURN_VALUE",
-                 FUNCTION_OBJ = "FUNCTION", BUILTIN_OBJ = "BUILTIN", ARRAY_OBJ = "ARRAY";
+                 NULL_OBJ = "NULL",
+                 FUNCTION_OBJ = "FUNCTION", BUILTIN_OBJ = "BUILTIN", ARRAY_OBJ = "ARRAY",
+                 MEMO_OBJ = "MEMO", HASH_OBJ = "HASH", RECORD_OBJ = "RECORD";
 
-class Object {
+class Object : public RefCounted {
 public:
   virtual ObjectType type() = 0;
   virtual std::string inspect() = 0;
 };
+typedef Ref<Object> ObjectPtr;
+typedef std::vector<ObjectPtr, RuntimeStlAllocator<ObjectPtr>> ObjectPtrVec;
 
-class ErrorObject : public Object {
+// An argument of an error message, kept as it was passed until the message
+// is formatted: integers and short strings by value, objects by reference,
+// to be shown as they inspect then.
+class ErrorArgument {
 public:
+  ErrorArgument() = default;
+  template <typename T>
+    requires std::is_integral_v<T>
+  ErrorArgument(T value) : _value(static_cast<int64_t>(value)) {}
+  ErrorArgument(std::string_view text)
+      : _value(RuntimeString(text.begin(), text.end())) {}
+  ErrorArgument(const char *text) : ErrorArgument(std::string_view(text)) {}
+  ErrorArgument(const std::string &text)
+      : ErrorArgument(std::string_view(text)) {}
+  template <typename T>
+  ErrorArgument(const Ref<T> &object) : _value(ObjectPtr(object)) {}
+
+  void appendTo(std::string &message) const;
+
+private:
+  std::variant<int64_t, RuntimeString, ObjectPtr> _value;
+};
+
+class ErrorObject : public Object, public RuntimeAllocated<ErrorObject> {
+public:
+  static constexpr size_t maxArguments = 3;
+
   explicit ErrorObject(std::string message);
+  // The message is only formatted when it is first read; `format` must
+  // outlive the object and may contain %s and %d placeholders.
+  ErrorObject(const char *format,
+              std::initializer_list<ErrorArgument> arguments);
   ObjectType type() override;
   std::string inspect() override;
 
-  std::string message;
+  const std::string &message();
+
+private:
+  const char *_format = nullptr;
+  std::array<ErrorArgument, maxArguments> _arguments;
+  size_t _argumentCount = 0;
+  std::string _message;
 };
 
-class IntegerObject : public Object {
+template <typename... Args>
+Ref<ErrorObject> newError(const char *format, Args &&...args) {
+  static_assert(sizeof...(Args) <= ErrorObject::maxArguments);
+  return makeRef<ErrorObject>(
+      format, std::initializer_list<ErrorArgument>{ErrorArgument(args)...});
+}
+
+class IntegerObject : public Object, public RuntimeAllocated<IntegerObject> {
 public:
   explicit IntegerObject(int64_t value = 0);
   ObjectType type() override;
@@ -40,16 +98,122 @@ public:
   int64_t value;
 };
 
-class StringObject : public Object {
+// Concatenation makes a rope: a string that only refers to its two halves,
+// so building a string by repeated appends copies nothing until the
+// characters are needed. The first call to value() joins them into one
+// buffer and, in a single-threaded runtime, lets go of the halves. Other
+// threads may be walking the halves of a shared string, so it keeps them.
+//
+// A substring can be a view instead: it points into the buffer of the
+// string it was taken from and keeps that string alive.
+//
+// The characters are UTF-8, which string literals are checked to be and every
+// operation on strings keeps. Lengths and positions count code points; a
+// string that is not all ASCII finds them through an index of the byte
+// offset of every 64th code point, built on first use.
+class StringObject : public Object, public RuntimeAllocated<StringObject> {
 public:
-  explicit StringObject(std::string value = "");
+  StringObject() = default;
+  explicit StringObject(std::string_view value);
+  explicit StringObject(RuntimeString &&value);
+  ~StringObject() override;
   ObjectType type() override;
   std::string inspect() override;
 
-  std::string value;
+  // Short results are copied right away; longer ones are ropes.
+  static Ref<StringObject> concat(const Ref<StringObject> &left,
+                                  const Ref<StringObject> &right);
+  // The characters [start, start + length) of `string`, as a view if `share`
+  // is set. Pieces short enough to fit in the object itself are copied
+  // either way.
+  static Ref<StringObject> substring(const Ref<StringObject> &string,
+                                     size_t start, size_t length, bool share);
+  // Whether views using `used` bytes of a buffer `size` bytes long are worth
+  // keeping it alive for: they may leave no more bytes unused than they use,
+  // or only a few.
+  static bool worthSharing(size_t used, size_t size);
+
+  // In bytes.
+  size_t length() const { return _length; }
+  size_t codePoints() const { return _codePoints; }
+  // Where code point `codePoint` starts; the length for the end of the
+  // string.
+  size_t byteOffset(size_t codePoint) const;
+  std::string_view value() const;
+  bool isView() const { return _parent != nullptr; }
+  // Computed on first use; strings are never changed once created.
+  size_t hash() const;
+
+  // Whether both strings hold the same characters. Two strings interned by
+  // the same table are equal only if they are the same object; other strings
+  // compare their lengths and hashes before their characters.
+  bool equals(const StringObject &other) const;
+  bool isInterned() const { return _table != 0; }
+
+private:
+  friend class StringTable;
+
+  static constexpr size_t _maxCopied = 64;
+  static constexpr size_t _minShared = 16;
+  static constexpr size_t _maxWasted = 256;
+  static constexpr size_t _indexStride = 64;
+
+  bool _isFlat() const;
+  void _flatten() const;
+  bool _isIndexed() const;
+  void _buildIndex(std::string_view value) const;
+  // The characters of a string that is not a rope, or a flattened one.
+  std::string_view _flatValue() const {
+    return _parent != nullptr ? std::string_view(_data, _length)
+                              : std::string_view(_value);
+  }
+  // Calls `visit` on the characters of each flat piece, in order.
+  template <typename F> void _forEachPiece(F visit) const;
+
+  mutable RuntimeString _value;
+  // The string owning the buffer a view points into, and where the view's
+  // characters start.
+  Ref<StringObject> _parent;
+  const char *_data = nullptr;
+  // The halves of a rope that has not been flattened yet.
+  mutable Ref<StringObject> _left;
+  mutable Ref<StringObject> _right;
+  size_t _length = 0;
+  size_t _codePoints = 0;
+  mutable bool _flat = true;
+  mutable bool _indexed = false;
+  // The byte offsets of code points 0, 64, 128 and so on.
+  mutable std::vector<size_t> _offsets;
+  mutable size_t _hash = 0;
+  // The id of the table that interned the string, or 0.
+  uint64_t _table = 0;
 };
 
-class BooleanObject : public Object {
+// The strings interned by one isolate, at most one object for each content.
+// Not thread-safe: every evaluator has a table of its own.
+class StringTable {
+public:
+  // New strings are no longer interned once the table holds this many.
+  static constexpr size_t capacity = 1 << 16;
+
+  StringTable();
+  StringTable(const StringTable &) = delete;
+  StringTable &operator=(const StringTable &) = delete;
+
+  // The interned string equal to `value`, or a new uninterned one if there
+  // is none and the table is full.
+  Ref<StringObject> intern(std::string_view value);
+  size_t size() const { return _strings.size(); }
+
+private:
+  // Ids are never reused, so strings outliving their table cannot be taken
+  // for members of a later one.
+  uint64_t _id;
+  // Keyed by the characters of the interned strings.
+  HashTable<std::string_view, Ref<StringObject>> _strings;
+};
+
+class BooleanObject : public Object, public RuntimeAllocated<BooleanObject> {
 public:
   explicit BooleanObject(bool value = false);
   ObjectType type() override;
@@ -64,31 +228,34 @@ public:
   std::string inspect() override;
 };
 
-class ReturnValueObject : public Object {
-public:
-  explicit ReturnValueObject(std::shared_ptr<Object> value);
-  ObjectType type() override;
-  std::string inspect() override;
-
-  std::shared_ptr<Object> value;
+// The immutable part of a function, shared by every closure created from the
+// same literal.
+struct FunctionPrototype {
+  IdentifierPtrVec parameters;
+  BlockStatementPtr body;
+  size_t arity = 0;
+  // Bindings a call frame is expected to hold.
+  size_t frameSize = 0;
+  // Set when no call can let its environment outlive the call, which allows
+  // the evaluator to run the call in a reused frame.
+  bool reusesFrames = false;
 };
+typedef std::shared_ptr<FunctionPrototype> FunctionPrototypePtr;
 
-class FunctionObject : public Object {
+class FunctionObject : public Object, public RuntimeAllocated<FunctionObject> {
 public:
-  explicit FunctionObject(IdentifierPtrVec parameters,
-                          BlockStatementPtr body,
+  explicit FunctionObject(FunctionPrototypePtr prototype,
                           std::shared_ptr<Environment> environment);
   ObjectType type() override;
   std::string inspect() override;
 
-  IdentifierPtrVec parameters;
-  BlockStatementPtr body;
+  FunctionPrototypePtr prototype;
   std::shared_ptr<Environment> environment;
 };
 
 
-using BuiltinFunction = std::function<std::shared_ptr<Object>(
-  const std::vector<std::shared_ptr<Object>>& args
+using BuiltinFunction = std::function<ObjectPtr(
+  const ObjectPtrVec& args
 )>;
 
 
@@ -101,17 +268,128 @@ public:
   BuiltinFunction value;
 };
 
-class ArrayObject : public Object {
+// Arrays are mutable cells holding a persistent vector: `rest`, `slice` and
+// `concat` share the elements of their arguments, and storing into an array
+// copies only the path to the element if another array shares it.
+//
+// An array whose elements are all integers keeps them unboxed, as int64_t
+// values, and only boxes an element when it is read as an object. Storing
+// anything else into it boxes the whole array for good.
+class ArrayObject : public Object, public RuntimeAllocated<ArrayObject> {
 public:
-  explicit ArrayObject(std::vector<std::shared_ptr<Object>> elements);
+  typedef PersistentVector<ObjectPtr> Elements;
+  typedef PersistentVector<int64_t> Integers;
+
+  explicit ArrayObject(const ObjectPtrVec &elements);
+  explicit ArrayObject(Elements elements);
+  explicit ArrayObject(Integers integers);
+  ObjectType type() override;
+  std::string inspect() override;
+
+  size_t size() const {
+    return _unboxed ? _integers.size() : _elements.size();
+  }
+  ObjectPtr at(size_t index) const;
+  void push(ObjectPtr element);
+  void set(size_t index, ObjectPtr element);
+  // The elements [start, end) in a new array sharing this one's.
+  Ref<ArrayObject> slice(size_t start, size_t end) const;
+  Ref<ArrayObject> concat(const ArrayObject &other) const;
+
+  bool isUnboxed() const { return _unboxed; }
+  // Only the representation in use holds the elements.
+  const Elements &elements() const { return _elements; }
+  const Integers &integers() const { return _integers; }
+  // Sets `integers` to the elements if all of them are integers, unboxing
+  // them if need be.
+  bool toIntegers(Integers &integers) const;
+
+private:
+  Elements _boxed() const;
+  void _box();
+
+  bool _unboxed;
+  Elements _elements;
+  Integers _integers;
+};
+
+// Integers, strings and booleans can be keys of a hash; they compare by value.
+// Keys and values are listed in insertion order.
+class HashObject : public Object, public RuntimeAllocated<HashObject> {
+public:
+  struct KeyHash {
+    size_t operator()(const ObjectPtr &key) const;
+  };
+  struct KeyEqual {
+    bool operator()(const ObjectPtr &left, const ObjectPtr &right) const;
+  };
+  typedef HashTable<ObjectPtr, ObjectPtr, KeyHash, KeyEqual> Pairs;
+
+  static bool isHashable(const ObjectPtr &key);
+  ObjectType type() override;
+  std::string inspect() override;
+
+  Pairs pairs;
+};
+
+// A record keeps the value of each field in the slot its shape assigns to the
+// name, and nothing else: the names live in the shape, which records with the
+// same fields share. Values can be replaced but fields never added.
+class RecordObject : public Object, public RuntimeAllocated<RecordObject> {
+public:
+  RecordObject(const Shape *shape, ObjectPtrVec values);
+  ObjectType type() override;
+  std::string inspect() override;
+
+  const Shape *shape;
+  ObjectPtrVec values;
+};
+
+// A function wrapped by the `memo` builtin. Results are cached under the
+// values of the arguments, so the function must be pure; the least recently
+// used entry is evicted once `capacity` results are held. A cached array is
+// the same object on every hit, so storing into it changes later results.
+class MemoObject : public Object, public RuntimeAllocated<MemoObject> {
+public:
+  static constexpr size_t defaultCapacity = 1024;
+
+  explicit MemoObject(Ref<FunctionObject> function,
+                      size_t capacity = defaultCapacity);
   ObjectType type() override;
   std::string inspect() override;
 
-  std::vector<std::shared_ptr<Object>> elements;
+  // Encodes the arguments into `key`. Returns false when one of them cannot
+  // be compared by content (functions, or containers holding themselves), in
+  // which case the call is not cached.
+  static bool key(const ObjectPtrVec &arguments, std::string &key);
+  // Returns the cached result for `key`, or nullptr, and counts the hit or
+  // miss.
+  ObjectPtr lookup(const std::string &key);
+  void store(std::string key, ObjectPtr result);
+
+  size_t hits() const { return _hits; }
+  size_t misses() const { return _misses; }
+  size_t size() const { return _entries.size(); }
+  size_t capacity() const { return _capacity; }
+
+  Ref<FunctionObject> function;
+
+private:
+  struct Entry {
+    std::string key;
+    ObjectPtr result;
+  };
+
+  size_t _capacity;
+  size_t _hits = 0;
+  size_t _misses = 0;
+  // Most recently used first. The index refers to the keys in the entries.
+  std::list<Entry> _entries;
+  std::unordered_map<std::string_view, std::list<Entry>::iterator> _index;
 };
 
-const auto NULL_ = std::make_shared<NullObject>();
-const auto TRUE_ = std::make_shared<BooleanObject>(true);
-const auto FALSE_ = std::make_shared<BooleanObject>(false);
+inline const ObjectPtr NULL_ = makeRef<NullObject>();
+inline const ObjectPtr TRUE_ = makeRef<BooleanObject>(true);
+inline const ObjectPtr FALSE_ = makeRef<BooleanObject>(false);
 
 #endif // MONKEY_OBJECT_H
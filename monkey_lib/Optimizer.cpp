@@ -0,0 +1,874 @@
+#include "Optimizer.h"
+
+#include <functional>
+#include <limits>
+#include <memory>
+#include <utility>
+
+#include "AST.h"
+#include "StringKernels.h"
+#include "Token.h"
+#include "TypeInference.h"
+
+static ExpressionPtr makeIntegerLiteral(int64_t value) {
+  auto literal = makeNode<IntegerLiteralExpression>();
+  literal->token = {.type = INT, .literal = std::to_string(value)};
+  literal->value = value;
+  return literal;
+}
+
+static ExpressionPtr makeBooleanLiteral(bool value) {
+  auto literal = makeNode<BooleanLiteralExpression>();
+  literal->token = value ? Token{.type = TRUE, .literal = "true"}
+                         : Token{.type = FALSE, .literal = "false"};
+  literal->value = value;
+  return literal;
+}
+
+static ExpressionPtr makeStringLiteral(const std::string &value) {
+  auto literal = makeNode<StringLiteralExpression>();
+  literal->token = {.type = STRING, .literal = value};
+  literal->value = value;
+  return literal;
+}
+
+static bool isLiteral(const ExpressionPtr &expression) {
+  if (expression == nullptr)
+    return false;
+  auto type = expression->nodeType();
+  return type == INTEGER_LITERAL || type == STRING_LITERAL ||
+         type == BOOLEAN_LITERAL;
+}
+
+// Literal conditions are the only ones whose truthiness is known statically.
+// Mirrors Evaluator::_isTruthy: only false (and null) are falsy.
+static bool isConstantCondition(const ExpressionPtr &expression,
+                                bool &truthy) {
+  if (!isLiteral(expression))
+    return false;
+  truthy = true;
+  if (expression->nodeType() == BOOLEAN_LITERAL) {
+    truthy = std::static_pointer_cast<BooleanLiteralExpression>(expression)
+                 ->value;
+  }
+  return true;
+}
+
+// Expressions without calls or binders; evaluating them twice, or in a
+// different scope with the same bindings, gives the same result.
+static bool isPure(const ExpressionPtr &expression) {
+  if (expression == nullptr)
+    return false;
+  switch (expression->nodeType()) {
+  case INTEGER_LITERAL:
+  case STRING_LITERAL:
+  case BOOLEAN_LITERAL:
+  case IDENTIFIER:
+    return true;
+  case PREFIX_EXPRESSION:
+    return isPure(std::static_pointer_cast<PrefixExpression>(expression)->right);
+  case INFIX_EXPRESSION: {
+    auto infix = std::static_pointer_cast<InfixExpression>(expression);
+    return isPure(infix->left) && isPure(infix->right);
+  }
+  case INDEX_EXPRESSION: {
+    auto index = std::static_pointer_cast<IndexExpression>(expression);
+    return isPure(index->left) && isPure(index->index);
+  }
+  case FIELD_EXPRESSION:
+    return isPure(std::static_pointer_cast<FieldExpression>(expression)->left);
+  case ARRAY_LITERAL:
+    for (const auto &element :
+         std::static_pointer_cast<ArrayLiteralExpression>(expression)
+             ->elements) {
+      if (!isPure(element))
+        return false;
+    }
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Lists, in the order a pure expression evaluates them, the parameters it
+// reads (by index) and the operations it applies that can fail (as -1).
+static void evaluationOrder(const NodePtr &node,
+                            const std::unordered_map<std::string, int>
+                                &parameters,
+                            std::vector<int> &order) {
+  forEachChild(node, [&](const NodePtr &child) {
+    evaluationOrder(child, parameters, order);
+  });
+  switch (node->nodeType()) {
+  case IDENTIFIER: {
+    auto parameter =
+        parameters.find(std::static_pointer_cast<Identifier>(node)->value);
+    if (parameter != parameters.end())
+      order.push_back(parameter->second);
+    break;
+  }
+  case PREFIX_EXPRESSION:
+  case INFIX_EXPRESSION:
+  case INDEX_EXPRESSION:
+  case FIELD_EXPRESSION:
+    order.push_back(-1);
+    break;
+  default:
+    break;
+  }
+}
+
+// Deep-copies a pure expression, replacing identifiers found in
+// `substitutions` by copies of their replacement.
+static ExpressionPtr
+cloneExpression(const ExpressionPtr &expression,
+                const std::unordered_map<std::string, ExpressionPtr>
+                    &substitutions) {
+  switch (expression->nodeType()) {
+  case INTEGER_LITERAL:
+    return makeNode<IntegerLiteralExpression>(
+        *std::static_pointer_cast<IntegerLiteralExpression>(expression));
+  case STRING_LITERAL:
+    return makeNode<StringLiteralExpression>(
+        *std::static_pointer_cast<StringLiteralExpression>(expression));
+  case BOOLEAN_LITERAL:
+    return makeNode<BooleanLiteralExpression>(
+        *std::static_pointer_cast<BooleanLiteralExpression>(expression));
+  case IDENTIFIER: {
+    auto identifier = std::static_pointer_cast<Identifier>(expression);
+    auto substitution = substitutions.find(identifier->value);
+    if (substitution != substitutions.end())
+      return cloneExpression(substitution->second, {});
+    auto clone = makeNode<Identifier>();
+    clone->token = identifier->token;
+    clone->value = identifier->value;
+    return clone;
+  }
+  case PREFIX_EXPRESSION: {
+    auto prefix = std::static_pointer_cast<PrefixExpression>(expression);
+    auto clone = makeNode<PrefixExpression>(*prefix);
+    clone->right = cloneExpression(prefix->right, substitutions);
+    return clone;
+  }
+  case INFIX_EXPRESSION: {
+    auto infix = std::static_pointer_cast<InfixExpression>(expression);
+    auto clone = makeNode<InfixExpression>();
+    clone->token = infix->token;
+    clone->operator_ = infix->operator_;
+    clone->left = cloneExpression(infix->left, substitutions);
+    clone->right = cloneExpression(infix->right, substitutions);
+    return clone;
+  }
+  case INDEX_EXPRESSION: {
+    auto index = std::static_pointer_cast<IndexExpression>(expression);
+    auto clone = makeNode<IndexExpression>(*index);
+    clone->left = cloneExpression(index->left, substitutions);
+    clone->index = cloneExpression(index->index, substitutions);
+    return clone;
+  }
+  case FIELD_EXPRESSION: {
+    auto field = std::static_pointer_cast<FieldExpression>(expression);
+    auto clone = makeNode<FieldExpression>(*field);
+    clone->left = cloneExpression(field->left, substitutions);
+    return clone;
+  }
+  case ARRAY_LITERAL: {
+    auto array = std::static_pointer_cast<ArrayLiteralExpression>(expression);
+    auto clone = makeNode<ArrayLiteralExpression>();
+    clone->token = array->token;
+    for (const auto &element : array->elements)
+      clone->elements.push_back(cloneExpression(element, substitutions));
+    return clone;
+  }
+  default:
+    return nullptr;
+  }
+}
+
+// Visits `node` and every node below it, including nested functions.
+static void forEachNode(const NodePtr &node,
+                        const std::function<void(Node *)> &visit) {
+  if (node == nullptr)
+    return;
+  visit(node.get());
+  forEachChild(node, [&](const NodePtr &child) { forEachNode(child, visit); });
+}
+
+// The name bound by a let or a for loop, or null for any other node.
+static const std::string *boundName(Node *node) {
+  if (node->nodeType() == LET_STATEMENT)
+    return &static_cast<LetStatement *>(node)->name->value;
+  if (node->nodeType() == FOR_EXPRESSION)
+    return &static_cast<ForExpression *>(node)->variable->value;
+  return nullptr;
+}
+
+// The variable an assignment changes: the one it rebinds, or the one
+// holding the array or record it stores into. Null when there is none.
+static const std::string *assignedName(Node *node) {
+  if (node->nodeType() != ASSIGN_EXPRESSION)
+    return nullptr;
+  auto target = static_cast<AssignExpression *>(node)->target;
+  if (target->nodeType() == INDEX_EXPRESSION)
+    target = static_cast<IndexExpression *>(target.get())->left;
+  else if (target->nodeType() == FIELD_EXPRESSION)
+    target = static_cast<FieldExpression *>(target.get())->left;
+  if (target == nullptr || target->nodeType() != IDENTIFIER)
+    return nullptr;
+  return &static_cast<Identifier *>(target.get())->value;
+}
+
+int OptimizationPass::run(const ProgramPtr &program) {
+  _rewritten = 0;
+  _walkStatements(program->statements);
+  return _rewritten;
+}
+
+void OptimizationPass::_walkStatements(StatementPtrVec &statements) {
+  for (const auto &statement : statements)
+    _walkStatement(statement);
+  _visitStatements(statements);
+}
+
+void OptimizationPass::_walkStatement(const StatementPtr &statement) {
+  if (statement == nullptr)
+    return;
+  switch (statement->nodeType()) {
+  case LET_STATEMENT:
+    _walkExpression(std::static_pointer_cast<LetStatement>(statement)->value);
+    break;
+  case RETURN_STATEMENT:
+    _walkExpression(
+        std::static_pointer_cast<ReturnStatement>(statement)->returnValue);
+    break;
+  case EXPRESSION_STATEMENT:
+    _walkExpression(
+        std::static_pointer_cast<ExpressionStatement>(statement)->expression);
+    break;
+  case BLOCK_STATEMENT:
+    _walkStatements(
+        std::static_pointer_cast<BlockStatement>(statement)->statements);
+    break;
+  default:
+    break;
+  }
+}
+
+void OptimizationPass::_walkExpression(ExpressionPtr &expression) {
+  if (expression == nullptr)
+    return;
+  switch (expression->nodeType()) {
+  case PREFIX_EXPRESSION:
+    _walkExpression(std::static_pointer_cast<PrefixExpression>(expression)->right);
+    break;
+  case INFIX_EXPRESSION: {
+    auto infix = std::static_pointer_cast<InfixExpression>(expression);
+    _walkExpression(infix->left);
+    _walkExpression(infix->right);
+    break;
+  }
+  case IF_EXPRESSION: {
+    auto ifExpression = std::static_pointer_cast<IfExpression>(expression);
+    _walkExpression(ifExpression->condition);
+    if (ifExpression->consequence != nullptr)
+      _walkStatements(ifExpression->consequence->statements);
+    if (ifExpression->alternative != nullptr)
+      _walkStatements(ifExpression->alternative->statements);
+    break;
+  }
+  case ASSIGN_EXPRESSION: {
+    // The target is a place rather than a value; only its operands are
+    // walked.
+    auto assign = std::static_pointer_cast<AssignExpression>(expression);
+    if (assign->target->nodeType() == INDEX_EXPRESSION) {
+      auto index = std::static_pointer_cast<IndexExpression>(assign->target);
+      _walkExpression(index->left);
+      _walkExpression(index->index);
+    } else if (assign->target->nodeType() == FIELD_EXPRESSION) {
+      _walkExpression(
+          std::static_pointer_cast<FieldExpression>(assign->target)->left);
+    }
+    _walkExpression(assign->value);
+    break;
+  }
+  case WHILE_EXPRESSION: {
+    auto loop = std::static_pointer_cast<WhileExpression>(expression);
+    _walkExpression(loop->condition);
+    if (loop->body != nullptr)
+      _walkStatements(loop->body->statements);
+    break;
+  }
+  case FOR_EXPRESSION: {
+    auto loop = std::static_pointer_cast<ForExpression>(expression);
+    _walkExpression(loop->iterable);
+    if (loop->body != nullptr)
+      _walkStatements(loop->body->statements);
+    break;
+  }
+  case FUNCTION_LITERAL: {
+    auto function =
+        std::static_pointer_cast<FunctionLiteralExpression>(expression);
+    _enterFunction(function.get());
+    if (function->body != nullptr)
+      _walkStatements(function->body->statements);
+    _leaveFunction(function.get());
+    break;
+  }
+  case CALL_EXPRESSION: {
+    auto call = std::static_pointer_cast<CallExpression>(expression);
+    _walkExpression(call->function);
+    for (auto &argument : call->arguments)
+      _walkExpression(argument);
+    break;
+  }
+  case ARRAY_LITERAL:
+    for (auto &element :
+         std::static_pointer_cast<ArrayLiteralExpression>(expression)->elements)
+      _walkExpression(element);
+    break;
+  case INDEX_EXPRESSION: {
+    auto index = std::static_pointer_cast<IndexExpression>(expression);
+    _walkExpression(index->left);
+    _walkExpression(index->index);
+    break;
+  }
+  case HASH_LITERAL:
+    for (auto &[key, value] :
+         std::static_pointer_cast<HashLiteralExpression>(expression)->pairs) {
+      _walkExpression(key);
+      _walkExpression(value);
+    }
+    break;
+  case RECORD_LITERAL:
+    for (auto &value :
+         std::static_pointer_cast<RecordLiteralExpression>(expression)->values)
+      _walkExpression(value);
+    break;
+  case FIELD_EXPRESSION:
+    _walkExpression(
+        std::static_pointer_cast<FieldExpression>(expression)->left);
+    break;
+  default:
+    break;
+  }
+  _visitExpression(expression);
+}
+
+std::string ConstantFoldingPass::name() { return "constant-folding"; }
+
+void ConstantFoldingPass::_visitExpression(ExpressionPtr &expression) {
+  if (expression->nodeType() == PREFIX_EXPRESSION) {
+    auto prefix = std::static_pointer_cast<PrefixExpression>(expression);
+    if (!isLiteral(prefix->right))
+      return;
+    bool truthy;
+    if (prefix->operator_ == "!" &&
+        isConstantCondition(prefix->right, truthy)) {
+      expression = makeBooleanLiteral(!truthy);
+      _rewritten++;
+    } else if (prefix->operator_ == "-" &&
+               prefix->right->nodeType() == INTEGER_LITERAL) {
+      auto value =
+          std::static_pointer_cast<IntegerLiteralExpression>(prefix->right)
+              ->value;
+      expression = makeIntegerLiteral(
+          static_cast<int64_t>(0 - static_cast<uint64_t>(value)));
+      _rewritten++;
+    }
+    return;
+  }
+
+  if (expression->nodeType() != INFIX_EXPRESSION)
+    return;
+  auto infix = std::static_pointer_cast<InfixExpression>(expression);
+  if (!isLiteral(infix->left) || !isLiteral(infix->right) ||
+      infix->left->nodeType() != infix->right->nodeType())
+    return;
+
+  auto op = lookupInfixOperator(infix->operator_);
+  ExpressionPtr folded;
+  switch (infix->left->nodeType()) {
+  case INTEGER_LITERAL: {
+    auto left =
+        std::static_pointer_cast<IntegerLiteralExpression>(infix->left)->value;
+    auto right =
+        std::static_pointer_cast<IntegerLiteralExpression>(infix->right)->value;
+    auto uleft = static_cast<uint64_t>(left);
+    auto uright = static_cast<uint64_t>(right);
+    switch (op) {
+    case OP_PLUS:
+      folded = makeIntegerLiteral(static_cast<int64_t>(uleft + uright));
+      break;
+    case OP_MINUS:
+      folded = makeIntegerLiteral(static_cast<int64_t>(uleft - uright));
+      break;
+    case OP_ASTERISK:
+      folded = makeIntegerLiteral(static_cast<int64_t>(uleft * uright));
+      break;
+    case OP_SLASH:
+      // Leave faulting divisions to the evaluator.
+      if (right != 0 &&
+          !(left == std::numeric_limits<int64_t>::min() && right == -1))
+        folded = makeIntegerLiteral(left / right);
+      break;
+    case OP_LT:
+      folded = makeBooleanLiteral(left < right);
+      break;
+    case OP_GT:
+      folded = makeBooleanLiteral(left > right);
+      break;
+    case OP_EQ:
+      folded = makeBooleanLiteral(left == right);
+      break;
+    case OP_NOT_EQ:
+      folded = makeBooleanLiteral(left != right);
+      break;
+    default:
+      break;
+    }
+    break;
+  }
+  case BOOLEAN_LITERAL: {
+    auto left =
+        std::static_pointer_cast<BooleanLiteralExpression>(infix->left)->value;
+    auto right =
+        std::static_pointer_cast<BooleanLiteralExpression>(infix->right)->value;
+    if (op == OP_EQ)
+      folded = makeBooleanLiteral(left == right);
+    else if (op == OP_NOT_EQ)
+      folded = makeBooleanLiteral(left != right);
+    break;
+  }
+  case STRING_LITERAL: {
+    auto &left =
+        std::static_pointer_cast<StringLiteralExpression>(infix->left)->value;
+    auto &right =
+        std::static_pointer_cast<StringLiteralExpression>(infix->right)->value;
+    if (op == OP_PLUS)
+      folded = makeStringLiteral(left + right);
+    else if (op == OP_EQ)
+      folded = makeBooleanLiteral(left == right);
+    else if (op == OP_NOT_EQ)
+      folded = makeBooleanLiteral(left != right);
+    break;
+  }
+  default:
+    break;
+  }
+
+  if (folded != nullptr) {
+    expression = folded;
+    _rewritten++;
+  }
+}
+
+std::string DeadBranchEliminationPass::name() {
+  return "dead-branch-elimination";
+}
+
+void DeadBranchEliminationPass::_visitExpression(ExpressionPtr &expression) {
+  if (expression->nodeType() != IF_EXPRESSION)
+    return;
+  auto ifExpression = std::static_pointer_cast<IfExpression>(expression);
+  bool truthy;
+  if (!isConstantCondition(ifExpression->condition, truthy))
+    return;
+
+  if (truthy) {
+    if (ifExpression->alternative != nullptr) {
+      ifExpression->alternative = nullptr;
+      _rewritten++;
+    }
+  } else if (ifExpression->alternative != nullptr) {
+    ifExpression->condition = makeBooleanLiteral(true);
+    ifExpression->consequence = ifExpression->alternative;
+    ifExpression->alternative = nullptr;
+    _rewritten++;
+  } else {
+    if (!ifExpression->consequence->statements.empty()) {
+      ifExpression->consequence->statements.clear();
+      _rewritten++;
+    }
+    return;
+  }
+
+  // `if (true) { expr }` is just `expr`.
+  auto &statements = ifExpression->consequence->statements;
+  if (statements.size() == 1 &&
+      statements[0]->nodeType() == EXPRESSION_STATEMENT) {
+    auto inner =
+        std::static_pointer_cast<ExpressionStatement>(statements[0])->expression;
+    if (inner != nullptr) {
+      expression = inner;
+      _rewritten++;
+    }
+  }
+}
+
+void DeadBranchEliminationPass::_visitStatements(StatementPtrVec &statements) {
+  // Blocks do not open a scope, so the taken block of a constant `if` in
+  // statement position can replace it outright. The last statement of a list
+  // provides its value, so it is only replaced by a non-empty block.
+  StatementPtrVec result;
+  bool changed = false;
+  for (size_t i = 0; i < statements.size(); i++) {
+    auto &statement = statements[i];
+    auto isLast = i == statements.size() - 1;
+    if (statement == nullptr ||
+        statement->nodeType() != EXPRESSION_STATEMENT) {
+      result.push_back(statement);
+      continue;
+    }
+    auto expression =
+        std::static_pointer_cast<ExpressionStatement>(statement)->expression;
+    bool truthy;
+    if (expression == nullptr || expression->nodeType() != IF_EXPRESSION ||
+        !isConstantCondition(
+            std::static_pointer_cast<IfExpression>(expression)->condition,
+            truthy)) {
+      result.push_back(statement);
+      continue;
+    }
+
+    auto ifExpression = std::static_pointer_cast<IfExpression>(expression);
+    auto taken = truthy ? ifExpression->consequence : ifExpression->alternative;
+    if (taken == nullptr || taken->statements.empty()) {
+      if (isLast) {
+        result.push_back(statement);
+      } else {
+        changed = true;
+        _rewritten++;
+      }
+      continue;
+    }
+    result.insert(result.end(), taken->statements.begin(),
+                  taken->statements.end());
+    changed = true;
+    _rewritten++;
+  }
+  if (changed)
+    statements = result;
+}
+
+std::string InliningPass::name() { return "inlining"; }
+
+int InliningPass::run(const ProgramPtr &program) {
+  _rewritten = 0;
+  _collectCandidates(program);
+  _scopes.clear();
+  for (_statementIndex = 0; _statementIndex < program->statements.size();
+       _statementIndex++) {
+    _walkStatement(program->statements[_statementIndex]);
+  }
+  return _rewritten;
+}
+
+void InliningPass::_collectCandidates(const ProgramPtr &program) {
+  _functions.clear();
+  _arrays.clear();
+  _definedAt.clear();
+  _boundNames.clear();
+
+  // Lets and loop variables inside functions bind locals; every other one
+  // binds a global, including those in top-level blocks and loops, which do
+  // not open a scope.
+  std::unordered_set<Node *> localBinders;
+  forEachNode(program, [&](Node *child) {
+    if (auto name = boundName(child))
+      _boundNames.insert(*name);
+    if (child->nodeType() != FUNCTION_LITERAL)
+      return;
+    auto function = static_cast<FunctionLiteralExpression *>(child);
+    for (const auto &parameter : function->parameters)
+      _boundNames.insert(parameter->value);
+    forEachNode(function->body, [&](Node *inner) {
+      if (boundName(inner) != nullptr)
+        localBinders.insert(inner);
+    });
+  });
+  std::unordered_map<std::string, int> globalBindings;
+  forEachNode(program, [&](Node *child) {
+    auto name = boundName(child);
+    if (name != nullptr && !localBinders.contains(child))
+      globalBindings[*name]++;
+  });
+
+  // Uses of each identifier, and how many of them only read an array.
+  // Assigned variables are never candidates.
+  std::unordered_map<std::string, int> uses, reads;
+  std::unordered_set<std::string> assigned;
+  forEachNode(program, [&](Node *child) {
+    if (auto name = assignedName(child))
+      assigned.insert(*name);
+    if (child->nodeType() == IDENTIFIER) {
+      uses[static_cast<Identifier *>(child)->value]++;
+    } else if (child->nodeType() == INDEX_EXPRESSION) {
+      auto left = static_cast<IndexExpression *>(child)->left;
+      if (left != nullptr && left->nodeType() == IDENTIFIER)
+        reads[std::static_pointer_cast<Identifier>(left)->value]++;
+    } else if (child->nodeType() == FOR_EXPRESSION) {
+      auto iterable = static_cast<ForExpression *>(child)->iterable;
+      if (iterable != nullptr && iterable->nodeType() == IDENTIFIER)
+        reads[std::static_pointer_cast<Identifier>(iterable)->value]++;
+    } else if (child->nodeType() == CALL_EXPRESSION) {
+      auto call = static_cast<CallExpression *>(child);
+      if (call->function == nullptr ||
+          call->function->nodeType() != IDENTIFIER ||
+          call->arguments.size() != 1 || call->arguments[0] == nullptr ||
+          call->arguments[0]->nodeType() != IDENTIFIER)
+        return;
+      auto callee = std::static_pointer_cast<Identifier>(call->function)->value;
+      if (callee == "len" || callee == "first" || callee == "last")
+        reads[std::static_pointer_cast<Identifier>(call->arguments[0])
+                  ->value]++;
+    }
+  });
+
+  for (size_t i = 0; i < program->statements.size(); i++) {
+    auto &statement = program->statements[i];
+    if (statement == nullptr || statement->nodeType() != LET_STATEMENT)
+      continue;
+    auto let = std::static_pointer_cast<LetStatement>(statement);
+    auto &name = let->name->value;
+    if (globalBindings[name] != 1 || assigned.contains(name) ||
+        let->value == nullptr)
+      continue;
+
+    if (let->value->nodeType() == ARRAY_LITERAL) {
+      auto array = std::static_pointer_cast<ArrayLiteralExpression>(let->value);
+      bool literals = true;
+      for (const auto &element : array->elements)
+        literals = literals && isLiteral(element);
+      if (literals && uses[name] == reads[name]) {
+        _arrays[name] = array.get();
+        _definedAt[name] = i;
+      }
+      continue;
+    }
+
+    if (let->value->nodeType() != FUNCTION_LITERAL)
+      continue;
+    auto function =
+        std::static_pointer_cast<FunctionLiteralExpression>(let->value);
+    if (function->body == nullptr || function->body->statements.size() != 1)
+      continue;
+    auto &only = function->body->statements[0];
+    ExpressionPtr body;
+    if (only->nodeType() == EXPRESSION_STATEMENT)
+      body = std::static_pointer_cast<ExpressionStatement>(only)->expression;
+    else if (only->nodeType() == RETURN_STATEMENT)
+      body = std::static_pointer_cast<ReturnStatement>(only)->returnValue;
+    if (!isPure(body))
+      continue;
+
+    // The body may only refer to its own parameters, which also rules out
+    // recursion.
+    std::unordered_set<std::string> parameters;
+    for (const auto &parameter : function->parameters)
+      parameters.insert(parameter->value);
+    bool closed = parameters.size() == function->parameters.size();
+    forEachNode(body, [&](Node *child) {
+      if (child->nodeType() == IDENTIFIER &&
+          !parameters.contains(static_cast<Identifier *>(child)->value))
+        closed = false;
+    });
+    if (closed) {
+      _functions[name] = function.get();
+      _definedAt[name] = i;
+    }
+  }
+}
+
+void InliningPass::_enterFunction(FunctionLiteralExpression *function) {
+  std::unordered_set<std::string> scope;
+  for (const auto &parameter : function->parameters)
+    scope.insert(parameter->value);
+  forEachNode(function->body, [&](Node *child) {
+    if (auto name = boundName(child))
+      scope.insert(*name);
+  });
+  _scopes.push_back(scope);
+}
+
+void InliningPass::_leaveFunction(FunctionLiteralExpression * /*function*/) {
+  _scopes.pop_back();
+}
+
+bool InliningPass::_isShadowed(const std::string &name) {
+  for (const auto &scope : _scopes) {
+    if (scope.contains(name))
+      return true;
+  }
+  return false;
+}
+
+void InliningPass::_visitExpression(ExpressionPtr &expression) {
+  if (expression->nodeType() != CALL_EXPRESSION)
+    return;
+  auto call = std::static_pointer_cast<CallExpression>(expression);
+  if (call->function == nullptr || call->function->nodeType() != IDENTIFIER)
+    return;
+
+  auto replacement = _inlineCall(call.get());
+  if (replacement == nullptr)
+    replacement = _foldArrayBuiltin(call.get());
+  if (replacement != nullptr) {
+    expression = replacement;
+    _rewritten++;
+  }
+}
+
+ExpressionPtr InliningPass::_inlineCall(CallExpression *call) {
+  auto &name = std::static_pointer_cast<Identifier>(call->function)->value;
+  auto candidate = _functions.find(name);
+  if (candidate == _functions.end() || _isShadowed(name) ||
+      _definedAt[name] >= _statementIndex)
+    return nullptr;
+
+  auto function = candidate->second;
+  if (call->arguments.size() != function->parameters.size())
+    return nullptr;
+
+  auto &only = function->body->statements[0];
+  auto body =
+      only->nodeType() == EXPRESSION_STATEMENT
+          ? std::static_pointer_cast<ExpressionStatement>(only)->expression
+          : std::static_pointer_cast<ReturnStatement>(only)->returnValue;
+
+  std::unordered_map<std::string, int> uses;
+  forEachNode(body, [&](Node *child) {
+    if (child->nodeType() == IDENTIFIER)
+      uses[static_cast<Identifier *>(child)->value]++;
+  });
+
+  // Arguments are evaluated exactly once at a call; only substitute them
+  // where that stays true or where repeating them is free.
+  std::unordered_map<std::string, ExpressionPtr> substitutions;
+  for (size_t i = 0; i < call->arguments.size(); i++) {
+    auto &argument = call->arguments[i];
+    auto count = uses[function->parameters[i]->value];
+    if (!isPure(argument))
+      return nullptr;
+    if (count == 0 && !isLiteral(argument))
+      return nullptr;
+    if (count > 1 && !isLiteral(argument) &&
+        argument->nodeType() != IDENTIFIER)
+      return nullptr;
+    substitutions[function->parameters[i]->value] = argument;
+  }
+
+  // A substituted argument runs where its parameter is first read instead of
+  // before the body. Any of them can fail unless it is a literal, so those
+  // first reads have to come in parameter order and ahead of everything in
+  // the body that can fail, or a different error would be reported.
+  std::unordered_map<std::string, int> parameters;
+  for (size_t i = 0; i < function->parameters.size(); i++)
+    parameters[function->parameters[i]->value] = static_cast<int>(i);
+  std::vector<int> order;
+  evaluationOrder(body, parameters, order);
+  auto &arguments = call->arguments;
+  size_t next = 0;
+  auto skipLiterals = [&] {
+    while (next < arguments.size() && isLiteral(arguments[next]))
+      next++;
+  };
+  skipLiterals();
+  for (auto step : order) {
+    if (next == arguments.size())
+      break;
+    if (step >= 0 && (static_cast<size_t>(step) < next ||
+                      isLiteral(arguments[step])))
+      continue;
+    if (step != static_cast<int>(next))
+      return nullptr;
+    next++;
+    skipLiterals();
+  }
+  return cloneExpression(body, substitutions);
+}
+
+ExpressionPtr InliningPass::_foldArrayBuiltin(CallExpression *call) {
+  auto &name = std::static_pointer_cast<Identifier>(call->function)->value;
+  if (name != "len" && name != "first" && name != "last")
+    return nullptr;
+  if (_boundNames.contains(name) || call->arguments.size() != 1 || call->arguments[0] == nullptr)
+    return nullptr;
+
+  auto &argument = call->arguments[0];
+  if (name == "len" && argument->nodeType() == STRING_LITERAL) {
+    return makeIntegerLiteral(static_cast<int64_t>(
+        StringKernels::countCodePoints(
+            std::static_pointer_cast<StringLiteralExpression>(argument)
+                ->value)));
+  }
+
+  ArrayLiteralExpression *array = nullptr;
+  if (argument->nodeType() == ARRAY_LITERAL) {
+    array = static_cast<ArrayLiteralExpression *>(argument.get());
+    // Folding drops the elements, which is only safe when evaluating them
+    // has no observable effect, including errors.
+    for (const auto &element : array->elements) {
+      if (!isLiteral(element))
+        return nullptr;
+    }
+  } else if (argument->nodeType() == IDENTIFIER) {
+    auto &arrayName = std::static_pointer_cast<Identifier>(argument)->value;
+    auto known = _arrays.find(arrayName);
+    if (known == _arrays.end() || _isShadowed(arrayName) ||
+        _definedAt[arrayName] >= _statementIndex)
+      return nullptr;
+    array = known->second;
+  }
+  if (array == nullptr)
+    return nullptr;
+
+  if (name == "len")
+    return makeIntegerLiteral(static_cast<int64_t>(array->elements.size()));
+  if (array->elements.empty())
+    return nullptr;
+  // `first` and `last` evaluate a copy of the element, which is only the same
+  // as reading the element of a named array when it is a literal.
+  for (const auto &element : array->elements) {
+    if (!isLiteral(element))
+      return nullptr;
+  }
+  auto &element = name == "first" ? array->elements.front()
+                                  : array->elements.back();
+  return cloneExpression(element, {});
+}
+
+Optimizer::Optimizer(OptimizationLevel level) {
+  if (level == O0)
+    return;
+  addPass(std::make_shared<ConstantFoldingPass>());
+  addPass(std::make_shared<DeadBranchEliminationPass>());
+  if (level >= O2) {
+    addPass(std::make_shared<InliningPass>());
+  }
+  // Runs last so it annotates the tree the other passes settled on.
+  addPass(std::make_shared<TypeInferencePass>());
+}
+
+void Optimizer::addPass(const OptimizationPassPtr &pass) {
+  _passes.push_back(pass);
+}
+
+std::vector<PassReport> Optimizer::optimize(const ProgramPtr &program) {
+  const int maxRounds = 4;
+
+  std::vector<PassReport> reports;
+  for (const auto &pass : _passes)
+    reports.push_back({pass->name(), 0});
+
+  for (int round = 0; round < maxRounds; round++) {
+    int rewritten = 0;
+    for (size_t i = 0; i < _passes.size(); i++) {
+      auto count = _passes[i]->run(program);
+      reports[i].rewritten += count;
+      rewritten += count;
+    }
+    if (rewritten == 0)
+      break;
+  }
+  return reports;
+}
@@ -0,0 +1,106 @@
+#ifndef MONKEY_OPTIMIZER_H
+#define MONKEY_OPTIMIZER_H
+
+#include "AST.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// O1 folds constants, prunes dead branches and infers static types; O2 also
+// inlines.
+enum OptimizationLevel { O0 = 0, O1, O2 };
+
+class OptimizationPass {
+public:
+  virtual ~OptimizationPass() = default;
+  virtual std::string name() = 0;
+
+  // Rewrites the program in place and returns the number of nodes rewritten.
+  virtual int run(const ProgramPtr &program);
+
+protected:
+  void _walkStatements(StatementPtrVec &statements);
+  void _walkStatement(const StatementPtr &statement);
+  void _walkExpression(ExpressionPtr &expression);
+
+  // Called for every expression slot after its children have been walked. A
+  // pass rewrites the expression by assigning a new node to the slot.
+  virtual void _visitExpression(ExpressionPtr & /*expression*/) {}
+  // Called for every statement list after its statements have been walked.
+  virtual void _visitStatements(StatementPtrVec & /*statements*/) {}
+  virtual void _enterFunction(FunctionLiteralExpression * /*function*/) {}
+  virtual void _leaveFunction(FunctionLiteralExpression * /*function*/) {}
+
+  int _rewritten = 0;
+};
+typedef std::shared_ptr<OptimizationPass> OptimizationPassPtr;
+
+// Folds prefix and infix expressions whose operands are literals.
+class ConstantFoldingPass : public OptimizationPass {
+public:
+  std::string name() override;
+
+protected:
+  void _visitExpression(ExpressionPtr &expression) override;
+};
+
+// Drops the untaken arm of `if` expressions whose condition is a literal and
+// splices the taken block into the enclosing statement list where possible.
+class DeadBranchEliminationPass : public OptimizationPass {
+public:
+  std::string name() override;
+
+protected:
+  void _visitExpression(ExpressionPtr &expression) override;
+  void _visitStatements(StatementPtrVec &statements) override;
+};
+
+// Inlines calls to small non-recursive top-level functions and folds
+// `len`/`first`/`last` applied to array literals or to arrays bound once at
+// the top level and only ever read.
+class InliningPass : public OptimizationPass {
+public:
+  std::string name() override;
+  int run(const ProgramPtr &program) override;
+
+protected:
+  void _visitExpression(ExpressionPtr &expression) override;
+  void _enterFunction(FunctionLiteralExpression *function) override;
+  void _leaveFunction(FunctionLiteralExpression *function) override;
+
+private:
+  void _collectCandidates(const ProgramPtr &program);
+  bool _isShadowed(const std::string &name);
+  ExpressionPtr _inlineCall(CallExpression *call);
+  ExpressionPtr _foldArrayBuiltin(CallExpression *call);
+
+  std::unordered_map<std::string, FunctionLiteralExpression *> _functions;
+  std::unordered_map<std::string, ArrayLiteralExpression *> _arrays;
+  std::unordered_map<std::string, size_t> _definedAt;
+  std::unordered_set<std::string> _boundNames;
+  std::vector<std::unordered_set<std::string>> _scopes;
+  size_t _statementIndex = 0;
+};
+
+struct PassReport {
+  std::string name;
+  int rewritten;
+};
+
+class Optimizer {
+public:
+  explicit Optimizer(OptimizationLevel level);
+
+  void addPass(const OptimizationPassPtr &pass);
+
+  // Runs the pipeline until it stops rewriting (bounded by a few rounds) and
+  // returns the number of nodes each pass rewrote.
+  std::vector<PassReport> optimize(const ProgramPtr &program);
+
+private:
+  std::vector<OptimizationPassPtr> _passes;
+};
+
+#endif // MONKEY_OPTIMIZER_H
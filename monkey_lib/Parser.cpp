@@ -1,10 +1,12 @@
 #include "Parser.h"
 
+#include <algorithm>
 #include <memory>
 #include <utility>
 #include <vector>
 
 #include "AST.h"
+#include "StringKernels.h"
 #include "Token.h"
 #include "utilities.h"
 
@@ -21,8 +23,12 @@ Parser::Parser(Lexer *lexer) : _lexer(lexer) {
   _registerPrefix(FALSE, &Parser::_parseBooleanLiteralExpression);
   _registerPrefix(LPAREN, &Parser::_parseGroupedExpression);
   _registerPrefix(IF, &Parser::_parseIfExpression);
+  _registerPrefix(WHILE, &Parser::_parseWhileExpression);
+  _registerPrefix(FOR, &Parser::_parseForExpression);
   _registerPrefix(FUNCTION, &Parser::_parseFunctionLiteralExpression);
   _registerPrefix(LBRACKET, &Parser::_parseArrayLiteral);
+  _registerPrefix(LBRACE, &Parser::_parseHashLiteral);
+  _registerPrefix(RECORD, &Parser::_parseRecordLiteral);
 
   _registerInfix(PLUS, &Parser::_parseInfixExpression);
   _registerInfix(MINUS, &Parser::_parseInfixExpression);
@@ -34,6 +40,8 @@ Parser::Parser(Lexer *lexer) : _lexer(lexer) {
   _registerInfix(GT, &Parser::_parseInfixExpression);
   _registerInfix(LPAREN, &Parser::_parseCallExpression);
   _registerInfix(LBRACKET, &Parser::_parseIndexExpression);
+  _registerInfix(DOT, &Parser::_parseFieldExpression);
+  _registerInfix(ASSIGN, &Parser::_parseAssignExpression);
 }
 
 ProgramPtr Parser::parseProgram() {
@@ -46,7 +54,7 @@ ProgramPtr Parser::parseProgram() {
     _nextToken();
   } while (_currentToken.type != EOF_);
 
-  return std::make_shared<Program>(program);
+  return makeNode<Program>(program);
 }
 
 std::vector<std::string> Parser::errors() { return _errors; }
@@ -85,7 +93,7 @@ LetStatementPtr Parser::_parseLetStatement() {
   if (_peekTokenIs(SEMICOLON))
     _nextToken();
 
-  return std::make_shared<LetStatement>(statement);
+  return makeNode<LetStatement>(statement);
 }
 
 ReturnStatementPtr Parser::_parseReturnStatement() {
@@ -97,7 +105,7 @@ ReturnStatementPtr Parser::_parseReturnStatement() {
   if (_peekTokenIs(SEMICOLON))
     _nextToken();
 
-  return std::make_shared<ReturnStatement>(statement);
+  return makeNode<ReturnStatement>(statement);
 }
 
 ExpressionStatementPtr Parser::_parseExpressionStatement() {
@@ -107,7 +115,7 @@ ExpressionStatementPtr Parser::_parseExpressionStatement() {
   if (_peekTokenIs(SEMICOLON))
     _nextToken();
 
-  return std::make_shared<ExpressionStatement>(statement);
+  return makeNode<ExpressionStatement>(statement);
 }
 
 ExpressionPtr Parser::_parseExpression(int precedence) {
@@ -157,7 +165,7 @@ ExpressionPtr Parser::_parseIdentifier() {
   Identifier identifier;
   identifier.token = _currentToken;
   identifier.value = _currentToken.literal;
-  return std::make_shared<Identifier>(identifier);
+  return makeNode<Identifier>(identifier);
 }
 
 ExpressionPtr Parser::_parseIntegerLiteralExpression() {
@@ -171,14 +179,19 @@ ExpressionPtr Parser::_parseIntegerLiteralExpression() {
     _errors.push_back(msg);
     return nullptr;
   }
-  return std::make_shared<IntegerLiteralExpression>(literal);
+  return makeNode<IntegerLiteralExpression>(literal);
 }
 
 ExpressionPtr Parser::_parseStringLiteralExpression() {
   StringLiteralExpression literal;
   literal.token = _currentToken;
   literal.value = _currentToken.literal;
-  return std::make_shared<StringLiteralExpression>(literal);
+  // Source text is read as bytes; strings only ever hold valid UTF-8.
+  if (!StringKernels::isValidUtf8(literal.value)) {
+    _errors.push_back("String literal is not valid UTF-8");
+    return nullptr;
+  }
+  return makeNode<StringLiteralExpression>(literal);
 }
 
 ExpressionPtr Parser::_parsePrefixExpression() {
@@ -187,7 +200,7 @@ ExpressionPtr Parser::_parsePrefixExpression() {
   prefix.operator_ = _currentToken.literal;
   _nextToken();
   prefix.right = _parseExpression(PREFIX);
-  return std::make_shared<PrefixExpression>(prefix);
+  return makeNode<PrefixExpression>(prefix);
 }
 
 ExpressionPtr
@@ -199,14 +212,32 @@ Parser::_parseInfixExpression(ExpressionPtr left) {
   auto precedence = _currentPrecedence();
   _nextToken();
   infix.right = _parseExpression(precedence);
-  return std::make_shared<InfixExpression>(infix);
+  return makeNode<InfixExpression>(infix);
+}
+
+// Assignment is right-associative: `a = b = 1` assigns 1 to both.
+ExpressionPtr Parser::_parseAssignExpression(ExpressionPtr target) {
+  AssignExpression assign;
+  assign.token = _currentToken;
+  if (target == nullptr || (target->nodeType() != IDENTIFIER &&
+                            target->nodeType() != INDEX_EXPRESSION &&
+                            target->nodeType() != FIELD_EXPRESSION)) {
+    _errors.push_back(string_format(
+        "Cannot assign to %s",
+        target != nullptr ? target->string().c_str() : "nothing"));
+    return nullptr;
+  }
+  assign.target = std::move(target);
+  _nextToken();
+  assign.value = _parseExpression(ASSIGNMENT - 1);
+  return makeNode<AssignExpression>(assign);
 }
 
 ExpressionPtr Parser::_parseBooleanLiteralExpression() {
   BooleanLiteralExpression boolean;
   boolean.token = _currentToken;
   boolean.value = _currentTokenIs(TRUE);
-  return std::make_shared<BooleanLiteralExpression>(boolean);
+  return makeNode<BooleanLiteralExpression>(boolean);
 }
 
 ExpressionPtr Parser::_parseGroupedExpression() {
@@ -242,7 +273,59 @@ ExpressionPtr Parser::_parseIfExpression() {
     expression.alternative = _parseBlockStatement();
   }
 
-  return std::make_shared<IfExpression>(expression);
+  return makeNode<IfExpression>(expression);
+}
+
+ExpressionPtr Parser::_parseWhileExpression() {
+  WhileExpression expression;
+  expression.token = _currentToken;
+
+  if (!_expectPeek(LPAREN))
+    return nullptr;
+
+  _nextToken();
+  expression.condition = _parseExpression(LOWEST);
+
+  if (!_expectPeek(RPAREN))
+    return nullptr;
+
+  if (!_expectPeek(LBRACE))
+    return nullptr;
+
+  expression.body = _parseBlockStatement();
+
+  return makeNode<WhileExpression>(expression);
+}
+
+ExpressionPtr Parser::_parseForExpression() {
+  ForExpression expression;
+  expression.token = _currentToken;
+
+  if (!_expectPeek(LPAREN))
+    return nullptr;
+
+  if (!_expectPeek(IDENT))
+    return nullptr;
+
+  expression.variable = makeNode<Identifier>();
+  expression.variable->token = _currentToken;
+  expression.variable->value = _currentToken.literal;
+
+  if (!_expectPeek(IN))
+    return nullptr;
+
+  _nextToken();
+  expression.iterable = _parseExpression(LOWEST);
+
+  if (!_expectPeek(RPAREN))
+    return nullptr;
+
+  if (!_expectPeek(LBRACE))
+    return nullptr;
+
+  expression.body = _parseBlockStatement();
+
+  return makeNode<ForExpression>(expression);
 }
 
 BlockStatementPtr Parser::_parseBlockStatement() {
@@ -260,7 +343,7 @@ BlockStatementPtr Parser::_parseBlockStatement() {
     _nextToken();
   }
 
-  return std::make_shared<BlockStatement>(block);
+  return makeNode<BlockStatement>(block);
 }
 
 ExpressionPtr Parser::_parseFunctionLiteralExpression() {
@@ -277,14 +360,67 @@ ExpressionPtr Parser::_parseFunctionLiteralExpression() {
 
   expression.body = _parseBlockStatement();
 
-  return std::make_shared<FunctionLiteralExpression>(expression);
+  return makeNode<FunctionLiteralExpression>(expression);
 }
 
 ExpressionPtr Parser::_parseArrayLiteral(){
   ArrayLiteralExpression expression;
   expression.token = _currentToken;
   expression.elements = _parseExpressionList(RBRACKET);
-  return std::make_shared<ArrayLiteralExpression>(expression);
+  return makeNode<ArrayLiteralExpression>(expression);
+}
+
+ExpressionPtr Parser::_parseHashLiteral() {
+  HashLiteralExpression expression;
+  expression.token = _currentToken;
+
+  while (!_peekTokenIs(RBRACE)) {
+    _nextToken();
+    auto key = _parseExpression(LOWEST);
+    if (!_expectPeek(COLON))
+      return nullptr;
+    _nextToken();
+    auto value = _parseExpression(LOWEST);
+    expression.pairs.emplace_back(key, value);
+    if (!_peekTokenIs(RBRACE) && !_expectPeek(COMMA))
+      return nullptr;
+  }
+
+  if (!_expectPeek(RBRACE))
+    return nullptr;
+  return makeNode<HashLiteralExpression>(expression);
+}
+
+// The fields of a record are fixed by its literal, so each name may appear
+// only once.
+ExpressionPtr Parser::_parseRecordLiteral() {
+  RecordLiteralExpression expression;
+  expression.token = _currentToken;
+  if (!_expectPeek(LBRACE))
+    return nullptr;
+
+  while (!_peekTokenIs(RBRACE)) {
+    if (!_expectPeek(IDENT))
+      return nullptr;
+    auto name = _currentToken.literal;
+    if (std::find(expression.names.begin(), expression.names.end(), name) !=
+        expression.names.end()) {
+      _errors.push_back(
+          string_format("Duplicate field %s in record", name.c_str()));
+      return nullptr;
+    }
+    if (!_expectPeek(COLON))
+      return nullptr;
+    _nextToken();
+    expression.names.push_back(std::move(name));
+    expression.values.push_back(_parseExpression(LOWEST));
+    if (!_peekTokenIs(RBRACE) && !_expectPeek(COMMA))
+      return nullptr;
+  }
+
+  if (!_expectPeek(RBRACE))
+    return nullptr;
+  return makeNode<RecordLiteralExpression>(expression);
 }
 
 IdentifierPtrVec Parser::_parseFunctionParameters() {
@@ -297,7 +433,7 @@ IdentifierPtrVec Parser::_parseFunctionParameters() {
 
   _nextToken();
 
-  auto identifier = std::make_shared<Identifier>();
+  auto identifier = makeNode<Identifier>();
   identifier->token = _currentToken;
   identifier->value = _currentToken.literal;
   identifiers.push_back(identifier);
@@ -305,7 +441,7 @@ IdentifierPtrVec Parser::_parseFunctionParameters() {
   while (_peekTokenIs(COMMA)) {
     _nextToken();
     _nextToken();
-    identifier = std::make_shared<Identifier>();
+    identifier = makeNode<Identifier>();
     identifier->token = _currentToken;
     identifier->value = _currentToken.literal;
     identifiers.push_back(identifier);
@@ -322,7 +458,7 @@ Parser::_parseCallExpression(ExpressionPtr function) {
   expression.token = _currentToken;
   expression.function = std::move(function);
   expression.arguments = _parseCallArguments();
-  return std::make_shared<CallExpression>(expression);
+  return makeNode<CallExpression>(expression);
 }
 
 ExpressionPtrVec Parser::_parseCallArguments() {
@@ -359,7 +495,17 @@ ExpressionPtr Parser::_parseIndexExpression(ExpressionPtr left) {
     return nullptr;
   }
 
-  return std::make_shared<IndexExpression>(expression);
+  return makeNode<IndexExpression>(expression);
+}
+
+ExpressionPtr Parser::_parseFieldExpression(ExpressionPtr left) {
+  FieldExpression expression;
+  expression.token = _currentToken;
+  expression.left = std::move(left);
+  if (!_expectPeek(IDENT))
+    return nullptr;
+  expression.name = _currentToken.literal;
+  return makeNode<FieldExpression>(expression);
 }
 
 void Parser::_noPrefixParseFnError(const TokenType &t) {
@@ -15,12 +15,23 @@ typedef ExpressionPtr (Parser::*prefixParseFn)();
 
 typedef ExpressionPtr (Parser::*infixParseFn)(ExpressionPtr);
 
-enum { LOWEST = 1, EQUALS, LESS_GREATER, SUM, PRODUCT, PREFIX, CALL, INDEX };
+enum {
+  LOWEST = 1,
+  ASSIGNMENT,
+  EQUALS,
+  LESS_GREATER,
+  SUM,
+  PRODUCT,
+  PREFIX,
+  CALL,
+  INDEX
+};
 
 const std::map<TokenType, int> precedences = {
-    {EQ, EQUALS},       {NOT_EQ, EQUALS},    {LT, LESS_GREATER},
-    {GT, LESS_GREATER}, {PLUS, SUM},         {MINUS, SUM},
-    {SLASH, PRODUCT},   {ASTERISK, PRODUCT}, {LPAREN, CALL}, {LBRACKET, INDEX} };
+    {ASSIGN, ASSIGNMENT}, {EQ, EQUALS},          {NOT_EQ, EQUALS},
+    {LT, LESS_GREATER},   {GT, LESS_GREATER},    {PLUS, SUM},
+    {MINUS, SUM},         {SLASH, PRODUCT},      {ASTERISK, PRODUCT},
+    {LPAREN, CALL},       {LBRACKET, INDEX},     {DOT, INDEX}};
 
 class Parser {
 public:
@@ -55,12 +66,18 @@ private:
 
   ExpressionPtr _parseInfixExpression(ExpressionPtr left);
 
+  ExpressionPtr _parseAssignExpression(ExpressionPtr target);
+
   ExpressionPtr _parseBooleanLiteralExpression();
 
   ExpressionPtr _parseGroupedExpression();
 
   ExpressionPtr _parseIfExpression();
 
+  ExpressionPtr _parseWhileExpression();
+
+  ExpressionPtr _parseForExpression();
+
   BlockStatementPtr _parseBlockStatement();
 
   ExpressionPtr _parseFunctionLiteralExpression();
@@ -73,8 +90,14 @@ private:
 
   ExpressionPtr _parseArrayLiteral();
 
+  ExpressionPtr _parseHashLiteral();
+
+  ExpressionPtr _parseRecordLiteral();
+
   ExpressionPtr _parseIndexExpression(ExpressionPtr left);
 
+  ExpressionPtr _parseFieldExpression(ExpressionPtr left);
+
   void _noPrefixParseFnError(const TokenType &t);
 
   void _registerPrefix(const TokenType &tokenType, prefixParseFn fn);
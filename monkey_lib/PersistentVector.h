@@ -0,0 +1,245 @@
+#ifndef MONKEY_PERSISTENTVECTOR_H
+#define MONKEY_PERSISTENTVECTOR_H
+
+#include "Allocator.h"
+#include "Ref.h"
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <utility>
+
+// An immutable sequence that shares structure between versions: a 32-way trie
+// of leaves holding the elements, plus a separate tail leaf that takes pushes
+// until it is full. Copying a vector is O(1); indexing walks at most
+// log32(n) levels, and push_back and set copy at most one path, leaving
+// every other version that shares the nodes untouched.
+//
+// A vector is a window [offset, offset + size) onto its trie, so slicing only
+// narrows the window. Nodes nobody else refers to are updated in place, which
+// makes repeated pushes onto one vector amortized O(1).
+template <typename T> class PersistentVector {
+  static constexpr size_t _bits = 5;
+  static constexpr size_t _width = size_t(1) << _bits;
+  static constexpr size_t _mask = _width - 1;
+
+  struct Node : public RefCounted {};
+  struct Branch : public Node, public RuntimeAllocated<Branch> {
+    Ref<Node> children[_width];
+  };
+  struct Leaf : public Node, public RuntimeAllocated<Leaf> {
+    T values[_width];
+  };
+
+public:
+  class const_iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T *;
+    using reference = const T &;
+
+    const_iterator() = default;
+
+    reference operator*() const { return _values[_index & _mask]; }
+    pointer operator->() const { return &**this; }
+    const_iterator &operator++() {
+      if ((++_index & _mask) == 0 && _index < _end)
+        _values = _vector->_leafFor(_index);
+      return *this;
+    }
+    const_iterator operator++(int) {
+      auto previous = *this;
+      ++*this;
+      return previous;
+    }
+    bool operator==(const const_iterator &other) const {
+      return _index == other._index;
+    }
+
+  private:
+    friend class PersistentVector;
+
+    const_iterator(const PersistentVector *vector, size_t index)
+        : _vector(vector), _index(index),
+          _end(vector->_offset + vector->_size) {
+      if (_index < _end)
+        _values = vector->_leafFor(_index);
+    }
+
+    const PersistentVector *_vector = nullptr;
+    // Absolute position in the trie, and the leaf holding it.
+    size_t _index = 0;
+    size_t _end = 0;
+    const T *_values = nullptr;
+  };
+
+  PersistentVector() = default;
+  template <typename Iterator> PersistentVector(Iterator first, Iterator last) {
+    for (; first != last; ++first)
+      push_back(*first);
+  }
+
+  // A vector of `size` elements written a leaf at a time: `fill(values,
+  // index, count)` stores the elements [index, index + count) in `values`.
+  template <typename F> static PersistentVector generate(size_t size, F fill) {
+    PersistentVector vector;
+    for (size_t index = 0; index < size; index += _width) {
+      if (vector._tail != nullptr)
+        vector._pushTail();
+      vector._tail = Ref<Leaf>(new Leaf());
+      auto count = std::min(_width, size - index);
+      fill(vector._tail->values, index, count);
+      vector._count += count;
+    }
+    vector._size = vector._count;
+    return vector;
+  }
+
+  size_t size() const { return _size; }
+  bool empty() const { return _size == 0; }
+
+  const T &operator[](size_t index) const {
+    auto position = _offset + index;
+    return _leafFor(position)[position & _mask];
+  }
+  const T &front() const { return (*this)[0]; }
+  const T &back() const { return (*this)[_size - 1]; }
+
+  // The elements from `index` on that lie next to it in memory, up to the end
+  // of its leaf or of the vector: a pointer to the first and their number.
+  std::pair<const T *, size_t> run(size_t index) const {
+    auto position = _offset + index;
+    auto within = position & _mask;
+    return {_leafFor(position) + within,
+            std::min(_width - within, _size - index)};
+  }
+
+  const_iterator begin() const { return const_iterator(this, _offset); }
+  const_iterator end() const { return const_iterator(this, _offset + _size); }
+
+  void push_back(T value) {
+    auto position = _offset + _size;
+    // Elements past the window belong to a longer version; overwrite the
+    // next one in a copy of its path.
+    if (position < _count) {
+      _set(position, std::move(value));
+      _size++;
+      return;
+    }
+
+    if (_count - _tailOffset() == _width) {
+      _pushTail();
+      _tail = Ref<Leaf>(new Leaf());
+    } else if (_tail == nullptr) {
+      _tail = Ref<Leaf>(new Leaf());
+    }
+    _unique(_tail)->values[_count & _mask] = std::move(value);
+    _count++;
+    _size++;
+  }
+
+  void set(size_t index, T value) { _set(_offset + index, std::move(value)); }
+
+  // The elements [start, end), sharing this vector's nodes.
+  PersistentVector slice(size_t start, size_t end) const {
+    auto slice = *this;
+    slice._offset += start;
+    slice._size = end - start;
+    return slice;
+  }
+
+private:
+  // Position of the first element in the tail.
+  size_t _tailOffset() const {
+    return _count < _width ? 0 : ((_count - 1) >> _bits) << _bits;
+  }
+
+  const T *_leafFor(size_t position) const {
+    if (position >= _tailOffset())
+      return _tail->values;
+    auto node = _root.get();
+    for (auto level = _shift; level > 0; level -= _bits)
+      node = static_cast<Branch *>(node)->children[(position >> level) & _mask]
+                 .get();
+    return static_cast<Leaf *>(node)->values;
+  }
+
+  // Makes `node` safe to modify: copies it unless this vector holds the only
+  // reference.
+  template <typename N> static N *_unique(Ref<N> &node) {
+    if (node->refCount() != 1)
+      node = Ref<N>(new N(*node));
+    return node.get();
+  }
+  template <typename N> static N *_unique(Ref<Node> &node) {
+    if (node->refCount() != 1)
+      node = Ref<Node>(new N(*static_cast<N *>(node.get())));
+    return static_cast<N *>(node.get());
+  }
+
+  void _set(size_t position, T value) {
+    if (position >= _tailOffset()) {
+      _unique(_tail)->values[position & _mask] = std::move(value);
+      return;
+    }
+    auto slot = &_root;
+    for (auto level = _shift; level > 0; level -= _bits)
+      slot = &_unique<Branch>(*slot)->children[(position >> level) & _mask];
+    _unique<Leaf>(*slot)->values[position & _mask] = std::move(value);
+  }
+
+  // Moves the full tail into the trie, adding a level when the trie is full.
+  void _pushTail() {
+    Ref<Node> tail(_tail);
+    if (_root == nullptr) {
+      auto root = new Branch();
+      root->children[0] = std::move(tail);
+      _root = Ref<Node>(root);
+      _shift = _bits;
+      return;
+    }
+    if ((_count >> _bits) > (size_t(1) << _shift)) {
+      auto root = new Branch();
+      root->children[0] = std::move(_root);
+      root->children[1] = _newPath(_shift, std::move(tail));
+      _root = Ref<Node>(root);
+      _shift += _bits;
+      return;
+    }
+
+    auto slot = &_root;
+    auto index = _count - 1;
+    for (auto level = _shift; level > _bits; level -= _bits) {
+      auto &child =
+          _unique<Branch>(*slot)->children[(index >> level) & _mask];
+      if (child == nullptr) {
+        child = _newPath(level - _bits, std::move(tail));
+        return;
+      }
+      slot = &child;
+    }
+    _unique<Branch>(*slot)->children[(index >> _bits) & _mask] =
+        std::move(tail);
+  }
+
+  // A chain of branches `level` deep ending in `leaf`.
+  static Ref<Node> _newPath(size_t level, Ref<Node> leaf) {
+    if (level == 0)
+      return leaf;
+    auto branch = new Branch();
+    branch->children[0] = _newPath(level - _bits, std::move(leaf));
+    return Ref<Node>(branch);
+  }
+
+  Ref<Node> _root;
+  Ref<Leaf> _tail;
+  // Bits to shift a position by to index the root.
+  size_t _shift = 0;
+  // Elements in the trie and tail, including those outside the window.
+  size_t _count = 0;
+  size_t _offset = 0;
+  size_t _size = 0;
+};
+
+#endif // MONKEY_PERSISTENTVECTOR_H
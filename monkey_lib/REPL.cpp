@@ -1,11 +1,13 @@
 #include "REPL.h"
 #include "Evaluator.h"
 #include "Lexer.h"
+#include "Optimizer.h"
 #include "Parser.h"
 
-void REPL::start() {
+void REPL::start(OptimizationLevel level) {
   auto environment = std::make_shared<Environment>();
   auto evaluator = Evaluator(environment);
+  auto optimizer = Optimizer(level);
 
   while (true) {
     std::cout << PROMPT;
@@ -19,6 +21,7 @@ void REPL::start() {
       printParseErrors(parser->errors());
       continue;
     }
+    optimizer.optimize(program);
 
     auto evaluated = evaluator.evaluate(program);
     if (evaluated != nullptr) {
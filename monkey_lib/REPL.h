@@ -1,6 +1,7 @@
 #ifndef MONKEY_REPL_H
 #define MONKEY_REPL_H
 
+#include "Optimizer.h"
 #include <iostream>
 #include <string>
 #include <vector>
@@ -9,7 +10,7 @@ const auto PROMPT = ">> ";
 
 class REPL {
 public:
-  static void start();
+  static void start(OptimizationLevel level = O1);
   static void printParseErrors(const std::vector<std::string> &errors);
 };
 
@@ -0,0 +1,142 @@
+#ifndef MONKEY_REF_H
+#define MONKEY_REF_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+// Base for intrusively reference-counted runtime values. The count lives in
+// the object itself, so a Ref is a single pointer and needs no control block.
+//
+// Objects created inside a ThreadConfinedScope are only ever touched by that
+// thread and use plain increments; all others count atomically.
+class RefCounted {
+public:
+  RefCounted() : _confined(_confinedToThread) {}
+  // A copy is a new object nobody refers to yet.
+  RefCounted(const RefCounted &) : RefCounted() {}
+  RefCounted &operator=(const RefCounted &) { return *this; }
+  virtual ~RefCounted() = default;
+
+  void retain() const {
+    if (_confined)
+      _refCount++;
+    else
+      std::atomic_ref<uint32_t>(_refCount).fetch_add(
+          1, std::memory_order_relaxed);
+  }
+  void release() const {
+    auto last = _confined ? --_refCount == 0
+                          : std::atomic_ref<uint32_t>(_refCount).fetch_sub(
+                                1, std::memory_order_acq_rel) == 1;
+    if (last)
+      delete this;
+  }
+  uint32_t refCount() const {
+    return std::atomic_ref<uint32_t>(_refCount).load(
+        std::memory_order_relaxed);
+  }
+  bool isThreadConfined() const { return _confined; }
+
+private:
+  friend class ThreadConfinedScope;
+
+  alignas(std::atomic_ref<uint32_t>::required_alignment) mutable uint32_t
+      _refCount = 0;
+  const bool _confined;
+
+  static inline thread_local bool _confinedToThread = false;
+};
+
+// Marks objects created on the current thread while it is alive as confined
+// to that thread. Scopes nest; the previous setting is restored on exit.
+class ThreadConfinedScope {
+public:
+  explicit ThreadConfinedScope(bool confined = true)
+      : _previous(RefCounted::_confinedToThread) {
+    RefCounted::_confinedToThread = confined;
+  }
+  ~ThreadConfinedScope() { RefCounted::_confinedToThread = _previous; }
+  ThreadConfinedScope(const ThreadConfinedScope &) = delete;
+  ThreadConfinedScope &operator=(const ThreadConfinedScope &) = delete;
+
+private:
+  bool _previous;
+};
+
+// Owning pointer to a RefCounted object.
+template <typename T> class Ref {
+public:
+  Ref() = default;
+  Ref(std::nullptr_t) {}
+  explicit Ref(T *pointer) : _pointer(pointer) {
+    if (_pointer != nullptr)
+      _pointer->retain();
+  }
+  Ref(const Ref &other) : Ref(other._pointer) {}
+  Ref(Ref &&other) noexcept : _pointer(std::exchange(other._pointer, nullptr)) {}
+  template <typename U,
+            typename = std::enable_if_t<std::is_convertible_v<U *, T *>>>
+  Ref(const Ref<U> &other) : Ref(static_cast<T *>(other.get())) {}
+  template <typename U,
+            typename = std::enable_if_t<std::is_convertible_v<U *, T *>>>
+  Ref(Ref<U> &&other) noexcept
+      : _pointer(std::exchange(other._pointer, nullptr)) {}
+  ~Ref() {
+    if (_pointer != nullptr)
+      _pointer->release();
+  }
+
+  Ref &operator=(Ref other) noexcept {
+    std::swap(_pointer, other._pointer);
+    return *this;
+  }
+
+  T *get() const { return _pointer; }
+  T *operator->() const { return _pointer; }
+  T &operator*() const { return *_pointer; }
+  explicit operator bool() const { return _pointer != nullptr; }
+
+private:
+  template <typename U> friend class Ref;
+
+  T *_pointer = nullptr;
+};
+
+template <typename T, typename U>
+bool operator==(const Ref<T> &left, const Ref<U> &right) {
+  return left.get() == right.get();
+}
+template <typename T, typename U>
+bool operator!=(const Ref<T> &left, const Ref<U> &right) {
+  return left.get() != right.get();
+}
+template <typename T> bool operator==(const Ref<T> &ref, std::nullptr_t) {
+  return ref.get() == nullptr;
+}
+template <typename T> bool operator!=(const Ref<T> &ref, std::nullptr_t) {
+  return ref.get() != nullptr;
+}
+
+template <typename T, typename... Args> Ref<T> makeRef(Args &&...args) {
+  return Ref<T>(new T(std::forward<Args>(args)...));
+}
+
+template <typename T, typename U> Ref<T> dynamicRefCast(const Ref<U> &ref) {
+  return Ref<T>(dynamic_cast<T *>(ref.get()));
+}
+
+template <typename T, typename U> Ref<T> staticRefCast(const Ref<U> &ref) {
+  return Ref<T>(static_cast<T *>(ref.get()));
+}
+
+template <typename T> struct std::hash<Ref<T>> {
+  size_t operator()(const Ref<T> &ref) const {
+    return std::hash<T *>()(ref.get());
+  }
+};
+
+#endif // MONKEY_REF_H
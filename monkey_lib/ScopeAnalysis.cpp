@@ -0,0 +1,141 @@
+#include "ScopeAnalysis.h"
+
+void ScopeAnalysis::analyze(const ProgramPtr &program) {
+  ScopeAnalysis analysis;
+  analysis._scopes.push_back(std::make_unique<Scope>());
+  analysis._bind(program, analysis._scopes.back().get());
+  analysis._freeVariables(program);
+
+  for (const auto &scope : analysis._scopes) {
+    if (scope->function == nullptr)
+      continue;
+    scope->function->escapeState =
+        scope->escapes ? ESCAPE_ESCAPES : ESCAPE_LOCAL;
+    scope->function->frameSize = scope->bindings.size();
+    // Prototypes built before the analysis carry stale metadata.
+    scope->function->prototype = nullptr;
+  }
+}
+
+static bool containsFunctionLiteral(const NodePtr &node) {
+  if (node->nodeType() == FUNCTION_LITERAL)
+    return true;
+  bool found = false;
+  forEachChild(node, [&found](const NodePtr &child) {
+    found = found || containsFunctionLiteral(child);
+  });
+  return found;
+}
+
+bool ScopeAnalysis::environmentEscapes(FunctionLiteralExpression *function) {
+  // Without analyze() every nested closure may keep the chain.
+  if (function->escapeState == ESCAPE_UNANALYZED) {
+    auto escapes =
+        function->body != nullptr && containsFunctionLiteral(function->body);
+    function->escapeState = escapes ? ESCAPE_ESCAPES : ESCAPE_LOCAL;
+  }
+  return function->escapeState == ESCAPE_ESCAPES;
+}
+
+// Numbers the nodes in evaluation order and records the binding sites of
+// every function scope. Blocks do not open scopes, so a let anywhere in a
+// function body binds in the function's scope; so does a for loop's
+// variable. A binding inside a loop runs once per iteration and therefore
+// counts as more than one site.
+void ScopeAnalysis::_bind(const NodePtr &node, Scope *scope) {
+  _positions[node.get()] = ++_position;
+
+  auto loops = _loops;
+  if (node->nodeType() == FUNCTION_LITERAL) {
+    auto function = std::static_pointer_cast<FunctionLiteralExpression>(node);
+    _scopes.push_back(std::make_unique<Scope>());
+    auto inner = _scopes.back().get();
+    inner->parent = scope;
+    inner->function = function.get();
+    for (const auto &parameter : function->parameters)
+      inner->bindings[parameter->value].sites++;
+    _functionScopes[node.get()] = inner;
+    scope = inner;
+    _loops = 0;
+  } else if (node->nodeType() == FOR_EXPRESSION) {
+    auto loop = std::static_pointer_cast<ForExpression>(node);
+    scope->bindings[loop->variable->value].sites += 2;
+  }
+  if (node->nodeType() == WHILE_EXPRESSION ||
+      node->nodeType() == FOR_EXPRESSION)
+    _loops++;
+  if (node->nodeType() == ASSIGN_EXPRESSION) {
+    auto target = std::static_pointer_cast<AssignExpression>(node)->target;
+    if (target->nodeType() == IDENTIFIER)
+      _assigned.insert(std::static_pointer_cast<Identifier>(target)->value);
+  }
+
+  forEachChild(node, [&](const NodePtr &child) { _bind(child, scope); });
+  _loops = loops;
+
+  if (node->nodeType() == LET_STATEMENT) {
+    auto let = std::static_pointer_cast<LetStatement>(node);
+    auto &binding = scope->bindings[let->name->value];
+    binding.sites += _loops > 0 ? 2 : 1;
+    binding.boundAt = _position;
+  }
+}
+
+std::set<std::string> ScopeAnalysis::_freeVariables(const NodePtr &node) {
+  std::set<std::string> names;
+  if (node->nodeType() == IDENTIFIER) {
+    names.insert(std::static_pointer_cast<Identifier>(node)->value);
+    return names;
+  }
+
+  forEachChild(node, [&](const NodePtr &child) {
+    names.merge(_freeVariables(child));
+  });
+
+  if (node->nodeType() == FUNCTION_LITERAL) {
+    auto function = static_cast<FunctionLiteralExpression *>(node.get());
+    for (const auto &[name, binding] : _functionScopes[function]->bindings)
+      names.erase(name);
+    _decideCaptureMode(function, names);
+  }
+  return names;
+}
+
+// A free variable bound in an enclosing function can be copied when the
+// closure is created if exactly one parameter or let binds it, that has
+// already run by the time the literal is evaluated and no assignment changes
+// it. Anything else (a recursive local function, a rebound name) keeps the
+// environment chain, which makes the enclosing function's environment escape.
+// Globals and builtins are found through the global environment either way.
+void ScopeAnalysis::_decideCaptureMode(
+    FunctionLiteralExpression *function,
+    const std::set<std::string> &freeVariables) {
+  auto enclosing = _functionScopes[function]->parent;
+  auto position = _positions[function];
+  auto mode = CAPTURE_NONE;
+  std::vector<std::string> captures;
+
+  for (const auto &name : freeVariables) {
+    for (auto scope = enclosing; scope->function != nullptr;
+         scope = scope->parent) {
+      auto binding = scope->bindings.find(name);
+      if (binding == scope->bindings.end())
+        continue;
+      if (binding->second.sites == 1 && binding->second.boundAt < position &&
+          !_assigned.contains(name)) {
+        captures.push_back(name);
+        if (mode == CAPTURE_NONE)
+          mode = CAPTURE_FLAT;
+      } else {
+        mode = CAPTURE_CHAIN;
+      }
+      break;
+    }
+  }
+
+  function->captureMode = mode;
+  function->captures = mode == CAPTURE_FLAT ? captures
+                                            : std::vector<std::string>();
+  if (mode == CAPTURE_CHAIN && enclosing->function != nullptr)
+    enclosing->escapes = true;
+}
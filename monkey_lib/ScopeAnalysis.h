@@ -0,0 +1,56 @@
+#ifndef MONKEY_SCOPEANALYSIS_H
+#define MONKEY_SCOPEANALYSIS_H
+
+#include "AST.h"
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Resolves the free variables of every function literal and decides how its
+// closures capture them (see CaptureMode) and whether a call's environment
+// can outlive the call.
+class ScopeAnalysis {
+public:
+  // Annotates every function literal in the program. Literals that were never
+  // analyzed are treated conservatively by the evaluator.
+  static void analyze(const ProgramPtr &program);
+
+  // Whether the environment of a call to `function` can outlive the call,
+  // i.e. whether a closure created in its body keeps the environment chain.
+  // The result is cached on the node.
+  static bool environmentEscapes(FunctionLiteralExpression *function);
+
+private:
+  // Where a name is bound in one function scope: how many parameters and lets
+  // bind it, and the position in the program after which the last one has
+  // run.
+  struct Binding {
+    int sites = 0;
+    size_t boundAt = 0;
+  };
+
+  struct Scope {
+    Scope *parent = nullptr;
+    FunctionLiteralExpression *function = nullptr;
+    std::unordered_map<std::string, Binding> bindings;
+    bool escapes = false;
+  };
+
+  void _bind(const NodePtr &node, Scope *scope);
+  std::set<std::string> _freeVariables(const NodePtr &node);
+  void _decideCaptureMode(FunctionLiteralExpression *function,
+                          const std::set<std::string> &freeVariables);
+
+  std::vector<std::unique_ptr<Scope>> _scopes;
+  std::unordered_map<Node *, Scope *> _functionScopes;
+  std::unordered_map<Node *, size_t> _positions;
+  size_t _position = 0;
+  // Loops enclosing the node being bound within its function.
+  int _loops = 0;
+  // Names assigned to anywhere in the program.
+  std::set<std::string> _assigned;
+};
+
+#endif // MONKEY_SCOPEANALYSIS_H
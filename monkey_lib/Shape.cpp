@@ -0,0 +1,28 @@
+#include "Shape.h"
+
+const Shape *Shape::empty() {
+  static Shape root;
+  return &root;
+}
+
+const Shape *Shape::with(const std::string &name) const {
+  std::lock_guard lock(_mutex);
+  auto &child = _children[name];
+  if (child == nullptr) {
+    child.reset(new Shape());
+    child->_fields.reserve(_fields.size() + 1);
+    for (const auto &field : _fields)
+      child->_fields.push_back({child.get(), field.name, field.slot});
+    child->_fields.push_back({child.get(), name, _fields.size()});
+  }
+  return child.get();
+}
+
+// Records have few fields, and sites that look one up cache what they find.
+const ShapeField *Shape::find(std::string_view name) const {
+  for (const auto &field : _fields) {
+    if (field.name == name)
+      return &field;
+  }
+  return nullptr;
+}
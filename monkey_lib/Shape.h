@@ -0,0 +1,50 @@
+#ifndef MONKEY_SHAPE_H
+#define MONKEY_SHAPE_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class Shape;
+
+// A field of one particular shape. An inline cache keeps a pointer to one,
+// so a single word tells both the shape it was found in and where to read.
+struct ShapeField {
+  const Shape *shape;
+  std::string name;
+  size_t slot;
+};
+
+// The layout of a record: the names of its fields, in slot order. Shapes
+// form a tree rooted at the empty shape, each adding one field to its parent.
+// Adding a field to a shape always gives back the same child, so records
+// built with the same fields in the same order share one shape, and
+// comparing shapes is comparing pointers.
+//
+// Shapes are never freed and are shared by every evaluator and thread.
+class Shape {
+public:
+  static const Shape *empty();
+
+  // The shape with the fields of this one followed by `name`, which must not
+  // be one of them.
+  const Shape *with(const std::string &name) const;
+  // The field called `name`, or nullptr.
+  const ShapeField *find(std::string_view name) const;
+
+  size_t size() const { return _fields.size(); }
+  const ShapeField &field(size_t slot) const { return _fields[slot]; }
+
+private:
+  Shape() = default;
+
+  std::vector<ShapeField> _fields;
+  mutable std::mutex _mutex;
+  mutable std::unordered_map<std::string, std::unique_ptr<Shape>> _children;
+};
+
+#endif // MONKEY_SHAPE_H
@@ -0,0 +1,185 @@
+#include "SlabAllocator.h"
+
+namespace {
+
+// Set once the heap of this thread has been handed over, after which blocks
+// allocated on it again are not.
+thread_local bool reaped = false;
+
+template <typename Slab> void pushSlab(Slab *&list, Slab *slab) {
+  slab->previous = nullptr;
+  slab->next = list;
+  if (list != nullptr)
+    list->previous = slab;
+  list = slab;
+}
+
+template <typename Slab> void unlinkSlab(Slab *&list, Slab *slab) {
+  if (slab->previous != nullptr)
+    slab->previous->next = slab->next;
+  else
+    list = slab->next;
+  if (slab->next != nullptr)
+    slab->next->previous = slab->previous;
+}
+
+} // namespace
+
+void *SlabAllocator::_allocateSlow(size_t size) {
+  auto heap = _heap != nullptr ? _heap : _createHeap();
+  auto &slabs = heap->classes[_index(size)];
+  auto current = slabs.current;
+  if (current == nullptr || !_collectRemoteFrees(current)) {
+    if (current != nullptr)
+      pushSlab(slabs.full, current);
+
+    // Before taking a new slab, look for blocks other threads have returned
+    // and for slabs left behind by threads that have exited.
+    if (slabs.partial == nullptr) {
+      for (auto slab = slabs.full; slab != nullptr;) {
+        auto next = slab->next;
+        if (_collectRemoteFrees(slab)) {
+          unlinkSlab(slabs.full, slab);
+          if (slab->used == 0 && slabs.partial != nullptr)
+            _releaseSlab(slab);
+          else
+            pushSlab(slabs.partial, slab);
+        }
+        slab = next;
+      }
+    }
+    if (slabs.partial == nullptr)
+      _adoptOrphans(heap);
+
+    if (slabs.partial != nullptr) {
+      current = slabs.partial;
+      unlinkSlab(slabs.partial, current);
+    } else {
+      current = _newSlab(sizeClass(size));
+      current->owner.store(heap, std::memory_order_relaxed);
+    }
+    slabs.current = current;
+  }
+
+  auto block = current->freeList;
+  current->freeList = block->next;
+  current->used++;
+  return block;
+}
+
+// Moves a slab that got its first free block back onto the partial list, and
+// returns one that got its last.
+void SlabAllocator::_freedLocal(Slab *slab, bool wasFull) {
+  auto &slabs = _heap->classes[_index(slab->blockSize)];
+  if (slab == slabs.current)
+    return;
+  unlinkSlab(wasFull ? slabs.full : slabs.partial, slab);
+  if (slab->used == 0)
+    _releaseSlab(slab);
+  else
+    pushSlab(slabs.partial, slab);
+}
+
+void SlabAllocator::_freeRemote(Slab *slab, FreeBlock *block) {
+  auto head = slab->remoteFrees.load(std::memory_order_relaxed);
+  do {
+    block->next = head;
+  } while (!slab->remoteFrees.compare_exchange_weak(
+      head, block, std::memory_order_release, std::memory_order_relaxed));
+}
+
+// Only the owner of a slab collects its remote frees. Returns whether the
+// slab has free blocks afterwards.
+bool SlabAllocator::_collectRemoteFrees(Slab *slab) {
+  auto block = slab->remoteFrees.exchange(nullptr, std::memory_order_acquire);
+  while (block != nullptr) {
+    auto next = block->next;
+    block->next = slab->freeList;
+    slab->freeList = block;
+    slab->used--;
+    block = next;
+  }
+  return slab->freeList != nullptr;
+}
+
+SlabAllocator::Slab *SlabAllocator::_newSlab(size_t blockSize) {
+  auto slab = new (::operator new(slabSize, std::align_val_t(slabSize))) Slab();
+  slab->blockSize = blockSize;
+  auto memory = reinterpret_cast<char *>(slab);
+  for (auto offset = _headerSize; offset + blockSize <= slabSize;
+       offset += blockSize) {
+    auto block = reinterpret_cast<FreeBlock *>(memory + offset);
+    block->next = slab->freeList;
+    slab->freeList = block;
+  }
+  _slabsReserved.fetch_add(1, std::memory_order_relaxed);
+  return slab;
+}
+
+void SlabAllocator::_releaseSlab(Slab *slab) {
+  slab->~Slab();
+  ::operator delete(slab, std::align_val_t(slabSize));
+  _slabsReserved.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void SlabAllocator::_adoptOrphans(Heap *heap) {
+  if (_orphans.load(std::memory_order_relaxed) == nullptr)
+    return;
+  auto slab = _orphans.exchange(nullptr, std::memory_order_acquire);
+  while (slab != nullptr) {
+    auto next = slab->next;
+    slab->owner.store(heap, std::memory_order_relaxed);
+    auto &slabs = heap->classes[_index(slab->blockSize)];
+    _collectRemoteFrees(slab);
+    if (slab->used == 0 && slabs.partial != nullptr)
+      _releaseSlab(slab);
+    else
+      pushSlab(slab->freeList != nullptr ? slabs.partial : slabs.full,
+               slab);
+    slab = next;
+  }
+}
+
+// Blocks of an orphaned slab still in use are freed remotely from then on.
+void SlabAllocator::_orphan(Slab *slab) {
+  _collectRemoteFrees(slab);
+  if (slab->used == 0) {
+    _releaseSlab(slab);
+    return;
+  }
+  slab->owner.store(nullptr, std::memory_order_relaxed);
+  auto head = _orphans.load(std::memory_order_relaxed);
+  do {
+    slab->next = head;
+  } while (!_orphans.compare_exchange_weak(
+      head, slab, std::memory_order_release, std::memory_order_relaxed));
+}
+
+SlabAllocator::Heap *SlabAllocator::_createHeap() {
+  _heap = new Heap();
+  if (!reaped) {
+    thread_local Reaper reaper;
+    (void)reaper;
+  }
+  return _heap;
+}
+
+void SlabAllocator::_destroyHeap() {
+  reaped = true;
+  auto heap = _heap;
+  if (heap == nullptr)
+    return;
+  _heap = nullptr;
+  for (auto &slabs : heap->classes) {
+    if (slabs.current != nullptr)
+      _orphan(slabs.current);
+    for (auto list : {slabs.partial, slabs.full}) {
+      for (auto slab = list; slab != nullptr;) {
+        auto next = slab->next;
+        _orphan(slab);
+        slab = next;
+      }
+    }
+  }
+  delete heap;
+}
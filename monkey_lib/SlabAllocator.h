@@ -0,0 +1,153 @@
+#ifndef MONKEY_SLABALLOCATOR_H
+#define MONKEY_SLABALLOCATOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+struct AllocationStats {
+  int64_t live = 0;
+  int64_t peak = 0;
+  int64_t total = 0;
+};
+
+// Allocation counters for objects of type T, kept per thread so counting
+// never synchronizes. An object freed on another thread than the one that
+// allocated it is counted as live on the first and as freed on the second.
+template <typename T> class AllocationCounter {
+public:
+  static const AllocationStats &stats() { return _stats; }
+  static void allocated() {
+    _stats.total++;
+    if (++_stats.live > _stats.peak)
+      _stats.peak = _stats.live;
+  }
+  static void freed() { _stats.live--; }
+
+private:
+  static inline thread_local AllocationStats _stats;
+};
+
+template <typename T> const AllocationStats &allocationStats() {
+  return AllocationCounter<T>::stats();
+}
+
+// Hands out small blocks in 16-byte size classes carved from 64 KiB slabs.
+// Every slab belongs to one thread, which allocates from it and takes back
+// its blocks without locking. A block freed on another thread is pushed onto
+// an atomic list of its slab and collected by the owner once the slab runs
+// dry. Slabs whose blocks have all come back are returned to the system, and
+// those of a thread that exits are adopted by the next thread short of
+// memory.
+class SlabAllocator {
+public:
+  static constexpr size_t granularity = alignof(std::max_align_t);
+  static constexpr size_t maxBlockSize = 256;
+  static constexpr size_t slabSize = 64 * 1024;
+
+  static size_t sizeClass(size_t size) {
+    return (size + granularity - 1) / granularity * granularity;
+  }
+
+  // `size` must be between 1 and maxBlockSize.
+  static void *allocate(size_t size) {
+    if (_heap != nullptr) {
+      auto slab = _heap->classes[_index(size)].current;
+      if (slab != nullptr && slab->freeList != nullptr) {
+        auto block = slab->freeList;
+        slab->freeList = block->next;
+        slab->used++;
+        return block;
+      }
+    }
+    return _allocateSlow(size);
+  }
+
+  // `size` must be the size the block was allocated with.
+  static void deallocate(void *pointer, size_t /*size*/) {
+    auto slab = _slabOf(pointer);
+    auto block = static_cast<FreeBlock *>(pointer);
+    if (_heap == nullptr ||
+        slab->owner.load(std::memory_order_relaxed) != _heap) {
+      _freeRemote(slab, block);
+      return;
+    }
+    auto wasFull = slab->freeList == nullptr;
+    block->next = slab->freeList;
+    slab->freeList = block;
+    if (--slab->used == 0 || wasFull)
+      _freedLocal(slab, wasFull);
+  }
+
+  // Slabs currently taken from the system, by all threads.
+  static size_t slabsReserved() {
+    return _slabsReserved.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct FreeBlock {
+    FreeBlock *next;
+  };
+
+  struct Heap;
+
+  // The header at the start of every slab.
+  struct Slab {
+    // Null while the thread that owned it has exited and no other has
+    // adopted it yet.
+    std::atomic<Heap *> owner;
+    std::atomic<FreeBlock *> remoteFrees;
+    FreeBlock *freeList;
+    size_t blockSize;
+    // Blocks handed out and not yet back on the free list.
+    size_t used;
+    Slab *previous;
+    Slab *next;
+  };
+
+  // The slabs of one size class. Blocks come from `current`; the others
+  // are kept on `partial` while they have free blocks and on `full` while
+  // they have none, possibly with remote frees not collected yet.
+  struct SizeClass {
+    Slab *current = nullptr;
+    Slab *partial = nullptr;
+    Slab *full = nullptr;
+  };
+
+  struct Heap {
+    SizeClass classes[maxBlockSize / granularity];
+  };
+
+  static constexpr size_t _headerSize =
+      (sizeof(Slab) + granularity - 1) / granularity * granularity;
+
+  static size_t _index(size_t size) { return (size - 1) / granularity; }
+
+  static Slab *_slabOf(void *pointer) {
+    return reinterpret_cast<Slab *>(reinterpret_cast<uintptr_t>(pointer) &
+                                    ~(slabSize - 1));
+  }
+
+  static void *_allocateSlow(size_t size);
+  static void _freedLocal(Slab *slab, bool wasFull);
+  static void _freeRemote(Slab *slab, FreeBlock *block);
+  static bool _collectRemoteFrees(Slab *slab);
+  static Slab *_newSlab(size_t blockSize);
+  static void _releaseSlab(Slab *slab);
+  static void _adoptOrphans(Heap *heap);
+  static void _orphan(Slab *slab);
+  static Heap *_createHeap();
+  static void _destroyHeap();
+
+  // Hands the slabs of a thread over when it exits.
+  struct Reaper {
+    ~Reaper() { _destroyHeap(); }
+  };
+
+  static inline thread_local Heap *_heap = nullptr;
+  static inline std::atomic<Slab *> _orphans = nullptr;
+  static inline std::atomic<size_t> _slabsReserved = 0;
+};
+
+#endif // MONKEY_SLABALLOCATOR_H
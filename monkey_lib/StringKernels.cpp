@@ -0,0 +1,271 @@
+#include "StringKernels.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MONKEY_AVX2_KERNELS
+#endif
+
+namespace {
+
+#ifdef MONKEY_AVX2_KERNELS
+// Every processor with AVX2 also counts bits in one instruction.
+#define AVX2 __attribute__((target("avx2,popcnt")))
+#endif
+
+struct Kernels {
+  bool (*isValidUtf8)(const char *text, size_t size);
+  size_t (*countCodePoints)(const char *text, size_t size);
+  size_t (*find)(std::string_view text, std::string_view pattern);
+};
+
+bool isValidUtf8Scalar(const char *text, size_t size) {
+  auto bytes = reinterpret_cast<const unsigned char *>(text);
+  for (size_t i = 0; i < size;) {
+    auto lead = bytes[i];
+    if (lead < 0x80) {
+      i++;
+      continue;
+    }
+    size_t length;
+    uint32_t codePoint, smallest;
+    if ((lead & 0xE0) == 0xC0) {
+      length = 2, codePoint = lead & 0x1F, smallest = 0x80;
+    } else if ((lead & 0xF0) == 0xE0) {
+      length = 3, codePoint = lead & 0x0F, smallest = 0x800;
+    } else if ((lead & 0xF8) == 0xF0) {
+      length = 4, codePoint = lead & 0x07, smallest = 0x10000;
+    } else {
+      return false;
+    }
+    if (size - i < length)
+      return false;
+    for (size_t k = 1; k < length; k++) {
+      if ((bytes[i + k] & 0xC0) != 0x80)
+        return false;
+      codePoint = codePoint << 6 | (bytes[i + k] & 0x3F);
+    }
+    if (codePoint < smallest || codePoint > 0x10FFFF ||
+        (codePoint >= 0xD800 && codePoint <= 0xDFFF))
+      return false;
+    i += length;
+  }
+  return true;
+}
+
+// Counts the bytes that are not continuation bytes, 10xxxxxx.
+size_t countCodePointsScalar(const char *text, size_t size) {
+  size_t count = 0;
+  for (size_t i = 0; i < size; i++)
+    count += (static_cast<unsigned char>(text[i]) & 0xC0) != 0x80;
+  return count;
+}
+
+// The standard library looks for the first byte with memchr.
+size_t findScalar(std::string_view text, std::string_view pattern) {
+  return text.find(pattern);
+}
+
+constexpr Kernels scalarKernels = {isValidUtf8Scalar, countCodePointsScalar,
+                                   findScalar};
+
+#ifdef MONKEY_AVX2_KERNELS
+
+// The validator of Keiser and Lemire, "Validating UTF-8 in less than one
+// instruction per byte". Each byte is classified by its high nibble and the
+// nibbles of the byte before it; three table lookups and an AND leave a bit
+// set for every error two adjacent bytes can show. The third and fourth
+// bytes of long sequences are checked against the lead two and three bytes
+// back.
+constexpr uint8_t TOO_SHORT = 1 << 0;
+constexpr uint8_t TOO_LONG = 1 << 1;
+constexpr uint8_t OVERLONG_3 = 1 << 2;
+constexpr uint8_t TOO_LARGE = 1 << 3;
+constexpr uint8_t SURROGATE = 1 << 4;
+constexpr uint8_t OVERLONG_2 = 1 << 5;
+constexpr uint8_t TOO_LARGE_1000 = 1 << 6;
+constexpr uint8_t OVERLONG_4 = 1 << 6;
+constexpr uint8_t TWO_CONTS = 1 << 7;
+constexpr uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+// The high nibble of the first byte of a pair.
+constexpr uint8_t firstHigh[16] = {
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TOO_LONG, TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3 | SURROGATE,
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4};
+
+// The low nibble of the first byte.
+constexpr uint8_t firstLow[16] = {
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    CARRY | OVERLONG_2,
+    CARRY,
+    CARRY,
+    CARRY | TOO_LARGE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000};
+
+// The high nibble of the second byte.
+constexpr uint8_t secondHigh[16] = {
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_SHORT, TOO_SHORT,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 |
+        OVERLONG_4,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT};
+
+AVX2 __m256i lookup(const uint8_t (&table)[16], __m256i nibbles) {
+  auto half = _mm_loadu_si128(reinterpret_cast<const __m128i *>(table));
+  return _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(half), nibbles);
+}
+
+AVX2 __m256i highNibbles(__m256i bytes) {
+  return _mm256_and_si256(_mm256_srli_epi16(bytes, 4), _mm256_set1_epi8(0x0F));
+}
+
+// The bytes of `input` moved up by N, with the last N bytes of `previous`
+// taking the place of the first ones.
+template <int N> AVX2 __m256i previousBytes(__m256i input, __m256i previous) {
+  return _mm256_alignr_epi8(
+      input, _mm256_permute2x128_si256(previous, input, 0x21), 16 - N);
+}
+
+AVX2 __m256i utf8Errors(__m256i input, __m256i previous) {
+  auto previous1 = previousBytes<1>(input, previous);
+  auto special = _mm256_and_si256(
+      _mm256_and_si256(
+          lookup(firstHigh, highNibbles(previous1)),
+          lookup(firstLow, _mm256_and_si256(previous1, _mm256_set1_epi8(0x0F)))),
+      lookup(secondHigh, highNibbles(input)));
+  // The high bit is set where a lead two or three bytes back asks for a
+  // continuation byte.
+  auto third = _mm256_subs_epu8(previousBytes<2>(input, previous),
+                                _mm256_set1_epi8(0xE0 - 0x80));
+  auto fourth = _mm256_subs_epu8(previousBytes<3>(input, previous),
+                                 _mm256_set1_epi8(0xF0 - 0x80));
+  auto continuations =
+      _mm256_and_si256(_mm256_or_si256(third, fourth),
+                       _mm256_set1_epi8(static_cast<char>(0x80)));
+  return _mm256_xor_si256(continuations, special);
+}
+
+// Adds the errors of a block to `errors`. A block of ASCII following another
+// has none.
+AVX2 void checkUtf8Block(__m256i input, __m256i &previous, __m256i &errors) {
+  if (_mm256_movemask_epi8(_mm256_or_si256(input, previous)) != 0)
+    errors = _mm256_or_si256(errors, utf8Errors(input, previous));
+  previous = input;
+}
+
+AVX2 bool isValidUtf8Avx2(const char *text, size_t size) {
+  auto errors = _mm256_setzero_si256();
+  auto previous = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32)
+    checkUtf8Block(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + i)),
+        previous, errors);
+  // The rest is padded with NULs, and a block of them follows to catch a
+  // sequence cut short by the end of the text.
+  char tail[32] = {};
+  if (i < size)
+    std::memcpy(tail, text + i, size - i);
+  checkUtf8Block(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(tail)),
+                 previous, errors);
+  checkUtf8Block(_mm256_setzero_si256(), previous, errors);
+  return _mm256_testz_si256(errors, errors);
+}
+
+AVX2 size_t countCodePointsAvx2(const char *text, size_t size) {
+  // Continuation bytes are the signed bytes below -64.
+  auto continuation = _mm256_set1_epi8(-65);
+  size_t count = 0, i = 0;
+  for (; i + 32 <= size; i += 32) {
+    auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + i));
+    count += __builtin_popcount(
+        _mm256_movemask_epi8(_mm256_cmpgt_epi8(bytes, continuation)));
+  }
+  return count + countCodePointsScalar(text + i, size - i);
+}
+
+// Compares the first and the last byte of the pattern with 32 positions at
+// once, and only the positions where both match with the rest of it (Muła,
+// "SIMD-friendly algorithms for substring searching").
+AVX2 size_t findAvx2(std::string_view text, std::string_view pattern) {
+  auto length = pattern.size();
+  if (length == 0 || length > text.size())
+    return text.find(pattern);
+  auto first = _mm256_set1_epi8(pattern.front());
+  auto last = _mm256_set1_epi8(pattern.back());
+  size_t i = 0;
+  for (; i + length - 1 + 32 <= text.size(); i += 32) {
+    auto firsts = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(text.data() + i));
+    auto lasts = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(text.data() + i + length - 1));
+    uint32_t candidates = _mm256_movemask_epi8(_mm256_and_si256(
+        _mm256_cmpeq_epi8(firsts, first), _mm256_cmpeq_epi8(lasts, last)));
+    for (; candidates != 0; candidates &= candidates - 1) {
+      auto start = i + __builtin_ctz(candidates);
+      if (length <= 2 || std::memcmp(text.data() + start + 1,
+                                     pattern.data() + 1, length - 2) == 0)
+        return start;
+    }
+  }
+  auto found = text.substr(i).find(pattern);
+  return found == std::string_view::npos ? found : i + found;
+}
+
+constexpr Kernels avx2Kernels = {isValidUtf8Avx2, countCodePointsAvx2,
+                                 findAvx2};
+
+bool supportsAvx2() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+const Kernels *kernels = supportsAvx2() ? &avx2Kernels : &scalarKernels;
+
+#else
+
+const Kernels *kernels = &scalarKernels;
+
+#endif // MONKEY_AVX2_KERNELS
+
+} // namespace
+
+bool StringKernels::isValidUtf8(std::string_view text) {
+  return kernels->isValidUtf8(text.data(), text.size());
+}
+
+size_t StringKernels::countCodePoints(std::string_view text) {
+  return kernels->countCodePoints(text.data(), text.size());
+}
+
+size_t StringKernels::find(std::string_view text, std::string_view pattern) {
+  return kernels->find(text, pattern);
+}
+
+bool StringKernels::vectorized() { return kernels != &scalarKernels; }
+
+bool StringKernels::useVectorized(bool enabled) {
+#ifdef MONKEY_AVX2_KERNELS
+  kernels = enabled && supportsAvx2() ? &avx2Kernels : &scalarKernels;
+#else
+  (void)enabled;
+#endif
+  return vectorized();
+}
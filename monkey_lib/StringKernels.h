@@ -0,0 +1,28 @@
+#ifndef MONKEY_STRINGKERNELS_H
+#define MONKEY_STRINGKERNELS_H
+
+#include <cstddef>
+#include <string_view>
+
+// Loops over the bytes of strings. Like the integer kernels they use AVX2,
+// 32 bytes at a time, when the processor has it and plain loops otherwise.
+class StringKernels {
+public:
+  // Whether `text` is well-formed UTF-8: no stray continuation bytes,
+  // truncated or overlong sequences, surrogates or code points above
+  // U+10FFFF.
+  static bool isValidUtf8(std::string_view text);
+  // The number of code points in valid UTF-8 `text`.
+  static size_t countCodePoints(std::string_view text);
+  // Where `pattern` first occurs in `text`, in bytes, or npos.
+  static size_t find(std::string_view text, std::string_view pattern);
+
+  // Whether the AVX2 loops are in use.
+  static bool vectorized();
+  // Switches between the AVX2 and the plain loops, so that both can be
+  // tested on one machine. AVX2 is only used where it is supported; returns
+  // whether it is.
+  static bool useVectorized(bool enabled);
+};
+
+#endif // MONKEY_STRINGKERNELS_H
@@ -21,16 +21,19 @@ const TokenType ILLEGAL = "ILLEGAL", EOF_ = "EOF",
                 SLASH = "/", LT = "<", GT = ">", EQ = "==", NOT_EQ = "!=",
 
                 // Delimiters
-    COMMA = ",", SEMICOLON = ";", LPAREN = "(", RPAREN = ")", LBRACE = "{",
-                RBRACE = "}", LBRACKET = "[", RBRACKET = "]",
+    COMMA = ",", SEMICOLON = ";", COLON = ":", DOT = ".", LPAREN = "(",
+                RPAREN = ")", LBRACE = "{", RBRACE = "}", LBRACKET = "[",
+                RBRACKET = "]",
 
                 // Keywords
     FUNCTION = "FUNCTION", LET = "LET", TRUE = "TRUE", FALSE = "FALSE",
-                IF = "IF", ELSE = "ELSE", RETURN = "RETURN";
+                IF = "IF", ELSE = "ELSE", RETURN = "RETURN", WHILE = "WHILE",
+                FOR = "FOR", IN = "IN", RECORD = "RECORD";
 
 const std::map<std::string, TokenType> keywords = {
     {"fn", FUNCTION}, {"let", LET},   {"true", TRUE},     {"false", FALSE},
-    {"if", IF},       {"else", ELSE}, {"return", RETURN},
+    {"if", IF},       {"else", ELSE}, {"return", RETURN}, {"while", WHILE},
+    {"for", FOR},     {"in", IN},     {"record", RECORD},
 };
 
 TokenType lookupIdent(const std::string &ident);
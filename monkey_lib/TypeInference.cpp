@@ -0,0 +1,357 @@
+#include "TypeInference.h"
+
+#include <memory>
+
+std::string TypeInferencePass::name() { return "type-inference"; }
+
+int TypeInferencePass::run(const ProgramPtr &program) {
+  _scopes.clear();
+  _variables.clear();
+  _functionScopes.clear();
+  _resolved.clear();
+  _letVariables.clear();
+  _parameters.clear();
+  _returnTypes.clear();
+  _rewritten = 0;
+
+  _scopes.push_back(std::make_unique<Scope>());
+  auto global = _scopes.back().get();
+  _declare(program, global);
+  _resolve(program, global);
+
+  // Parameters only get their types from call sites when every use of the
+  // function is a direct call through its single binding.
+  std::unordered_map<Node *, bool> callable;
+  for (const auto &variable : _variables) {
+    if (variable->function != nullptr && variable->bindings == 1 &&
+        !variable->escapes)
+      callable[variable->function] = true;
+  }
+  for (auto &[function, parameters] : _parameters) {
+    if (!callable[function]) {
+      for (auto parameter : parameters)
+        parameter->type = TOP;
+    }
+  }
+
+  // Types only ever grow, so this terminates; the bound is a safety net.
+  const int maxSweeps = 32;
+  for (int sweep = 0; sweep < maxSweeps; sweep++) {
+    if (!_propagate(program, nullptr))
+      break;
+  }
+
+  _annotate(program);
+  return _rewritten;
+}
+
+TypeInferencePass::InferredType TypeInferencePass::_join(InferredType a,
+                                                         InferredType b) {
+  if (a == BOTTOM)
+    return b;
+  if (b == BOTTOM || a == b)
+    return a;
+  return TOP;
+}
+
+TypeInferencePass::Variable *TypeInferencePass::_newVariable() {
+  _variables.push_back(std::make_unique<Variable>());
+  return _variables.back().get();
+}
+
+TypeInferencePass::Variable *
+TypeInferencePass::_lookup(Scope *scope, const std::string &name) {
+  for (; scope != nullptr; scope = scope->parent) {
+    auto variable = scope->variables.find(name);
+    if (variable != scope->variables.end())
+      return variable->second;
+  }
+  return nullptr;
+}
+
+// Functions open a scope; blocks and loops do not, so a let or loop variable
+// anywhere in a function body binds in the function's scope.
+void TypeInferencePass::_declare(const NodePtr &node, Scope *scope) {
+  if (node->nodeType() == LET_STATEMENT) {
+    auto let = std::static_pointer_cast<LetStatement>(node);
+    auto &variable = scope->variables[let->name->value];
+    if (variable == nullptr)
+      variable = _newVariable();
+    variable->bindings++;
+    if (let->value != nullptr && let->value->nodeType() == FUNCTION_LITERAL)
+      variable->function = static_cast<FunctionLiteralExpression *>(
+          let->value.get());
+    _letVariables[node.get()] = variable;
+  }
+
+  // Array elements are not tracked, so a loop variable can hold anything.
+  if (node->nodeType() == FOR_EXPRESSION) {
+    auto loop = std::static_pointer_cast<ForExpression>(node);
+    auto &variable = scope->variables[loop->variable->value];
+    if (variable == nullptr)
+      variable = _newVariable();
+    variable->bindings++;
+    variable->type = TOP;
+  }
+
+  if (node->nodeType() == FUNCTION_LITERAL) {
+    auto function = std::static_pointer_cast<FunctionLiteralExpression>(node);
+    _scopes.push_back(std::make_unique<Scope>());
+    auto inner = _scopes.back().get();
+    inner->parent = scope;
+    _functionScopes[node.get()] = inner;
+    auto &parameters = _parameters[node.get()];
+    for (const auto &parameter : function->parameters) {
+      auto variable = _newVariable();
+      variable->bindings = 1;
+      inner->variables[parameter->value] = variable;
+      parameters.push_back(variable);
+    }
+    scope = inner;
+  }
+
+  forEachChild(node, [&](const NodePtr &child) { _declare(child, scope); });
+}
+
+void TypeInferencePass::_resolve(const NodePtr &node, Scope *scope) {
+  switch (node->nodeType()) {
+  case FUNCTION_LITERAL: {
+    auto inner = _functionScopes[node.get()];
+    forEachChild(node, [&](const NodePtr &child) { _resolve(child, inner); });
+    return;
+  }
+  case IDENTIFIER: {
+    auto variable =
+        _lookup(scope, std::static_pointer_cast<Identifier>(node)->value);
+    if (variable != nullptr) {
+      variable->escapes = true;
+      _resolved[node.get()] = variable;
+    }
+    return;
+  }
+  case CALL_EXPRESSION: {
+    auto call = std::static_pointer_cast<CallExpression>(node);
+    if (call->function != nullptr &&
+        call->function->nodeType() == IDENTIFIER) {
+      auto variable = _lookup(
+          scope, std::static_pointer_cast<Identifier>(call->function)->value);
+      if (variable != nullptr)
+        _resolved[call->function.get()] = variable;
+      for (const auto &argument : call->arguments) {
+        if (argument != nullptr)
+          _resolve(argument, scope);
+      }
+      return;
+    }
+    break;
+  }
+  case ASSIGN_EXPRESSION: {
+    // Another binding site; a reassigned function is no longer known.
+    auto target = std::static_pointer_cast<AssignExpression>(node)->target;
+    if (target->nodeType() != IDENTIFIER)
+      break;
+    auto variable =
+        _lookup(scope, std::static_pointer_cast<Identifier>(target)->value);
+    if (variable != nullptr)
+      variable->bindings++;
+    break;
+  }
+  default:
+    break;
+  }
+  forEachChild(node, [&](const NodePtr &child) { _resolve(child, scope); });
+}
+
+// One sweep over the program: joins the current type of every binding site
+// (lets, assignments, call-site arguments, returns) into its variable or
+// function.
+bool TypeInferencePass::_propagate(const NodePtr &node,
+                                   FunctionLiteralExpression *function) {
+  bool changed = false;
+  auto update = [&changed](InferredType &type, InferredType with) {
+    auto joined = _join(type, with);
+    if (joined != type) {
+      type = joined;
+      changed = true;
+    }
+  };
+
+  switch (node->nodeType()) {
+  case LET_STATEMENT: {
+    auto let = std::static_pointer_cast<LetStatement>(node);
+    update(_letVariables[node.get()]->type,
+           let->value != nullptr ? _infer(let->value) : TOP);
+    break;
+  }
+  case ASSIGN_EXPRESSION: {
+    auto assign = std::static_pointer_cast<AssignExpression>(node);
+    auto resolved = _resolved.find(assign->target.get());
+    if (resolved != _resolved.end())
+      update(resolved->second->type,
+             assign->value != nullptr ? _infer(assign->value) : TOP);
+    break;
+  }
+  case RETURN_STATEMENT:
+    if (function != nullptr) {
+      auto returnValue =
+          std::static_pointer_cast<ReturnStatement>(node)->returnValue;
+      update(_returnTypes[function],
+             returnValue != nullptr ? _infer(returnValue) : TOP);
+    }
+    break;
+  case FUNCTION_LITERAL: {
+    auto literal = std::static_pointer_cast<FunctionLiteralExpression>(node);
+    if (literal->body != nullptr)
+      update(_returnTypes[literal.get()], _inferBlock(literal->body));
+    function = literal.get();
+    break;
+  }
+  case CALL_EXPRESSION: {
+    auto call = std::static_pointer_cast<CallExpression>(node);
+    auto resolved = _resolved.find(call->function.get());
+    if (resolved == _resolved.end() || resolved->second->function == nullptr)
+      break;
+    auto &parameters = _parameters[resolved->second->function];
+    bool arityMatches = parameters.size() == call->arguments.size();
+    for (size_t i = 0; i < parameters.size(); i++) {
+      update(parameters[i]->type,
+             arityMatches && call->arguments[i] != nullptr
+                 ? _infer(call->arguments[i])
+                 : TOP);
+    }
+    break;
+  }
+  default:
+    break;
+  }
+
+  forEachChild(node, [&](const NodePtr &child) {
+    if (_propagate(child, function))
+      changed = true;
+  });
+  return changed;
+}
+
+TypeInferencePass::InferredType
+TypeInferencePass::_infer(const ExpressionPtr &expression) {
+  switch (expression->nodeType()) {
+  case INTEGER_LITERAL:
+    return INTEGER;
+  case BOOLEAN_LITERAL:
+    return BOOLEAN;
+  case IDENTIFIER: {
+    auto resolved = _resolved.find(expression.get());
+    return resolved != _resolved.end() ? resolved->second->type : TOP;
+  }
+  case PREFIX_EXPRESSION: {
+    auto prefix = std::static_pointer_cast<PrefixExpression>(expression);
+    if (prefix->right == nullptr)
+      return TOP;
+    auto right = _infer(prefix->right);
+    if (prefix->operator_ == "!")
+      return right == BOTTOM ? BOTTOM : BOOLEAN;
+    if (prefix->operator_ == "-" && (right == BOTTOM || right == INTEGER))
+      return right;
+    return TOP;
+  }
+  case INFIX_EXPRESSION: {
+    auto infix = std::static_pointer_cast<InfixExpression>(expression);
+    if (infix->left == nullptr || infix->right == nullptr)
+      return TOP;
+    auto left = _infer(infix->left);
+    auto right = _infer(infix->right);
+    if (left == BOTTOM || right == BOTTOM)
+      return left == TOP || right == TOP ? TOP : BOTTOM;
+    auto op = lookupInfixOperator(infix->operator_);
+    if (left == INTEGER && right == INTEGER) {
+      switch (op) {
+      case OP_PLUS:
+      case OP_MINUS:
+      case OP_ASTERISK:
+      case OP_SLASH:
+        return INTEGER;
+      case OP_LT:
+      case OP_GT:
+      case OP_EQ:
+      case OP_NOT_EQ:
+        return BOOLEAN;
+      default:
+        return TOP;
+      }
+    }
+    if (left == BOOLEAN && right == BOOLEAN && (op == OP_EQ || op == OP_NOT_EQ))
+      return BOOLEAN;
+    return TOP;
+  }
+  case IF_EXPRESSION: {
+    auto ifExpression = std::static_pointer_cast<IfExpression>(expression);
+    if (ifExpression->consequence == nullptr ||
+        ifExpression->alternative == nullptr)
+      return TOP;
+    return _join(_inferBlock(ifExpression->consequence),
+                 _inferBlock(ifExpression->alternative));
+  }
+  case CALL_EXPRESSION:
+    return _inferCall(static_cast<CallExpression *>(expression.get()));
+  case ASSIGN_EXPRESSION: {
+    auto value = std::static_pointer_cast<AssignExpression>(expression)->value;
+    return value != nullptr ? _infer(value) : TOP;
+  }
+  default:
+    return TOP;
+  }
+}
+
+// Type of the value a block evaluates to when it runs to completion. A block
+// ending in `return` contributes through the function's return type instead.
+TypeInferencePass::InferredType
+TypeInferencePass::_inferBlock(const BlockStatementPtr &block) {
+  if (block->statements.empty() || block->statements.back() == nullptr)
+    return TOP;
+  auto &last = block->statements.back();
+  switch (last->nodeType()) {
+  case EXPRESSION_STATEMENT: {
+    auto expression =
+        std::static_pointer_cast<ExpressionStatement>(last)->expression;
+    return expression != nullptr ? _infer(expression) : TOP;
+  }
+  case RETURN_STATEMENT:
+    return BOTTOM;
+  default:
+    return TOP;
+  }
+}
+
+TypeInferencePass::InferredType
+TypeInferencePass::_inferCall(CallExpression *call) {
+  auto resolved = _resolved.find(call->function.get());
+  if (resolved == _resolved.end())
+    return TOP;
+  auto variable = resolved->second;
+  if (variable->function == nullptr || variable->bindings != 1)
+    return TOP;
+  return _returnTypes[variable->function];
+}
+
+void TypeInferencePass::_annotate(const NodePtr &node) {
+  forEachChild(node, [&](const NodePtr &child) { _annotate(child); });
+
+  auto expression = std::dynamic_pointer_cast<Expression>(node);
+  if (expression == nullptr)
+    return;
+  auto type = TYPE_UNKNOWN;
+  switch (_infer(expression)) {
+  case INTEGER:
+    type = TYPE_INTEGER;
+    break;
+  case BOOLEAN:
+    type = TYPE_BOOLEAN;
+    break;
+  default:
+    break;
+  }
+  if (expression->staticType != type) {
+    expression->staticType = type;
+    _rewritten++;
+  }
+}
@@ -0,0 +1,59 @@
+#ifndef MONKEY_TYPEINFERENCE_H
+#define MONKEY_TYPEINFERENCE_H
+
+#include "AST.h"
+#include "Optimizer.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Proves INTEGER and BOOLEAN types and records them in
+// Expression::staticType so the evaluator can run those subtrees on unboxed
+// int64_t values. Types flow from literals through lets, operators, return
+// values and the parameters of functions that are only ever called by name.
+// The evaluator still checks every boxed leaf it reads, so a wrong guess
+// (e.g. a later REPL line rebinding a name) only costs the fast path.
+class TypeInferencePass : public OptimizationPass {
+public:
+  std::string name() override;
+  int run(const ProgramPtr &program) override;
+
+private:
+  // Lattice: nothing known yet < INTEGER, BOOLEAN < anything.
+  enum InferredType { BOTTOM, INTEGER, BOOLEAN, TOP };
+
+  struct Variable {
+    InferredType type = BOTTOM;
+    int bindings = 0;
+    bool escapes = false;
+    FunctionLiteralExpression *function = nullptr;
+  };
+
+  struct Scope {
+    Scope *parent = nullptr;
+    std::unordered_map<std::string, Variable *> variables;
+  };
+
+  static InferredType _join(InferredType a, InferredType b);
+
+  Variable *_newVariable();
+  Variable *_lookup(Scope *scope, const std::string &name);
+  void _declare(const NodePtr &node, Scope *scope);
+  void _resolve(const NodePtr &node, Scope *scope);
+  bool _propagate(const NodePtr &node, FunctionLiteralExpression *function);
+  InferredType _infer(const ExpressionPtr &expression);
+  InferredType _inferBlock(const BlockStatementPtr &block);
+  InferredType _inferCall(CallExpression *call);
+  void _annotate(const NodePtr &node);
+
+  std::vector<std::unique_ptr<Scope>> _scopes;
+  std::vector<std::unique_ptr<Variable>> _variables;
+  std::unordered_map<Node *, Scope *> _functionScopes;
+  std::unordered_map<Node *, Variable *> _resolved;
+  std::unordered_map<Node *, Variable *> _letVariables;
+  std::unordered_map<Node *, std::vector<Variable *>> _parameters;
+  std::unordered_map<Node *, InferredType> _returnTypes;
+};
+
+#endif // MONKEY_TYPEINFERENCE_H
@@ -0,0 +1,110 @@
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <utility>
+
+WorkStealingPool::WorkStealingPool(size_t workers) {
+  workers = std::max<size_t>(workers, 1);
+  for (size_t i = 0; i < workers; i++)
+    _queues.push_back(std::make_unique<Queue>());
+  for (size_t i = 0; i < workers; i++)
+    _threads.emplace_back([this, i] { _work(i); });
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  {
+    std::lock_guard lock(_sleepMutex);
+    _stopping = true;
+  }
+  _wakeUp.notify_all();
+  for (auto &thread : _threads)
+    thread.join();
+}
+
+WorkStealingPool &WorkStealingPool::shared() {
+  static WorkStealingPool pool(
+      std::max(std::thread::hardware_concurrency(), 2u) - 1);
+  return pool;
+}
+
+void WorkStealingPool::submit(Task task) {
+  auto index = _workerPool == this
+                   ? _workerIndex
+                   : _nextQueue.fetch_add(1, std::memory_order_relaxed) %
+                         _queues.size();
+  // Counted first so that the count never drops below the queued tasks.
+  _pending.fetch_add(1, std::memory_order_release);
+  {
+    std::lock_guard lock(_queues[index]->mutex);
+    _queues[index]->tasks.push_back(std::move(task));
+  }
+  // Taking the lock orders this against a worker that has just found nothing
+  // to do and is about to sleep.
+  { std::lock_guard lock(_sleepMutex); }
+  _wakeUp.notify_one();
+}
+
+bool WorkStealingPool::runPendingTask() {
+  Task task;
+  auto index = _workerPool == this ? _workerIndex : 0;
+  if (!_take(index, task))
+    return false;
+  task();
+  return true;
+}
+
+void WorkStealingPool::_work(size_t index) {
+  _workerPool = this;
+  _workerIndex = index;
+  while (true) {
+    Task task;
+    if (_take(index, task)) {
+      task();
+      continue;
+    }
+    std::unique_lock lock(_sleepMutex);
+    _wakeUp.wait(lock, [this] {
+      return _stopping || _pending.load(std::memory_order_acquire) > 0;
+    });
+    if (_stopping)
+      return;
+  }
+}
+
+// Pops the newest task of queue `index`, or else steals the oldest task of
+// another queue.
+bool WorkStealingPool::_take(size_t index, Task &task) {
+  if (_pending.load(std::memory_order_acquire) == 0)
+    return false;
+  for (size_t i = 0; i < _queues.size(); i++) {
+    auto &queue = *_queues[(index + i) % _queues.size()];
+    std::lock_guard lock(queue.mutex);
+    if (queue.tasks.empty())
+      continue;
+    if (i == 0) {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    } else {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+    _pending.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+  return false;
+}
+
+void TaskGroup::run(WorkStealingPool::Task task) {
+  _running.fetch_add(1, std::memory_order_relaxed);
+  _pool.submit([this, task = std::move(task)] {
+    task();
+    _running.fetch_sub(1, std::memory_order_release);
+  });
+}
+
+void TaskGroup::wait() {
+  while (_running.load(std::memory_order_acquire) > 0) {
+    if (!_pool.runPendingTask())
+      std::this_thread::yield();
+  }
+}
@@ -0,0 +1,82 @@
+#ifndef MONKEY_WORKSTEALINGPOOL_H
+#define MONKEY_WORKSTEALINGPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads, each with its own queue of tasks. Workers
+// run their newest task first and steal the oldest task of another worker
+// when their own queue is empty. Threads waiting on a TaskGroup run queued
+// tasks instead of blocking, so tasks can fork and join recursively.
+class WorkStealingPool {
+public:
+  typedef std::function<void()> Task;
+
+  explicit WorkStealingPool(size_t workers);
+  ~WorkStealingPool();
+  WorkStealingPool(const WorkStealingPool &) = delete;
+  WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+  // A pool with one worker per hardware thread besides the caller's.
+  static WorkStealingPool &shared();
+
+  size_t size() const { return _queues.size(); }
+  // Tasks submitted but not started yet.
+  size_t pendingTasks() const {
+    return _pending.load(std::memory_order_relaxed);
+  }
+
+  // Queues `task` on the calling worker, or on the next worker in turn when
+  // called from another thread.
+  void submit(Task task);
+  // Runs one queued task on the calling thread, preferring its own queue.
+  // Returns false if there was none.
+  bool runPendingTask();
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void _work(size_t index);
+  bool _take(size_t index, Task &task);
+
+  std::vector<std::unique_ptr<Queue>> _queues;
+  std::vector<std::thread> _threads;
+  std::atomic<size_t> _pending = 0;
+  std::atomic<size_t> _nextQueue = 0;
+  bool _stopping = false;
+  std::mutex _sleepMutex;
+  std::condition_variable _wakeUp;
+
+  static inline thread_local WorkStealingPool *_workerPool = nullptr;
+  static inline thread_local size_t _workerIndex = 0;
+};
+
+// Tasks that are waited for together.
+class TaskGroup {
+public:
+  explicit TaskGroup(WorkStealingPool &pool) : _pool(pool) {}
+  ~TaskGroup() { wait(); }
+  TaskGroup(const TaskGroup &) = delete;
+  TaskGroup &operator=(const TaskGroup &) = delete;
+
+  void run(WorkStealingPool::Task task);
+  // Returns once every task of the group has finished, running queued tasks
+  // meanwhile.
+  void wait();
+
+private:
+  WorkStealingPool &_pool;
+  std::atomic<size_t> _running = 0;
+};
+
+#endif // MONKEY_WORKSTEALINGPOOL_H
@@ -0,0 +1,136 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "Allocator.h"
+#include "Environment.h"
+#include "Evaluator.h"
+#include "Lexer.h"
+#include "Object.h"
+#include "Parser.h"
+
+#include <memory>
+#include <string>
+
+namespace {
+
+// Counts the blocks that pass through it on their way to the default heap.
+class CountingAllocator : public Allocator {
+public:
+  void *allocate(size_t size) override {
+    live++;
+    return Allocator::defaultAllocator().allocate(size);
+  }
+  void deallocate(void *pointer, size_t size) override {
+    live--;
+    Allocator::defaultAllocator().deallocate(pointer, size);
+  }
+
+  int live = 0;
+};
+
+ObjectPtr evaluateWith(const std::string &input, Allocator *allocator) {
+  Lexer lexer(input);
+  auto program = Parser(&lexer).parseProgram();
+  auto environment = std::make_shared<Environment>();
+  auto evaluator = Evaluator(environment, RUNTIME_SINGLE_THREADED, allocator);
+  auto result = evaluator.evaluate(program);
+  // Closures bound globally keep the environment alive until it is cleared.
+  environment->reset(nullptr);
+  return result;
+}
+
+} // namespace
+
+TEST_CASE("Allocator: the default allocator is current outside any scope") {
+  REQUIRE(Allocator::current() == &Allocator::defaultAllocator());
+  CountingAllocator counting;
+  {
+    AllocatorScope scope(&counting);
+    REQUIRE(Allocator::current() == &counting);
+    {
+      AllocatorScope inherited(nullptr);
+      REQUIRE(Allocator::current() == &counting);
+    }
+  }
+  REQUIRE(Allocator::current() == &Allocator::defaultAllocator());
+}
+
+TEST_CASE("Allocator: blocks return to the allocator they came from") {
+  CountingAllocator counting;
+  ObjectPtr integer;
+  {
+    AllocatorScope scope(&counting);
+    integer = makeRef<IntegerObject>(7);
+    auto string = makeRef<StringObject>(std::string(100, 'x'));
+    REQUIRE(counting.live == 3);
+  }
+  REQUIRE(counting.live == 1);
+  integer = nullptr;
+  REQUIRE(counting.live == 0);
+
+  // Blocks of the default allocator carry no header, and are returned to it
+  // whichever allocator is current.
+  auto plain = makeRef<IntegerObject>(7);
+  REQUIRE(reinterpret_cast<uintptr_t>(plain.get()) %
+              alignof(std::max_align_t) ==
+          0);
+  {
+    AllocatorScope scope(&counting);
+    plain = nullptr;
+  }
+  REQUIRE(counting.live == 0);
+}
+
+TEST_CASE("Allocator: evaluation allocates from the evaluator's heap") {
+  CountingAllocator counting;
+  {
+    auto result = evaluateWith(
+        "let names = [\"ada\", \"grace\", \"barbara\"]; "
+        "let greet = fn(name) { \"hello \" + name + \"!\" }; "
+        "[greet(names[0]), greet(names[1]), greet(names[2])]",
+        &counting);
+    auto array = dynamicRefCast<ArrayObject>(result);
+    REQUIRE(array != nullptr);
+    REQUIRE(array->size() == 3);
+    REQUIRE(array->inspect() == "[hello ada!, hello grace!, hello barbara!]");
+    REQUIRE(counting.live > 0);
+  }
+  REQUIRE(counting.live == 0);
+}
+
+TEST_CASE("Allocator: a region frees a whole run at once") {
+  RegionAllocator region(4096);
+  auto functions = allocationStats<FunctionObject>();
+  auto environments = allocationStats<Environment>();
+  {
+    // Closures capturing the frames they are bound in, globally and in a
+    // call, must not survive the run.
+    auto result = evaluateWith(
+        "let sum = fn(n) { if (n == 0) { return 0; } n + sum(n - 1) }; "
+        "let counter = fn() { let next = fn(n) { if (n == 0) { 0 } else "
+        "{ next(n - 1) } }; next }; counter()(10); sum(100);",
+        &region);
+    REQUIRE(dynamicRefCast<IntegerObject>(result)->value == 5050);
+  }
+  REQUIRE(allocationStats<FunctionObject>().live == functions.live);
+  REQUIRE(allocationStats<Environment>().live == environments.live);
+  REQUIRE(region.bytesAllocated() > 0);
+  REQUIRE(region.bytesReserved() >= region.bytesAllocated());
+
+  // Blocks larger than a quarter chunk get a chunk of their own.
+  auto reserved = region.bytesReserved();
+  {
+    AllocatorScope scope(&region);
+    auto large = makeRef<StringObject>(std::string(10000, 'x'));
+    REQUIRE(large->value().size() == 10000);
+  }
+  REQUIRE(region.bytesReserved() >= reserved + 10000);
+
+  region.release();
+  REQUIRE(region.bytesAllocated() == 0);
+  REQUIRE(region.bytesReserved() == 0);
+
+  // A released region can be used again.
+  REQUIRE(dynamicRefCast<IntegerObject>(evaluateWith("1 + 2", &region))
+              ->value == 3);
+  REQUIRE(region.bytesAllocated() > 0);
+}
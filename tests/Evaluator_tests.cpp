@@ -1,15 +1,19 @@
 #include <catch2/catch_test_macros.hpp>
+#include <limits>
 #include <memory>
+#include <string_view>
 #include <utility>
 
+#include "EffectAnalysis.h"
 #include "Evaluator.h"
 #include "Lexer.h"
 #include "Object.h"
 #include "Parser.h"
+#include "ScopeAnalysis.h"
 #include <any>
 #include <iostream>
 
-std::shared_ptr<Object> testEval(std::string input) {
+ObjectPtr testEval(std::string input) {
   auto lexer = new Lexer(std::move(input));
   auto parser = new Parser(lexer);
   auto program = parser->parseProgram();
@@ -18,21 +22,21 @@ std::shared_ptr<Object> testEval(std::string input) {
   return evaluator.evaluate(program);
 }
 
-bool testNullObject(const std::shared_ptr<Object> &obj) {
-  auto result = std::dynamic_pointer_cast<NullObject>(obj);
+bool testNullObject(const ObjectPtr &obj) {
+  auto result = dynamicRefCast<NullObject>(obj);
   REQUIRE(result != nullptr);
   return true;
 }
 
-bool testIntegerObject(const std::shared_ptr<Object> &obj, int expected) {
-  auto result = std::dynamic_pointer_cast<IntegerObject>(obj);
+bool testIntegerObject(const ObjectPtr &obj, int64_t expected) {
+  auto result = dynamicRefCast<IntegerObject>(obj);
   REQUIRE(result != nullptr);
   REQUIRE(result->value == expected);
   return true;
 }
 
-bool testBooleanObject(const std::shared_ptr<Object> &obj, bool expected) {
-  auto result = std::dynamic_pointer_cast<BooleanObject>(obj);
+bool testBooleanObject(const ObjectPtr &obj, bool expected) {
+  auto result = dynamicRefCast<BooleanObject>(obj);
   REQUIRE(result != nullptr);
   REQUIRE(result->value == expected);
   return true;
@@ -142,6 +146,94 @@ TEST_CASE("Evaluator: return statements") {
   }
 }
 
+TEST_CASE("Evaluator: returns unwind to the enclosing call") {
+  typedef struct {
+    std::string input;
+    int expected;
+  } ReturnTest;
+
+  ReturnTest tests[] = {
+      {"let f = fn(x) { if (x > 1) { return x; } 0 }; f(5) + f(1);", 5},
+      {"let f = fn() { let x = if (true) { return 5; }; 10 }; f();", 5},
+      {"let f = fn() { 1 + if (true) { return 2; } }; f() * 3;", 6},
+      {"let f = fn() { return 1; }; let g = fn() { f(); 7 }; g();", 7},
+  };
+
+  for (const auto &test : tests) {
+    auto evaluated = testEval(test.input);
+    REQUIRE(testIntegerObject(evaluated, test.expected));
+  }
+
+  // A top-level return or error does not leak into the next program.
+  auto environment = std::make_shared<Environment>();
+  auto evaluator = Evaluator(environment);
+  auto first = new Parser(new Lexer("return 1; 2;"));
+  REQUIRE(testIntegerObject(evaluator.evaluate(first->parseProgram()), 1));
+  auto second = new Parser(new Lexer("foo; 3;"));
+  REQUIRE(evaluator.evaluate(second->parseProgram())->type() == ERROR_OBJ);
+  auto third = new Parser(new Lexer("4; 5;"));
+  REQUIRE(testIntegerObject(evaluator.evaluate(third->parseProgram()), 5));
+}
+
+TEST_CASE("Evaluator: error messages are formatted lazily") {
+  ErrorObject error("wrong number of arguments, got=%d, want=%d", {3, 1});
+  REQUIRE(error.message() == "wrong number of arguments, got=3, want=1");
+  REQUIRE(error.message() == "wrong number of arguments, got=3, want=1");
+  REQUIRE(error.inspect() == "ERROR: wrong number of arguments, got=3, want=1");
+  REQUIRE(newError("unknown operator: %s%s", "-", std::string("BOOLEAN"))
+              ->message() == "unknown operator: -BOOLEAN");
+
+  // Objects are held, not inspected, until the message is read.
+  ObjectPtr array = makeRef<ArrayObject>(
+      ObjectPtrVec{makeRef<IntegerObject>(1), makeRef<IntegerObject>(2)});
+  auto held = newError("unknown operator: -%s", array);
+  REQUIRE(array->refCount() == 2);
+  REQUIRE(held->message() == "unknown operator: -[1, 2]");
+  REQUIRE(array->refCount() == 1);
+}
+
+TEST_CASE("Evaluator: objects are reference counted") {
+  auto evaluated = testEval("let a = [1, 2]; let b = a; [a, b];");
+  auto array = dynamicRefCast<ArrayObject>(evaluated);
+  REQUIRE(array != nullptr);
+  // The environment is gone; only the result and its elements remain.
+  REQUIRE(array->refCount() == 2);
+  REQUIRE(array->elements()[0] == array->elements()[1]);
+  REQUIRE(array->elements()[0]->refCount() == 2);
+
+  ObjectPtr copy = array;
+  REQUIRE(array->refCount() == 3);
+  copy = nullptr;
+  REQUIRE(array->refCount() == 2);
+}
+
+TEST_CASE("Evaluator: runtime modes") {
+  auto input = "let a = [1 < 2, first([])]; "
+               "[a, !first([]), first([]) == if (false) { 1 }, "
+               "first([true]) == true, a[0] != false]";
+  auto evaluate = [&input](RuntimeMode mode) {
+    auto program = (new Parser(new Lexer(input)))->parseProgram();
+    auto evaluator = Evaluator(std::make_shared<Environment>(), mode);
+    return dynamicRefCast<ArrayObject>(evaluator.evaluate(program));
+  };
+
+  auto single = evaluate(RUNTIME_SINGLE_THREADED);
+  REQUIRE(single->isThreadConfined());
+  // Each isolate has its own singletons.
+  auto first = dynamicRefCast<ArrayObject>(single->elements()[0]);
+  REQUIRE(first->elements()[0] != TRUE_);
+  REQUIRE(first->elements()[1] == NULL_);
+  for (size_t i = 1; i < single->size(); i++)
+    REQUIRE(testBooleanObject(single->elements()[i], true));
+
+  auto multi = evaluate(RUNTIME_MULTI_THREADED);
+  REQUIRE_FALSE(multi->isThreadConfined());
+  first = dynamicRefCast<ArrayObject>(multi->elements()[0]);
+  REQUIRE(first->elements()[0] == TRUE_);
+  for (size_t i = 1; i < multi->size(); i++)
+    REQUIRE(testBooleanObject(multi->elements()[i], true));
+}
+
 TEST_CASE("Evaluator: errors") {
   typedef struct {
     std::string input;
@@ -158,14 +250,33 @@ TEST_CASE("Evaluator: errors") {
       {"if (10 > 1) { if (10 > 1) { return true + false; } return 1; }",
        "unknown operator: BOOLEAN + BOOLEAN"},
       {"foobar", "identifier not found: foobar"},
-      {R"("hello" - "world")", "unknown operator: STRING - STRING"}};
+      {R"("hello" - "world")", "unknown operator: STRING - STRING"},
+      {"for (x in 5) { x }", "cannot iterate over INTEGER"},
+      {"let i = 0; while (i < 3) { let i = i + true; }",
+       "type mismatch: INTEGER + BOOLEAN"},
+      {"x = 1", "identifier not found: x"},
+      {"let a = [1]; a[1] = 2", "index out of range: 1"},
+      {"let a = [1]; a[-1] = 2", "index out of range: -1"},
+      {"let s = \"ab\"; s[0] = 1", "index assignment not supported: STRING[INTEGER]"},
+      {"let a = [1]; a[true] = 1", "index assignment not supported: ARRAY[BOOLEAN]"},
+      // Every path dividing integers reports a zero divisor the same way.
+      {"1 / 0", "division by zero"},
+      {"let x = 0; 10 / x", "division by zero"},
+      {"let f = fn(a, b) { a / b }; f(4, 2); f(1, 0)", "division by zero"},
+      {"let f = fn(a) { a / (a - a) }; f(3)", "division by zero"},
+      {"[1, true] / 0", "division by zero"},
+      {"[4] / [0]", "division by zero"}};
 
   for (const auto &test : tests) {
     auto evaluated = testEval(test.input);
-    auto result = std::dynamic_pointer_cast<ErrorObject>(evaluated);
+    auto result = dynamicRefCast<ErrorObject>(evaluated);
     REQUIRE(result != nullptr);
-    REQUIRE(result->message == test.expectedMessage);
+    REQUIRE(result->message() == test.expectedMessage);
   }
+
+  // The one quotient that does not fit wraps around, as in the array kernels.
+  REQUIRE(testIntegerObject(testEval("(-9223372036854775807 - 1) / -1"),
+                            std::numeric_limits<int64_t>::min()));
 }
 
 TEST_CASE("Evaluator: let statements") {
@@ -189,11 +300,27 @@ TEST_CASE("Evaluator: let statements") {
 TEST_CASE("Evaluator: function object") {
   auto input = "fn(x) { x + 2; };";
   auto evaluated = testEval(input);
-  auto result = std::dynamic_pointer_cast<FunctionObject>(evaluated);
+  auto result = dynamicRefCast<FunctionObject>(evaluated);
   REQUIRE(result != nullptr);
-  REQUIRE(result->parameters.size() == 1);
-  REQUIRE(result->parameters[0]->string() == "x");
-  REQUIRE(result->body->string() == "(x + 2)");
+  REQUIRE(result->prototype->parameters.size() == 1);
+  REQUIRE(result->prototype->parameters[0]->string() == "x");
+  REQUIRE(result->prototype->body->string() == "(x + 2)");
+  REQUIRE(result->prototype->arity == 1);
+}
+
+TEST_CASE("Evaluator: closures share their prototype") {
+  auto input = "let make = fn(a) { let b = a * 2; fn(x, y) { x + y + b } }; "
+               "[make(1), make(2)];";
+  auto evaluated = testEval(input);
+  auto array = dynamicRefCast<ArrayObject>(evaluated);
+  REQUIRE(array != nullptr);
+  auto first = dynamicRefCast<FunctionObject>(array->at(0));
+  auto second = dynamicRefCast<FunctionObject>(array->at(1));
+  REQUIRE(first->prototype == second->prototype);
+  REQUIRE(first->environment != second->environment);
+  REQUIRE(first->prototype->frameSize == 2);
+  REQUIRE(testIntegerObject(first->environment->get("b"), 2));
+  REQUIRE(testIntegerObject(second->environment->get("b"), 4));
 }
 
 TEST_CASE("Evaluator: function application") {
@@ -218,25 +345,585 @@ TEST_CASE("Evaluator: function application") {
 
 TEST_CASE("Evaluator: closures") {
   auto input = "let newAdder = fn(x) { fn(y) { x + y }; }; let addTwo = "
-               "newAdder(2); addTwo(x);";
+               "newAdder(2); addTwo(2);";
   auto evaluated = testEval(input);
   REQUIRE(testIntegerObject(evaluated, 4));
 }
 
+TEST_CASE("Evaluator: recursive functions") {
+  auto input = "let fib = fn(n) { if (n < 2) { return n; } "
+               "fib(n - 1) + fib(n - 2); }; fib(15);";
+  auto evaluated = testEval(input);
+  REQUIRE(testIntegerObject(evaluated, 610));
+}
+
+TEST_CASE("Evaluator: loops") {
+  typedef struct {
+    std::string input;
+    int64_t expected;
+  } LoopTest;
+
+  LoopTest tests[] = {
+      {"let i = 0; let s = 0; while (i < 10) { let s = s + i; let i = i + 1; }; "
+       "s",
+       45},
+      {"let s = 0; for (x in [1, 2, 3, 4]) { let s = s + x; }; s", 10},
+      {"let s = 0; for (x in []) { let s = 1; }; s", 0},
+      {"for (x in [1, 2, 3]) { x }; x", 3},
+      {"let find = fn(xs, y) { let i = 0; for (x in xs) { if (x == y) { "
+       "return i; } let i = i + 1; }; -1 }; find([5, 6, 7], 7) + find([], 1)",
+       1},
+      {"let f = fn(n) { let i = 0; while (true) { if (i == n) { return i; } "
+       "let i = i + 1; } }; f(5)",
+       5},
+      {"let s = 0; for (row in [[1, 2], [3]]) { for (x in row) { "
+       "let s = s * 10 + x; } }; s",
+       123},
+      // The body shares the enclosing scope, so closures created in it see
+      // the latest binding.
+      {"let fs = []; for (x in [1, 2, 3]) { let fs = push(fs, fn() { x }); }; "
+       "fs[0]() + fs[1]()",
+       6},
+      {"let count = fn(n) { let i = 0; while (i < n) { let i = i + 1; }; i }; "
+       "count(100000)",
+       100000},
+  };
+
+  for (const auto &test : tests)
+    REQUIRE(testIntegerObject(testEval(test.input), test.expected));
+  REQUIRE(testNullObject(testEval("while (false) { 1 }")));
+  REQUIRE(testNullObject(testEval("for (x in [1]) { x }")));
+}
+
+TEST_CASE("Evaluator: assignments") {
+  typedef struct {
+    std::string input;
+    int64_t expected;
+  } AssignmentTest;
+
+  AssignmentTest tests[] = {
+      {"let x = 1; x = x + 1; x", 2},
+      {"let x = 1; let y = 2; x = y = 5; x + y", 10},
+      {"let x = 1; (x = 4) * x", 16},
+      {"let a = [1, 2, 3]; a[1] = 5; a[0] + a[1] + a[2]", 9},
+      {"let a = [0, 0]; let b = a; b[1] = 7; a[1]", 7},
+      // Assignment rebinds the nearest existing binding.
+      {"let n = 0; let inc = fn() { n = n + 1; }; inc(); inc(); n", 2},
+      {"let f = fn() { let n = 1; n = 5; n }; let n = 0; f() + n", 5},
+      {"let counter = fn() { let c = 0; fn() { c = c + 1; c } }; "
+       "let next = counter(); next(); next(); next()",
+       3},
+      {"let make = fn(x) { let get = fn() { x }; x = x * 10; get() }; make(4)",
+       40},
+      {"let a = []; let i = 0; while (i < 100) { push(a, i); i = i + 1; }; "
+       "len(a) + a[99]",
+       199},
+      {"let a = [1, 2, 3]; let i = 0; for (x in a) { a[i] = x * x; "
+       "i = i + 1; }; a[0] + a[1] + a[2]",
+       14},
+  };
+
+  for (const auto &test : tests)
+    REQUIRE(testIntegerObject(testEval(test.input), test.expected));
+}
+
+TEST_CASE("Evaluator: push appends in place") {
+  auto result = testEval("let a = [1]; let b = push(a, 2); b[0] = 5; a");
+  auto array = dynamicRefCast<ArrayObject>(result);
+  REQUIRE(array != nullptr);
+  REQUIRE(array->inspect() == "[5, 2]");
+}
+
+TEST_CASE("Evaluator: quickened infix expressions") {
+  auto lexer = new Lexer("let add = fn(a, b) { a + b }; add(1, 2); add(3, 4);");
+  auto parser = new Parser(lexer);
+  auto program = parser->parseProgram();
+  auto environment = std::make_shared<Environment>();
+  auto evaluator = Evaluator(environment);
+  REQUIRE(testIntegerObject(evaluator.evaluate(program), 7));
+
+  auto let = std::dynamic_pointer_cast<LetStatement>(program->statements[0]);
+  auto fn = std::dynamic_pointer_cast<FunctionLiteralExpression>(let->value);
+  auto statement = std::dynamic_pointer_cast<ExpressionStatement>(
+      fn->body->statements[0]);
+  auto infix = std::dynamic_pointer_cast<InfixExpression>(statement->expression);
+  REQUIRE(infix->specialization == SPECIALIZED_INTEGER);
+  REQUIRE(infix->opcode == OP_PLUS);
+
+  auto call = std::dynamic_pointer_cast<ExpressionStatement>(
+      program->statements[1]);
+  REQUIRE(std::dynamic_pointer_cast<CallExpression>(call->expression)
+              ->specialization == SPECIALIZED_FUNCTION);
+
+  lexer = new Lexer(R"(add("a", "b"))");
+  parser = new Parser(lexer);
+  auto result = dynamicRefCast<StringObject>(
+      evaluator.evaluate(parser->parseProgram()));
+  REQUIRE(result != nullptr);
+  REQUIRE(result->value() == "ab");
+  REQUIRE(infix->specialization == GENERIC);
+}
+
+TEST_CASE("Evaluator: quickened builtins can be shadowed") {
+  auto input = "let f = fn() { len(\"abc\") }; let a = f(); "
+               "let len = fn(x) { 10 }; a + f();";
+  auto evaluated = testEval(input);
+  REQUIRE(testIntegerObject(evaluated, 13));
+}
+
+FunctionLiteralExpressionPtr functionAt(const ProgramPtr &program,
+                                        size_t index) {
+  auto statement = program->statements[index];
+  if (statement->nodeType() == LET_STATEMENT)
+    return std::dynamic_pointer_cast<FunctionLiteralExpression>(
+        std::dynamic_pointer_cast<LetStatement>(statement)->value);
+  return std::dynamic_pointer_cast<FunctionLiteralExpression>(
+      std::dynamic_pointer_cast<ExpressionStatement>(statement)->expression);
+}
+
+TEST_CASE("Evaluator: escape analysis") {
+  auto lexer = new Lexer("fn(x) { let y = x * 2; if (y > 1) { y } }; "
+                         "fn(x) { if (x) { fn(y) { x + y } } }; "
+                         "fn(x) { let loop = fn(n) { loop(n) }; loop };");
+  auto parser = new Parser(lexer);
+  auto program = parser->parseProgram();
+
+  // Unanalyzed, any nested closure is assumed to keep the frame.
+  REQUIRE(ScopeAnalysis::environmentEscapes(functionAt(program, 1).get()));
+
+  functionAt(program, 1)->escapeState = ESCAPE_UNANALYZED;
+  ScopeAnalysis::analyze(program);
+  REQUIRE_FALSE(functionAt(program, 0)->escapeState == ESCAPE_ESCAPES);
+  REQUIRE_FALSE(functionAt(program, 1)->escapeState == ESCAPE_ESCAPES);
+  REQUIRE(functionAt(program, 2)->escapeState == ESCAPE_ESCAPES);
+}
+
+TEST_CASE("Evaluator: closure capture modes") {
+  auto lexer = new Lexer(
+      "let g = 1; "
+      "let outer = fn(a, b) { let c = a + b; "
+      "fn(x) { x + g + len([]) }; "
+      "fn(x) { a + c + x }; "
+      "fn() { fn() { b } }; "
+      "let loop = fn(n) { loop(n) }; "
+      "let d = 1; let d = 2; fn() { d }; };");
+  auto parser = new Parser(lexer);
+  auto program = parser->parseProgram();
+  ScopeAnalysis::analyze(program);
+
+  auto body = functionAt(program, 1)->body;
+  auto literal = [&body](size_t index) {
+    auto statement = body->statements[index];
+    if (statement->nodeType() == LET_STATEMENT)
+      return std::dynamic_pointer_cast<FunctionLiteralExpression>(
+          std::dynamic_pointer_cast<LetStatement>(statement)->value);
+    return std::dynamic_pointer_cast<FunctionLiteralExpression>(
+        std::dynamic_pointer_cast<ExpressionStatement>(statement)
+            ->expression);
+  };
+
+  REQUIRE(functionAt(program, 1)->captureMode == CAPTURE_NONE);
+  REQUIRE(literal(1)->captureMode == CAPTURE_NONE);
+  REQUIRE(literal(2)->captureMode == CAPTURE_FLAT);
+  REQUIRE(literal(2)->captures == std::vector<std::string>{"a", "c"});
+  REQUIRE(literal(3)->captureMode == CAPTURE_FLAT);
+  REQUIRE(literal(3)->captures == std::vector<std::string>{"b"});
+  REQUIRE(literal(4)->captureMode == CAPTURE_CHAIN);
+  REQUIRE(literal(7)->captureMode == CAPTURE_CHAIN);
+}
+
+TEST_CASE("Evaluator: bindings in loops are not captured flat") {
+  auto lexer = new Lexer("fn(xs) { let a = 1; "
+                         "for (x in xs) { let b = x; fn() { a + b + x } } }");
+  auto parser = new Parser(lexer);
+  auto program = parser->parseProgram();
+  ScopeAnalysis::analyze(program);
+
+  auto outer = functionAt(program, 0);
+  REQUIRE(outer->frameSize == 4);
+  auto loop = std::dynamic_pointer_cast<ForExpression>(
+      std::dynamic_pointer_cast<ExpressionStatement>(
+          outer->body->statements[1])
+          ->expression);
+  auto inner = std::dynamic_pointer_cast<FunctionLiteralExpression>(
+      std::dynamic_pointer_cast<ExpressionStatement>(
+          loop->body->statements[1])
+          ->expression);
+  REQUIRE(inner->captureMode == CAPTURE_CHAIN);
+}
+
+TEST_CASE("Evaluator: assigned variables are not captured flat") {
+  auto lexer = new Lexer("fn(a, b) { fn() { a + b }; b = 2; }");
+  auto parser = new Parser(lexer);
+  auto program = parser->parseProgram();
+  ScopeAnalysis::analyze(program);
+
+  auto inner = std::dynamic_pointer_cast<FunctionLiteralExpression>(
+      std::dynamic_pointer_cast<ExpressionStatement>(
+          functionAt(program, 0)->body->statements[0])
+          ->expression);
+  REQUIRE(inner->captureMode == CAPTURE_CHAIN);
+}
+
+TEST_CASE("Evaluator: flat closures") {
+  typedef struct {
+    std::string input;
+    int64_t expected;
+  } ClosureTest;
+
+  ClosureTest tests[] = {
+      {"let compose = fn(f, g) { fn(x) { g(f(x)) } }; "
+       "let inc = fn(x) { x + 1 }; let dbl = fn(x) { x * 2 }; "
+       "compose(inc, dbl)(5);",
+       12},
+      {"let make = fn(a) { let big = [1, 2, 3]; fn() { fn() { a } } }; "
+       "make(7)()();",
+       7},
+      {"let f = fn() { let x = 1; let g = fn() { x }; let x = 2; g() }; f();",
+       2},
+      {"let count = fn(n) { let go = fn(i) { if (i == 0) { return 0; } "
+       "1 + go(i - 1) }; go(n) }; count(20);",
+       20},
+      {"let g = 1; let f = fn() { fn() { g } }; let h = f(); let g = 5; h();",
+       5},
+      {"let f = fn(c) { if (c) { let x = 1; } fn() { x } }; let x = 9; "
+       "f(false)();",
+       9},
+  };
+
+  for (const auto &test : tests) {
+    auto evaluated = testEval(test.input);
+    REQUIRE(testIntegerObject(evaluated, test.expected));
+  }
+}
+
+TEST_CASE("Evaluator: calls in reused frames") {
+  typedef struct {
+    std::string input;
+    int64_t expected;
+  } FrameTest;
+
+  FrameTest tests[] = {
+      {"let sum = fn(n) { if (n == 0) { return 0; } n + sum(n - 1) }; "
+       "sum(100);",
+       5050},
+      {"let sq = fn(x) { x * x }; let f = fn(a, b) { let c = sq(a); "
+       "c + sq(b) }; f(3, 4) + f(1, 1);",
+       27},
+      {"let adder = fn(x) { fn(y) { x + y } }; let sq = fn(x) { x * x }; "
+       "let addThree = adder(3); sq(2); addThree(sq(3));",
+       12},
+      {"let many = fn(a, b, c, d, e, f, g, h, i, j) { "
+       "let k = a + j; k * i }; many(1, 2, 3, 4, 5, 6, 7, 8, 9, 10);",
+       99},
+  };
+
+  for (const auto &test : tests) {
+    auto evaluated = testEval(test.input);
+    REQUIRE(testIntegerObject(evaluated, test.expected));
+  }
+}
+
 TEST_CASE("Evaluator: string literal") {
   auto input = R"("hello world")";
   auto evaluated = testEval(input);
-  auto result = std::dynamic_pointer_cast<StringObject>(evaluated);
+  auto result = dynamicRefCast<StringObject>(evaluated);
   REQUIRE(result != nullptr);
-  REQUIRE(result->value == "hello world");
+  REQUIRE(result->value() == "hello world");
 }
 
 TEST_CASE("Evaluator: string concatenation") {
   auto input = R"("hello" + " " + "world")";
   auto evaluated = testEval(input);
-  auto result = std::dynamic_pointer_cast<StringObject>(evaluated);
+  auto result = dynamicRefCast<StringObject>(evaluated);
   REQUIRE(result != nullptr);
-  REQUIRE(result->value == "hello world");
+  REQUIRE(result->value() == "hello world");
+}
+
+TEST_CASE("Evaluator: strings built by repeated appends") {
+  auto input = "let s = \"\"; let i = 0; "
+               "while (i < 20000) { s = s + \"ab\"; i = i + 1; }; "
+               "let h = {}; h[s + \"!\"] = len(s); "
+               "[len(s), h[s + \"!\"], len(s + s)]";
+  REQUIRE(testEval(input)->inspect() == "[40000, 40000, 80000]");
+
+  auto evaluated = testEval("let s = \"\"; "
+                            "for (c in [\"a\", \"b\", \"c\"]) { "
+                            "let i = 0; while (i < 30) { s = s + c; "
+                            "i = i + 1; }; }; s");
+  auto result = dynamicRefCast<StringObject>(evaluated);
+  REQUIRE(result != nullptr);
+  REQUIRE(std::string_view(result->value()) ==
+          std::string(30, 'a') + std::string(30, 'b') + std::string(30, 'c'));
+}
+
+TEST_CASE("Evaluator: ropes") {
+  auto check = [](bool confined) {
+    ThreadConfinedScope scope(confined);
+    auto piece = makeRef<StringObject>(std::string(50, 'x'));
+    auto rope = StringObject::concat(piece, piece);
+    std::string expected(100, 'x');
+    for (int i = 0; i < 100000; i++) {
+      auto digit = makeRef<StringObject>(std::string(1, '0' + i % 10));
+      rope = StringObject::concat(rope, digit);
+      expected += char('0' + i % 10);
+    }
+    rope = StringObject::concat(makeRef<StringObject>(std::string("<")), rope);
+    expected = "<" + expected;
+
+    REQUIRE(rope->length() == expected.size());
+    REQUIRE(rope->inspect() == expected);
+    REQUIRE(std::string_view(rope->value()) == expected);
+    REQUIRE(rope->hash() == makeRef<StringObject>(expected)->hash());
+    // A second read sees the same buffer.
+    REQUIRE(rope->value().data() == rope->value().data());
+    REQUIRE(std::string_view(piece->value()) == std::string(50, 'x'));
+  };
+  check(true);
+  check(false);
+
+  // Short results are plain strings.
+  auto a = makeRef<StringObject>(std::string("a"));
+  REQUIRE(StringObject::concat(a, a)->value() == "aa");
+}
+
+TEST_CASE("Evaluator: string equality") {
+  typedef struct {
+    std::string input;
+    bool expected;
+  } EqualityTest;
+
+  EqualityTest tests[] = {
+      {"\"a\" == \"a\"", true},
+      {"\"a\" == \"b\"", false},
+      {"\"a\" != \"b\"", true},
+      {"\"\" == \"\"", true},
+      {"\"ab\" == \"a\" + \"b\"", true},
+      {"\"ab\" != \"a\" + \"b\"", false},
+      {"\"ab\" == \"abc\"", false},
+      {"let a = \"x\"; let b = \"y\"; a + b == \"xy\"", true},
+      {"\"1\" == 1", false},
+      {"\"true\" != true", true},
+      // Long strings built in different orders.
+      {"let s = \"\"; let t = \"\"; let i = 0; "
+       "while (i < 100) { s = s + \"ab\"; t = t + \"a\" + \"b\"; "
+       "i = i + 1; }; s == t",
+       true},
+      {"let s = \"\"; let i = 0; while (i < 100) { s = s + \"ab\"; "
+       "i = i + 1; }; s == s + \"\"",
+       true},
+      {"let s = \"\"; let t = \"\"; let i = 0; "
+       "while (i < 100) { s = s + \"ab\"; t = t + \"ba\"; i = i + 1; }; "
+       "s == t",
+       false},
+      {"contains([\"x\", \"y\"], \"x\" + \"\")", true},
+      {"first(pairwiseEqual([\"a\", \"b\"], [\"a\", \"c\"]))", true},
+      {"last(pairwiseEqual([\"a\", \"b\"], [\"a\", \"c\"]))", false},
+  };
+
+  for (const auto &test : tests)
+    REQUIRE(testBooleanObject(testEval(test.input), test.expected));
+
+  // A quickened comparison keeps working when its operands change type.
+  REQUIRE(testEval("let eq = fn(a, b) { a == b }; "
+                   "[eq(\"a\", \"a\"), eq(\"a\" + \"b\", \"ab\"), "
+                   "eq(1, 1), eq(\"a\", 1), eq(\"b\", \"a\")]")
+              ->inspect() == "[true, true, true, false, false]");
+}
+
+TEST_CASE("Evaluator: interned strings") {
+  auto evaluated = testEval("let f = fn() { \"abc\" }; "
+                            "[f(), f(), \"ab\" + \"c\", \"abc\" + \"abc\", "
+                            "\"abcdefghijklmnopqrstuvwxyz\" + \"0123456789\"]");
+  auto strings = dynamicRefCast<ArrayObject>(evaluated);
+  REQUIRE(strings != nullptr);
+  auto string = [&](size_t i) {
+    return dynamicRefCast<StringObject>(strings->at(i));
+  };
+  // Literals and short results share one object.
+  REQUIRE(string(0) == string(1));
+  REQUIRE(string(0) == string(2));
+  REQUIRE(string(0)->isInterned());
+  REQUIRE(string(3)->isInterned());
+  REQUIRE_FALSE(string(4)->isInterned());
+
+  StringTable table, other;
+  auto a = table.intern("a");
+  REQUIRE(table.intern("a") == a);
+  REQUIRE(table.size() == 1);
+  // Equal strings of two tables are different objects with the same
+  // characters.
+  auto b = other.intern("a");
+  REQUIRE(a != b);
+  REQUIRE(a->equals(*b));
+  REQUIRE(a->equals(*makeRef<StringObject>(std::string("a"))));
+  REQUIRE_FALSE(a->equals(*table.intern("b")));
+
+  for (size_t i = table.size(); i < StringTable::capacity; i++)
+    table.intern(std::to_string(i));
+  REQUIRE(table.size() == StringTable::capacity);
+  REQUIRE(table.intern("a") == a);
+  auto late = table.intern("late");
+  REQUIRE_FALSE(late->isInterned());
+  REQUIRE(late->equals(*table.intern("late")));
+  REQUIRE(table.size() == StringTable::capacity);
+}
+
+TEST_CASE("Evaluator: substrings") {
+  typedef struct {
+    std::string input;
+    std::string expected;
+  } SubstringTest;
+
+  SubstringTest tests[] = {
+      {"substr(\"hello world\", 6)", "world"},
+      {"substr(\"hello world\", 0, 5)", "hello"},
+      {"substr(\"hello\", 3, 1)", ""},
+      {"substr(\"hello\", -2, 99)", "hello"},
+      {"substr(\"ab\" + \"cd\", 1, 3)", "bc"},
+      {"split(\"a,b,,c\", \",\")", "[a, b, , c]"},
+      {"split(\"a, b\", \", \")", "[a, b]"},
+      {"split(\"abc\", \";\")", "[abc]"},
+      {"split(\"\", \",\")", "[]"},
+      {"lines(\"one\ntwo\r\nthree\n\")", "[one, two, three]"},
+      {"lines(\"one\n\ntwo\")", "[one, , two]"},
+      {"lines(\"\")", "[]"},
+      {"len(split(\"x y z\", \" \"))", "3"},
+      {"substr(1, 2)", "argument to `substr` must be STRING, got INTEGER"},
+      {"substr(\"a\", \"b\")", "bounds of `substr` must be INTEGER, got STRING"},
+      {"split(\"a\", \"\")", "separator of `split` must not be empty"},
+      {"lines([])", "argument to `lines` must be STRING, got ARRAY"},
+  };
+
+  for (const auto &test : tests) {
+    auto evaluated = testEval(test.input);
+    auto error = dynamicRefCast<ErrorObject>(evaluated);
+    REQUIRE((error != nullptr ? error->message() : evaluated->inspect()) ==
+            test.expected);
+  }
+
+  auto text = makeRef<StringObject>(std::string(1000, 'x'));
+  // Most of the string, or pieces of a short one, share its buffer.
+  auto view = StringObject::substring(text, 100, 800, true);
+  REQUIRE(view->isView());
+  REQUIRE(view->value().data() == text->value().data() + 100);
+  REQUIRE(view->value() == std::string(800, 'x'));
+  auto nested = StringObject::substring(view, 10, 20, true);
+  REQUIRE(nested->value().data() == text->value().data() + 110);
+  REQUIRE(nested->equals(*makeRef<StringObject>(std::string(20, 'x'))));
+  REQUIRE_FALSE(StringObject::substring(text, 0, 10, true)->isView());
+  REQUIRE(StringObject::worthSharing(500, 1000));
+  REQUIRE(StringObject::worthSharing(20, 200));
+  REQUIRE_FALSE(StringObject::worthSharing(100, 1000));
+
+  // A view keeps its string alive.
+  view = StringObject::substring(makeRef<StringObject>(std::string(64, 'y')),
+                                 1, 62, true);
+  REQUIRE(view->value() == std::string(62, 'y'));
+
+  auto fields = dynamicRefCast<ArrayObject>(
+      testEval("let s = \"\"; let i = 0; while (i < 100) { "
+               "s = s + \"0123456789abcdefghij;\"; i = i + 1; }; "
+               "[split(s, \";\"), substr(s, 0, 20), substr(s, 5, 400)]"));
+  REQUIRE(fields != nullptr);
+  auto pieces = dynamicRefCast<ArrayObject>(fields->at(0));
+  REQUIRE(pieces->size() == 101);
+  auto piece = dynamicRefCast<StringObject>(pieces->at(1));
+  REQUIRE(piece->isView());
+  REQUIRE(piece->value() == "0123456789abcdefghij");
+  REQUIRE(dynamicRefCast<StringObject>(fields->at(1))->isView() == false);
+  REQUIRE(dynamicRefCast<StringObject>(fields->at(2))->isView() == false);
+}
+
+TEST_CASE("Evaluator: UTF-8 strings") {
+  typedef struct {
+    std::string input;
+    std::string expected;
+  } Utf8Test;
+
+  Utf8Test tests[] = {
+      {"len(\"h\xc3\xa9llo\")", "5"},
+      {"len(\"\xe6\x97\xa5\xe6\x9c\xac\" + \"\xe8\xaa\x9e\")", "3"},
+      {"\"\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e\"[1]", "\xe6\x9c\xac"},
+      {"\"abc\"[2]", "c"},
+      {"\"abc\"[3]", "null"},
+      {"\"abc\"[-1]", "null"},
+      {"substr(\"na\xc3\xafve caf\xc3\xa9\", 2, 8)", "\xc3\xafve ca"},
+      {"split(\"\xce\xb1,\xce\xb2\", \",\")", "[\xce\xb1, \xce\xb2]"},
+      {"let s = \"\"; let i = 0; while (i < 100) { "
+       "s = s + \"\xc3\xa9\" + \"ab\"; i = i + 1; }; "
+       "[len(s), s[0], s[298], s[299], s[300]]",
+       "[300, \xc3\xa9, a, b, null]"},
+  };
+
+  for (const auto &test : tests)
+    REQUIRE(testEval(test.input)->inspect() == test.expected);
+
+  // Indexing a long string goes through its index of code points, whether
+  // it is shared between threads or not.
+  for (auto confined : {true, false}) {
+    ThreadConfinedScope scope(confined);
+    std::string text;
+    std::vector<size_t> starts;
+    for (int i = 0; i < 1000; i++) {
+      starts.push_back(text.size());
+      text += i % 5 == 0 ? "\xf0\x9f\x98\x80" : i % 5 == 1 ? "\xc3\xa9" : "x";
+    }
+    auto string = makeRef<StringObject>(text);
+    REQUIRE(string->codePoints() == 1000);
+    bool matched = true;
+    for (size_t i = 1000; i-- > 0;)
+      matched &= string->byteOffset(i) == starts[i];
+    REQUIRE(matched);
+    REQUIRE(string->byteOffset(1000) == text.size());
+  }
+}
+
+TEST_CASE("Evaluator: string search") {
+  typedef struct {
+    std::string input;
+    std::string expected;
+  } SearchTest;
+
+  SearchTest tests[] = {
+      {"contains(\"hello world\", \"o w\")", "true"},
+      {"contains(\"hello\", \"world\")", "false"},
+      {"contains(\"hello\", \"\")", "true"},
+      {"indexOf(\"hello world\", \"o\")", "4"},
+      {"indexOf(\"hello\", \"x\")", "-1"},
+      {"indexOf(\"\xc3\xa9t\xc3\xa9 \xc3\xa0 Paris\", \"Paris\")", "6"},
+      {"startsWith(\"hello\", \"he\")", "true"},
+      {"startsWith(\"hello\", \"lo\")", "false"},
+      {"startsWith(\"he\", \"hello\")", "false"},
+      {"count(\"banana\", \"an\")", "2"},
+      {"count(\"aaaa\", \"aa\")", "2"},
+      {"count(\"abc\", \"d\")", "0"},
+      {"replace(\"banana\", \"an\", \"AN\")", "bANANa"},
+      {"replace(\"aaa\", \"a\", \"\")", ""},
+      {"replace(\"abc\", \"x\", \"y\")", "abc"},
+      {"replace(\"a-b-c\", \"-\", \" - \")", "a - b - c"},
+      {"contains(\"a\", 1)", "argument to `contains` must be STRING, got INTEGER"},
+      {"indexOf([], \"a\")", "argument to `indexOf` must be STRING, got ARRAY"},
+      {"count(\"a\", \"\")", "substring of `count` must not be empty"},
+      {"replace(\"a\", \"\", \"b\")", "substring of `replace` must not be empty"},
+      {"replace(\"a\", \"b\")", "wrong number of arguments, got=2, want=3"},
+  };
+
+  for (const auto &test : tests) {
+    auto evaluated = testEval(test.input);
+    auto error = dynamicRefCast<ErrorObject>(evaluated);
+    REQUIRE((error != nullptr ? error->message() : evaluated->inspect()) ==
+            test.expected);
+  }
+
+  // Long texts, built as ropes.
+  REQUIRE(testEval("let s = \"\"; let i = 0; while (i < 1000) { "
+                   "s = s + \"lorem ipsum \"; i = i + 1; }; "
+                   "s = s + \"needle\"; "
+                   "[indexOf(s, \"needle\"), count(s, \"ipsum\"), "
+                   "len(replace(s, \"lorem\", \"\")), "
+                   "contains(s, \"ipsum needle\")]")
+              ->inspect() == "[12000, 1000, 7006, true]");
 }
 
 TEST_CASE("Evaluator: builtin functions") {
@@ -259,22 +946,499 @@ TEST_CASE("Evaluator: builtin functions") {
     if(test.expected >= 0) {
       REQUIRE(testIntegerObject(evaluated, test.expected));
     } else {
-      auto result = std::dynamic_pointer_cast<ErrorObject>(evaluated);
+      auto result = dynamicRefCast<ErrorObject>(evaluated);
       REQUIRE(result != nullptr);
-      REQUIRE(result->message == test.expectedMessage);
+      REQUIRE(result->message() == test.expectedMessage);
     }
   }
 }
 
+TEST_CASE("Evaluator: array builtins share structure") {
+  typedef struct {
+    std::string input;
+    std::string expected;
+  } ArrayBuiltinTest;
+
+  ArrayBuiltinTest tests[] = {
+      {"rest([1, 2, 3])", "[2, 3]"},
+      {"rest(rest(rest([1, 2, 3])))", "[]"},
+      {"rest([])", "null"},
+      {"slice([1, 2, 3, 4], 1, 3)", "[2, 3]"},
+      {"slice([1, 2, 3, 4], 2)", "[3, 4]"},
+      {"slice([1, 2, 3], -5, 10)", "[1, 2, 3]"},
+      {"slice([1, 2, 3], 2, 1)", "[]"},
+      {"concat([1, 2], [3])", "[1, 2, 3]"},
+      {"concat([], [])", "[]"},
+      // Results are independent of their arguments.
+      {"let a = [1, 2, 3]; let b = rest(a); b[0] = 9; push(b, 4); [a, b]",
+       "[[1, 2, 3], [9, 3, 4]]"},
+      {"let a = [1, 2, 3]; let b = slice(a, 0, 1); push(b, 7); a[0] = 0; "
+       "[a, b]",
+       "[[0, 2, 3], [1, 7]]"},
+      {"let a = [1]; let b = concat(a, [2]); a[0] = 5; [a, b]",
+       "[[5], [1, 2]]"},
+      // A loop iterates over the array as it was when the loop started.
+      {"let a = [1, 2]; for (x in a) { push(a, x); }; a", "[1, 2, 1, 2]"},
+      {"slice([1], true)", "ERROR: bounds of `slice` must be INTEGER, got BOOLEAN"},
+      {"concat([1], 2)", "ERROR: argument to `concat` must be ARRAY, got INTEGER"},
+  };
+
+  for (const auto &test : tests)
+    REQUIRE(testEval(test.input)->inspect() == test.expected);
+}
+
+TEST_CASE("Evaluator: list processing with rest") {
+  auto result = testEval(
+      "let map = fn(arr, f) { let iter = fn(arr, acc) { if (len(arr) == 0) { "
+      "acc } else { iter(rest(arr), push(acc, f(first(arr)))) } }; "
+      "iter(arr, []) }; "
+      "let sum = fn(arr) { if (len(arr) == 0) { 0 } else { first(arr) + "
+      "sum(rest(arr)) } }; "
+      "let a = []; let i = 0; while (i < 500) { push(a, i); i = i + 1; }; "
+      "sum(map(a, fn(x) { x * 2 }))");
+  REQUIRE(testIntegerObject(result, 249500));
+}
+
+TEST_CASE("Evaluator: integer arrays are unboxed") {
+  auto array = [](const std::string &input) {
+    return dynamicRefCast<ArrayObject>(testEval(input));
+  };
+
+  REQUIRE(array("[1, 2 + 3, -4]")->isUnboxed());
+  REQUIRE(array("[]")->isUnboxed());
+  REQUIRE(array("push([1], 2)")->isUnboxed());
+  REQUIRE(array("rest([1, 2])")->isUnboxed());
+  REQUIRE(array("concat([1], [2])")->isUnboxed());
+  REQUIRE_FALSE(array("[1, true]")->isUnboxed());
+  REQUIRE_FALSE(array("concat([1], [\"a\"])")->isUnboxed());
+
+  // Storing anything else boxes the array, and other arrays sharing its
+  // elements are left as they were.
+  auto boxed = array("let a = [1, 2, 3]; let b = rest(a); a[1] = \"x\"; "
+                     "push(b, \"y\"); push(b, 4); a");
+  REQUIRE_FALSE(boxed->isUnboxed());
+  REQUIRE(boxed->inspect() == "[1, x, 3]");
+  REQUIRE(testIntegerObject(boxed->at(2), 3));
+  REQUIRE(testEval("let a = [1, 2, 3]; let b = rest(a); a[1] = \"x\"; b")
+              ->inspect() == "[2, 3]");
+
+  // Memoized calls see the same key either way.
+  REQUIRE(testIntegerObject(
+      testEval("let f = memo(fn(a) { len(a) }); let a = [1, true]; a[1] = 2; "
+               "f([1, 2]); f(a); memoStats(f)[0]"),
+      1));
+}
+
+TEST_CASE("Evaluator: integer array builtins") {
+  typedef struct {
+    std::string input;
+    std::string expected;
+  } IntegerBuiltinTest;
+
+  IntegerBuiltinTest tests[] = {
+      {"sum([1, 2, 3, 4, 5])", "15"},
+      {"sum([])", "0"},
+      {"sum([-3, 3])", "0"},
+      {"min([4, -2, 7, 1, 9])", "-2"},
+      {"max([4, -2, 7, 1, 9])", "9"},
+      {"min([])", "null"},
+      {"max([5])", "5"},
+      {"dot([1, 2, 3], [4, 5, 6])", "32"},
+      {"dot([], [])", "0"},
+      {"contains([1, 2, 3], 2)", "true"},
+      {"contains([1, 2, 3], 4)", "false"},
+      {"contains([1, 2, 3], true)", "false"},
+      {"contains([1, true, \"a\"], true)", "true"},
+      {"contains([1, true, \"a\"], 1)", "true"},
+      {"contains([false], 0)", "false"},
+      // Boxed arrays that only hold integers still qualify.
+      {"let a = [true, 2]; a[0] = 1; [sum(a), max(a), dot(a, a)]",
+       "[3, 2, 5]"},
+      {"let a = []; let i = 0; while (i < 1000) { push(a, i); i = i + 1; }; "
+       "[sum(a), min(rest(a)), max(a), dot(a, slice(a, 0)), "
+       "dot(rest(a), slice(a, 0, 999)), contains(a, 999)]",
+       "[499500, 1, 999, 332833500, 332334000, true]"},
+      {"sum(1)", "ERROR: argument to `sum` must be ARRAY, got INTEGER"},
+      {"max([1, \"a\"])", "ERROR: elements of `max` must be INTEGER"},
+      {"dot([1], [1, 2])",
+       "ERROR: arguments to `dot` must have the same length, got 1 and 2"},
+      {"contains(1, 1)",
+       "ERROR: argument to `contains` must be ARRAY or STRING, got INTEGER"},
+  };
+
+  for (const auto &test : tests)
+    REQUIRE(testEval(test.input)->inspect() == test.expected);
+}
+
+TEST_CASE("Evaluator: element-wise array operators") {
+  typedef struct {
+    std::string input;
+    std::string expected;
+  } ElementWiseTest;
+
+  ElementWiseTest tests[] = {
+      {"[1, 2, 3] + [10, 20, 30]", "[11, 22, 33]"},
+      {"[1, 2, 3] - 1", "[0, 1, 2]"},
+      {"10 - [1, 2, 3]", "[9, 8, 7]"},
+      {"[1, 2, 3] * [4, 5, 6] * 2", "[8, 20, 36]"},
+      {"[7, -7, 9] / 2", "[3, -3, 4]"},
+      {"100 / [3, -4]", "[33, -25]"},
+      // Comparisons compare arrays themselves; the pairwise builtins compare
+      // their elements.
+      {"[1, 5, 3] < [2, 2, 3]", "ERROR: unknown operator: ARRAY < ARRAY"},
+      {"[1, 5, 3] > 2", "ERROR: type mismatch: ARRAY > INTEGER"},
+      {"if ([1, 2] < [1, 2]) { \"yes\" }",
+       "ERROR: unknown operator: ARRAY < ARRAY"},
+      {"pairwiseLess([1, 5, 3], [2, 2, 3])", "[true, false, false]"},
+      {"pairwiseGreater([1, 5, 3], [2, 2, 3])", "[false, true, false]"},
+      {"pairwiseLess([], [])", "[]"},
+      {"pairwiseLess([1, true], [2, 2])",
+       "ERROR: elements of `pairwiseLess` must be INTEGER"},
+      {"pairwiseGreater([1], [1, 2])",
+       "ERROR: arguments to `pairwiseGreater` must have the same length, got "
+       "1 and 2"},
+      {"[1, 2, 3] == [1, 2, 3]", "false"},
+      {"let a = [1]; [a == a, a != a, [] == [], a == 1, a != 1]",
+       "[true, false, false, false, true]"},
+      {"if ([1] == [2]) { 1 } else { 2 }", "2"},
+      {"pairwiseEqual([1, 2, 3], [1, 0, 3])", "[true, false, true]"},
+      {"pairwiseEqual([1, \"a\", [1]], [1, \"a\", [1]])",
+       "[true, true, false]"},
+      {"pairwiseEqual([], [])", "[]"},
+      {"pairwiseEqual([1], [1, 2])",
+       "ERROR: arguments to `pairwiseEqual` must have the same length, got 1 "
+       "and 2"},
+      {"pairwiseEqual([1], 1)",
+       "ERROR: argument to `pairwiseEqual` must be ARRAY, got INTEGER"},
+      {"[] + []", "[]"},
+      {"[] * 3", "[]"},
+      {"sum([1, 2, 3] * [1, 2, 3])", "14"},
+      // Other elements are combined one pair at a time.
+      {"[\"a\", \"b\"] + \"!\"", "[a!, b!]"},
+      {"[true, false] < true", "ERROR: type mismatch: ARRAY < BOOLEAN"},
+      {"[[1, 2], [3]] * 2", "[[2, 4], [6]]"},
+      {"let a = [1, true]; a[1] = 2; a + a", "[2, 4]"},
+      {"[1, 2] + [3]", "ERROR: length mismatch: 2 + 1"},
+      {"[1, 2] / [1, 0]", "ERROR: division by zero"},
+      {"[1, 2] / 0", "ERROR: division by zero"},
+      {"[1, true] + 1", "ERROR: type mismatch: BOOLEAN + INTEGER"},
+      {"[1] - \"a\"", "ERROR: type mismatch: INTEGER - STRING"},
+  };
+
+  for (const auto &test : tests)
+    REQUIRE(testEval(test.input)->inspect() == test.expected);
+
+  // Arithmetic on integer arrays gives an unboxed array.
+  auto result = dynamicRefCast<ArrayObject>(testEval("[1, 2] * [3, 4]"));
+  REQUIRE(result->isUnboxed());
+}
+
+TEST_CASE("Evaluator: containers holding themselves") {
+  typedef struct {
+    std::string input;
+    std::string expected;
+  } CycleTest;
+
+  CycleTest tests[] = {
+      {"let a = [1]; push(a, a); a", "[1, [...]]"},
+      {"let a = [1]; push(a, a); a == a", "true"},
+      {"let a = [1]; push(a, a); [a != a, a == [1, a], contains(a, a)]",
+       "[false, false, true]"},
+      {"let h = {}; h[1] = h; h", "{1: {...}}"},
+      {"let r = record {a: 1}; r.a = r; r", "record {a: record {...}}"},
+      {"let a = [1]; let h = {\"a\": a}; push(a, h); a", "[1, {a: [...]}]"},
+      // The same array twice is not a cycle.
+      {"let a = [1]; [a, a]", "[[1], [1]]"},
+      {"let a = [1]; push(a, a); a * 2",
+       "ERROR: cannot apply * to an array that contains itself"},
+      {"let a = [1]; push(a, a); let f = memo(fn(x) { len(x) }); "
+       "[f(a), f(a), memoStats(f)]",
+       "[2, 2, [0, 0, 0]]"},
+  };
+
+  for (const auto &test : tests)
+    REQUIRE(testEval(test.input)->inspect() == test.expected);
+}
+
+TEST_CASE("Evaluator: environments outlive their evaluator") {
+  auto functions = allocationStats<FunctionObject>();
+  auto environment = std::make_shared<Environment>();
+  {
+    auto evaluator = Evaluator(environment);
+    Lexer lexer("let x = 5; let f = fn() { x }; "
+                "let make = fn() { let n = 3; fn() { n } }; let g = make(); "
+                "let loop = fn() { let count = fn(n) { if (n == 0) { 0 } "
+                "else { count(n - 1) } }; count(3) }; loop();");
+    REQUIRE(testIntegerObject(evaluator.evaluate(Parser(&lexer).parseProgram()),
+                              0));
+  }
+  // The bindings of the host's environment, and the frames its closures
+  // captured, are left intact; the frame of `loop`, which only its own
+  // closure referred to, is not kept.
+  REQUIRE(allocationStats<FunctionObject>().live == functions.live + 4);
+  {
+    auto evaluator = Evaluator(environment);
+    Lexer lexer("f() + g() + x");
+    REQUIRE(testIntegerObject(evaluator.evaluate(Parser(&lexer).parseProgram()),
+                              13));
+  }
+  environment->reset(nullptr);
+  REQUIRE(allocationStats<FunctionObject>().live == functions.live);
+}
+
+TEST_CASE("Evaluator: hashes") {
+  typedef struct {
+    std::string input;
+    std::string expected;
+  } HashTest;
+
+  HashTest tests[] = {
+      {"{}", "{}"},
+      {"let two = \"two\"; {\"one\": 10 - 9, two: 1 + 1, 4: 4, true: 5}",
+       "{one: 1, two: 2, 4: 4, true: 5}"},
+      {"{1: \"a\", 1: \"b\"}", "{1: b}"},
+      {"{\"foo\": 5}[\"foo\"]", "5"},
+      {"{\"foo\": 5}[\"bar\"]", "null"},
+      {"let key = \"foo\"; {\"foo\": 5}[key]", "5"},
+      {"{}[\"foo\"]", "null"},
+      {"{5: 5}[5]", "5"},
+      {"{true: 5}[true]", "5"},
+      {"{false: 5}[1 > 2]", "5"},
+      // Keys compare by value and type.
+      {"{1: \"int\", true: \"bool\", \"1\": \"str\"}[1]", "int"},
+      {"{\"a\" + \"b\": 1}[\"ab\"]", "1"},
+      {"len({1: 1, 2: 2})", "2"},
+      {"let h = {\"b\": 1, \"a\": 2}; [keys(h), values(h)]",
+       "[[b, a], [1, 2]]"},
+      {"let h = {}; put(h, \"x\", 1); put(h, \"y\", 2); put(h, \"x\", 3)",
+       "{x: 3, y: 2}"},
+      {"let h = {1: 1, 2: 2, 3: 3}; delete(h, 2); delete(h, 5); put(h, 2, 4)",
+       "{1: 1, 3: 3, 2: 4}"},
+      {"let h = {}; h[\"a\"] = 1; h[\"a\"] = h[\"a\"] + 1; h", "{a: 2}"},
+      // Hashes are shared, like arrays.
+      {"let h = {}; let g = h; put(g, 1, 1); h", "{1: 1}"},
+      {"let h = {}; let i = 0; while (i < 1000) { h[i] = i * i; i = i + 1; }; "
+       "let i = 0; while (i < 1000) { if (i / 2 * 2 == i) { delete(h, i); }; "
+       "i = i + 1; }; [len(h), h[999], h[998], sum(keys(h))]",
+       "[500, 998001, null, 250000]"},
+      {"{[1]: 2}", "ERROR: unusable as hash key: ARRAY"},
+      {"{1: 2}[fn(x) { x }]", "ERROR: unusable as hash key: FUNCTION"},
+      {"let h = {}; h[[]] = 1", "ERROR: unusable as hash key: ARRAY"},
+      {"put({}, {}, 1)", "ERROR: unusable as hash key: HASH"},
+      {"keys([1])", "ERROR: argument to `keys` must be HASH, got ARRAY"},
+      {"delete([1], 0)", "ERROR: argument to `delete` must be HASH, got ARRAY"},
+  };
+
+  for (const auto &test : tests)
+    REQUIRE(testEval(test.input)->inspect() == test.expected);
+
+  // Memoized calls can take hashes.
+  REQUIRE(testIntegerObject(
+      testEval("let f = memo(fn(h) { h[1] }); f({1: 2}); f({1: 2}); "
+               "memoStats(f)[0]"),
+      1));
+}
+
+TEST_CASE("Evaluator: records") {
+  typedef struct {
+    std::string input;
+    std::string expected;
+  } RecordTest;
+
+  RecordTest tests[] = {
+      {"record {}", "record {}"},
+      {"record {name: \"ada\", score: 1 + 2}",
+       "record {name: ada, score: 3}"},
+      {"record {a: 1, b: 2}.b", "2"},
+      {"let r = record {a: record {b: [1, 2]}}; r.a.b[1]", "2"},
+      {"let r = record {a: 1}; r.a = r.a + 1; r.a = r.a * 5; r",
+       "record {a: 10}"},
+      // Records are shared, like arrays and hashes.
+      {"let r = record {a: 1}; let s = r; s.a = 2; r.a", "2"},
+      {"let r = record {a: 1}; r == r", "true"},
+      {"record {a: 1} == record {a: 1}", "false"},
+      // One access site reading records of several shapes.
+      {"let get = fn(r) { r.x }; "
+       "[get(record {x: 1}), get(record {y: 2, x: 3}), get(record {x: 4}), "
+       "get(record {z: 0, y: 0, x: 5})]",
+       "[1, 3, 4, 5]"},
+      {"let total = 0; let people = []; let i = 0; "
+       "while (i < 100) { push(people, record {age: i, id: i * 2}); "
+       "i = i + 1; }; "
+       "for (p in people) { total = total + p.age + p.id; }; total",
+       "14850"},
+      {"record {a: 1}.b", "ERROR: record has no field: b"},
+      {"let r = record {a: 1}; r.b = 2", "ERROR: record has no field: b"},
+      {"[1].a", "ERROR: field access not supported: ARRAY"},
+      {"let h = {}; h.a = 1", "ERROR: field assignment not supported: HASH"},
+      {"record {a: 1, b: c}", "ERROR: identifier not found: c"},
+  };
+
+  for (const auto &test : tests)
+    REQUIRE(testEval(test.input)->inspect() == test.expected);
+
+  // Records with the same fields in the same order share a shape.
+  auto shapes = testEval("[record {a: 1, b: 2}, record {a: \"x\", b: 3}, "
+                         "record {b: 1, a: 2}]");
+  auto records = dynamicRefCast<ArrayObject>(shapes);
+  REQUIRE(records != nullptr);
+  auto shapeOf = [&](size_t i) {
+    return dynamicRefCast<RecordObject>(records->at(i))->shape;
+  };
+  REQUIRE(shapeOf(0) == shapeOf(1));
+  REQUIRE(shapeOf(0) != shapeOf(2));
+
+  REQUIRE(testIntegerObject(
+      testEval("let f = memo(fn(r) { r.a }); f(record {a: 2}); "
+               "f(record {a: 2}); f(record {b: 2, a: 2}); memoStats(f)[0]"),
+      1));
+}
+
+TEST_CASE("Evaluator: memoized functions") {
+  // Without the cache this would make billions of calls.
+  auto fib = "let fib = memo(fn(n) { if (n < 2) { return n; } "
+             "fib(n - 1) + fib(n - 2) }); ";
+  REQUIRE(testIntegerObject(testEval(std::string(fib) + "fib(60)"),
+                            1548008755920));
+
+  auto stats = dynamicRefCast<ArrayObject>(
+      testEval(std::string(fib) + "fib(30); fib(30); memoStats(fib)"));
+  REQUIRE(stats != nullptr);
+  REQUIRE(testIntegerObject(stats->at(0), 29));
+  REQUIRE(testIntegerObject(stats->at(1), 31));
+  REQUIRE(testIntegerObject(stats->at(2), 31));
+
+  struct {
+    std::string input;
+    int64_t hits;
+    int64_t misses;
+    int64_t size;
+  } tests[] = {
+      // Arrays, strings and booleans are keyed by content.
+      {"let f = memo(fn(a) { len(a) }); f([1, [2, \"x\"]]); "
+       "f([1, [2, \"x\"]]); f([1, [2, \"y\"]]); f([true]); f([false]);",
+       1, 4, 4},
+      // The integer 1 and the string "1" are different keys.
+      {"let f = memo(fn(a, b) { a }); f(1, \"1\"); f(\"1\", 1); "
+       "f(1, \"1\");",
+       1, 2, 2},
+      // The least recently used result is evicted first.
+      {"let f = memo(fn(x) { x }, 2); f(1); f(2); f(1); f(3); f(1); f(2);",
+       2, 4, 2},
+      // Calls with function arguments bypass the cache.
+      {"let f = memo(fn(g) { g(1) }); f(fn(x) { x }); f(fn(x) { x });", 0,
+       0, 0},
+  };
+  for (const auto &test : tests) {
+    auto evaluated = testEval(test.input + " memoStats(f)");
+    auto result = dynamicRefCast<ArrayObject>(evaluated);
+    INFO(test.input);
+    REQUIRE(result != nullptr);
+    REQUIRE(testIntegerObject(result->at(0), test.hits));
+    REQUIRE(testIntegerObject(result->at(1), test.misses));
+    REQUIRE(testIntegerObject(result->at(2), test.size));
+  }
+
+  struct {
+    std::string input;
+    std::string expectedMessage;
+  } errors[] = {
+      {"memo(1)", "argument to `memo` must be FUNCTION, got INTEGER"},
+      {"memo(fn(x) { x }, 0)",
+       "capacity of `memo` must be a positive INTEGER, got 0"},
+      {"memoStats(len)", "argument to `memoStats` must be MEMO, got BUILTIN"},
+      {"let f = memo(fn(x) { x + true }); f(1)",
+       "type mismatch: INTEGER + BOOLEAN"},
+  };
+  for (const auto &test : errors) {
+    auto result = dynamicRefCast<ErrorObject>(testEval(test.input));
+    INFO(test.input);
+    REQUIRE(result != nullptr);
+    REQUIRE(result->message() == test.expectedMessage);
+  }
+}
+
+TEST_CASE("Evaluator: effect analysis") {
+  auto lexer = new Lexer(
+      "let square = fn(x) { let y = x * x; y }; "
+      "let sumTo = fn(n) { if (n == 0) { 0 } else { n + sumTo(n - 1) } }; "
+      "let append = fn(a) { push(a, 1) }; "
+      "let indirect = fn(a) { append(a) }; "
+      "let apply = fn(f, x) { f(x) }; "
+      "let shadow = fn(len) { len([]) }; "
+      "[square(2), sumTo(3), len([1])]; "
+      "[square(2), append([])]; "
+      "[if (true) { let z = 1; z }, square(2)]; "
+      "let rebind = fn(x) { x = x + 1; x }; "
+      "let store = fn(a) { a[0] = 1; }; "
+      "let outer = fn() { let n = 0; fn() { n = 1 }() }; "
+      "let global = 0; let setGlobal = fn() { global = 1 }; "
+      "let replaced = fn() { 1 }; replaced = fn() { setGlobal() }; "
+      "let callsReplaced = fn() { replaced() };");
+  auto program = (new Parser(lexer))->parseProgram();
+  EffectAnalysis::analyze(program);
+
+  REQUIRE(functionAt(program, 0)->pureBody);
+  REQUIRE(functionAt(program, 1)->pureBody);
+  REQUIRE_FALSE(functionAt(program, 2)->pureBody);
+  REQUIRE_FALSE(functionAt(program, 3)->pureBody);
+  REQUIRE_FALSE(functionAt(program, 4)->pureBody);
+  REQUIRE_FALSE(functionAt(program, 5)->pureBody);
+
+  auto expressionAt = [&program](size_t index) {
+    return std::dynamic_pointer_cast<ExpressionStatement>(
+               program->statements[index])
+        ->expression;
+  };
+  REQUIRE(expressionAt(6)->pure);
+  REQUIRE_FALSE(expressionAt(7)->pure);
+  // A let in a block binds in the enclosing frame.
+  REQUIRE_FALSE(expressionAt(8)->pure);
+
+  REQUIRE(functionAt(program, 9)->pureBody);
+  REQUIRE_FALSE(functionAt(program, 10)->pureBody);
+  REQUIRE_FALSE(functionAt(program, 11)->pureBody);
+  REQUIRE_FALSE(functionAt(program, 13)->pureBody);
+  REQUIRE_FALSE(functionAt(program, 16)->pureBody);
+}
+
+TEST_CASE("Evaluator: parallel evaluation") {
+  auto evaluate = [](const std::string &input, RuntimeMode mode) {
+    auto program = (new Parser(new Lexer(input)))->parseProgram();
+    auto evaluator = Evaluator(std::make_shared<Environment>(), mode);
+    return evaluator.evaluate(program)->inspect();
+  };
+
+  auto fib = std::string("let fib = fn(n) { if (n < 2) { n } else { "
+                         "fib(n - 1) + fib(n - 2) } }; "
+                         "let pair = fn(a, b) { [a, b] }; ");
+  std::string inputs[] = {
+      "[fib(15), fib(16), pair(fib(10), fib(11)), len([fib(5), fib(6)])]",
+      "let k = 3; pair(fib(k), pair(fib(k + 1), fib(k + 2)))",
+      // Impure elements are evaluated in order on one thread.
+      "let a = [1]; [fib(5), len(push(a, 2)), fib(6)]",
+      // The first error in source order wins.
+      "[fib(3), fib(true), fib(-true), fib(4)]",
+      "pair(fib(2), pair(fib(1), fib(\"x\")))",
+  };
+  for (const auto &input : inputs) {
+    INFO(input);
+    REQUIRE(evaluate(fib + input, RUNTIME_PARALLEL) ==
+            evaluate(fib + input, RUNTIME_SINGLE_THREADED));
+  }
+  REQUIRE(evaluate(fib + inputs[0], RUNTIME_PARALLEL) ==
+          "[610, 987, [55, 89], 2]");
+}
+
 TEST_CASE("Evaluator: array literal"){
   auto input = R"([1, 2 * 2, 3 + 3])";
   auto evaluated = testEval(input);
-  auto result = std::dynamic_pointer_cast<ArrayObject>(evaluated);
+  auto result = dynamicRefCast<ArrayObject>(evaluated);
   REQUIRE(result != nullptr);
-  REQUIRE(result->elements.size() == 3);
-  testIntegerObject(result->elements[0], 1);
-  testIntegerObject(result->elements[1], 4);
-  testIntegerObject(result->elements[2], 6);
+  REQUIRE(result->size() == 3);
+  testIntegerObject(result->at(0), 1);
+  testIntegerObject(result->at(1), 4);
+  testIntegerObject(result->at(2), 6);
 }
 
 TEST_CASE("Evaluator: array index expressions"){\
@@ -293,6 +1457,7 @@ TEST_CASE("Evaluator: array index expressions"){\
     {"let myArray = [1, 2, 3]; let i = myArray[0]; myArray[i]",2,},
     {"[1, 2, 3][3]",-1,},
     {"[1, 2, 3][-1]",-1,},
+    {"[][0]",-1,},
   };
 
   for (auto test : tests) {
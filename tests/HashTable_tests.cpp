@@ -0,0 +1,105 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "HashTable.h"
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+typedef HashTable<int, std::string> Table;
+
+std::vector<std::pair<int, std::string>> toVector(const Table &table) {
+  std::vector<std::pair<int, std::string>> pairs;
+  for (const auto &entry : table)
+    pairs.emplace_back(entry.key, entry.value);
+  return pairs;
+}
+
+// Sends every key to the same group with the same control byte.
+struct Colliding {
+  size_t operator()(int) const { return 42; }
+};
+
+} // namespace
+
+TEST_CASE("HashTable: insert, find and erase") {
+  Table table;
+  REQUIRE(table.empty());
+  REQUIRE(table.find(1) == nullptr);
+  REQUIRE_FALSE(table.erase(1));
+
+  REQUIRE(table.insert_or_assign(1, "one"));
+  REQUIRE(table.insert_or_assign(2, "two"));
+  REQUIRE_FALSE(table.insert_or_assign(1, "uno"));
+  REQUIRE(table.size() == 2);
+  REQUIRE(*table.find(1) == "uno");
+  REQUIRE(table.contains(2));
+
+  REQUIRE(table.erase(1));
+  REQUIRE_FALSE(table.contains(1));
+  REQUIRE(table.size() == 1);
+  REQUIRE(toVector(table) == std::vector<std::pair<int, std::string>>{
+                                 {2, "two"}});
+}
+
+TEST_CASE("HashTable: growth keeps every entry in insertion order") {
+  Table table;
+  std::vector<std::pair<int, std::string>> expected;
+  for (int i = 0; i < 10000; i++) {
+    auto key = i * 7919 - 5000;
+    table.insert_or_assign(key, std::to_string(i));
+    expected.emplace_back(key, std::to_string(i));
+  }
+  REQUIRE(table.size() == 10000);
+  REQUIRE(toVector(table) == expected);
+
+  bool found = true;
+  for (const auto &[key, value] : expected)
+    found = found && table.find(key) != nullptr && *table.find(key) == value;
+  REQUIRE(found);
+  REQUIRE(table.find(1) == nullptr);
+}
+
+TEST_CASE("HashTable: erased entries are skipped and reclaimed") {
+  Table table;
+  for (int round = 0; round < 50; round++) {
+    for (int i = 0; i < 100; i++)
+      table.insert_or_assign(round * 100 + i, "x");
+    for (int i = 0; i < 100; i++) {
+      if (i != 0)
+        table.erase(round * 100 + i);
+    }
+  }
+  REQUIRE(table.size() == 50);
+  std::vector<std::pair<int, std::string>> expected;
+  for (int round = 0; round < 50; round++)
+    expected.emplace_back(round * 100, "x");
+  REQUIRE(toVector(table) == expected);
+
+  // Erasing every key leaves an empty table that can be filled again.
+  for (int round = 0; round < 50; round++)
+    REQUIRE(table.erase(round * 100));
+  REQUIRE(table.empty());
+  REQUIRE(table.begin() == table.end());
+  table.insert_or_assign(7, "seven");
+  REQUIRE(*table.find(7) == "seven");
+}
+
+TEST_CASE("HashTable: colliding keys are told apart") {
+  HashTable<int, int, Colliding> table;
+  for (int i = 0; i < 100; i++)
+    table.insert_or_assign(i, i * 2);
+  for (int i = 0; i < 100; i += 2)
+    table.erase(i);
+
+  bool found = true;
+  for (int i = 0; i < 100; i++) {
+    auto value = table.find(i);
+    found = found && (i % 2 == 0 ? value == nullptr : *value == i * 2);
+  }
+  REQUIRE(found);
+  REQUIRE(table.size() == 50);
+}
@@ -0,0 +1,154 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "IntegerKernels.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace {
+
+typedef IntegerKernels::Integers Integers;
+
+// Runs `check` with the AVX2 loops, where supported, and with the plain ones.
+template <typename F> void withEachKernel(F check) {
+  auto vectorized = IntegerKernels::vectorized();
+  for (auto enabled : {true, false}) {
+    IntegerKernels::useVectorized(enabled);
+    check();
+  }
+  IntegerKernels::useVectorized(vectorized);
+}
+
+Integers integers(const std::vector<int64_t> &values) {
+  return Integers(values.begin(), values.end());
+}
+
+} // namespace
+
+TEST_CASE("IntegerKernels: reductions match plain loops") {
+  std::vector<int64_t> values;
+  for (int64_t i = 0; i < 1000; i++)
+    values.push_back((i * 7919) % 1013 - 500);
+
+  withEachKernel([&values] {
+    // Every length and every start within a leaf, so that runs begin and
+    // end at each offset from a vector boundary.
+    bool matched = true;
+    auto vector = integers(values);
+    for (size_t start = 0; start < 40; start++) {
+      for (size_t end = start + 1; end <= 100; end++) {
+        auto slice = vector.slice(start, end);
+        auto first = values.begin() + start, last = values.begin() + end;
+        int64_t sum = 0, dot = 0;
+        for (auto it = first; it != last; ++it) {
+          sum += *it;
+          dot += *it * values[it - values.begin() - start];
+        }
+        matched = matched && IntegerKernels::sum(slice) == sum &&
+                  IntegerKernels::min(slice) == *std::min_element(first, last) &&
+                  IntegerKernels::max(slice) == *std::max_element(first, last) &&
+                  IntegerKernels::dot(slice, vector.slice(0, end - start)) ==
+                      dot &&
+                  IntegerKernels::contains(slice, *(last - 1)) &&
+                  !IntegerKernels::contains(slice, 1000);
+      }
+    }
+    REQUIRE(matched);
+
+    REQUIRE(IntegerKernels::sum(vector) == 6886);
+    REQUIRE(IntegerKernels::sum(Integers()) == 0);
+    REQUIRE(IntegerKernels::dot(Integers(), Integers()) == 0);
+    REQUIRE_FALSE(IntegerKernels::contains(Integers(), 0));
+  });
+}
+
+TEST_CASE("IntegerKernels: extremes and overflow") {
+  auto smallest = std::numeric_limits<int64_t>::min();
+  auto largest = std::numeric_limits<int64_t>::max();
+
+  withEachKernel([=] {
+    auto extremes = integers({0, largest, -1, smallest, 5, 1, 2, 3});
+    REQUIRE(IntegerKernels::min(extremes) == smallest);
+    REQUIRE(IntegerKernels::max(extremes) == largest);
+    REQUIRE(IntegerKernels::contains(extremes, smallest));
+
+    // Sums and products wrap around.
+    REQUIRE(IntegerKernels::sum(integers({largest, 1, 0, 0, 0})) == smallest);
+    auto big = integers({int64_t(1) << 40, 3, -(int64_t(1) << 33), 7, 11});
+    auto other = integers({int64_t(1) << 30, -5, int64_t(1) << 31, 2, 1});
+    // 2^70 and -2^64 wrap to 0, leaving -15 + 14 + 11.
+    REQUIRE(IntegerKernels::dot(big, other) == 10);
+  });
+}
+
+TEST_CASE("IntegerKernels: element-wise operators match plain loops") {
+  // No zeros, so that every element can be a divisor.
+  std::vector<int64_t> values;
+  for (int64_t i = 0; i < 300; i++)
+    values.push_back((i * 7919) % 1013 - 500 | 1);
+  auto vector = integers(values);
+
+  // Each operator as the evaluator applies it to two integers.
+  auto expected = [](InfixOperator op, int64_t left, int64_t right) {
+    switch (op) {
+    case OP_PLUS:
+      return left + right;
+    case OP_MINUS:
+      return left - right;
+    case OP_ASTERISK:
+      return left * right;
+    case OP_SLASH:
+      return left / right;
+    case OP_LT:
+      return int64_t(left < right);
+    case OP_GT:
+      return int64_t(left > right);
+    case OP_EQ:
+      return int64_t(left == right);
+    default:
+      return int64_t(left != right);
+    }
+  };
+
+  withEachKernel([&] {
+    bool matched = true;
+    for (auto op : {OP_PLUS, OP_MINUS, OP_ASTERISK, OP_SLASH, OP_LT, OP_GT,
+                    OP_EQ, OP_NOT_EQ}) {
+      // Windows starting at different places in their leaves, so that the
+      // runs of the two sides do not line up.
+      for (size_t start = 0; start < 40; start += 3) {
+        auto size = values.size() - 40;
+        auto left = vector.slice(start, start + size);
+        auto right = vector.slice(40 - start, 40 - start + size);
+        auto pairs = IntegerKernels::apply(op, left, right);
+        auto same = IntegerKernels::apply(op, left, left);
+        auto scalarRight = IntegerKernels::apply(op, left, 7);
+        auto scalarLeft = IntegerKernels::apply(op, -7, left);
+        matched = matched && pairs.size() == size && same.size() == size &&
+                  scalarRight.size() == size && scalarLeft.size() == size;
+        for (size_t i = 0; matched && i < size; i++) {
+          matched = pairs[i] == expected(op, left[i], right[i]) &&
+                    same[i] == expected(op, left[i], left[i]) &&
+                    scalarRight[i] == expected(op, left[i], 7) &&
+                    scalarLeft[i] == expected(op, -7, left[i]);
+        }
+      }
+    }
+    REQUIRE(matched);
+
+    // Results longer than a leaf are laid out like pushed ones.
+    auto sums = IntegerKernels::apply(OP_PLUS, vector, vector);
+    auto pushed = vector;
+    for (size_t i = 0; i < 100; i++) {
+      sums.push_back(-1);
+      pushed.push_back(-1);
+    }
+    REQUIRE(IntegerKernels::sum(sums) == 2 * IntegerKernels::sum(vector) - 100);
+    REQUIRE(sums.size() == pushed.size());
+    REQUIRE(IntegerKernels::apply(OP_SLASH, std::numeric_limits<int64_t>::min(),
+                                  integers({-1}))[0] ==
+            std::numeric_limits<int64_t>::min());
+  });
+}
@@ -28,6 +28,10 @@ if (5 < 10) {
 "foobar"
 "foo bar"
 [1, 2];
+while (x) {}
+for (x in xs) {}
+{"foo": "bar"}
+record {a: 1}.a
 )";
 
   Token tests[] = {
@@ -58,6 +62,15 @@ if (5 < 10) {
       {SEMICOLON, ";"},  {STRING, "foobar"}, {STRING, "foo bar"},
       {LBRACKET, "["},   {INT, "1"},         {COMMA, ","},      
       {INT, "2"},        {RBRACKET, "]"},    {SEMICOLON, ";"},  
+      {WHILE, "while"},  {LPAREN, "("},      {IDENT, "x"},
+      {RPAREN, ")"},     {LBRACE, "{"},      {RBRACE, "}"},
+      {FOR, "for"},      {LPAREN, "("},      {IDENT, "x"},
+      {IN, "in"},        {IDENT, "xs"},      {RPAREN, ")"},
+      {LBRACE, "{"},     {RBRACE, "}"},      {LBRACE, "{"},
+      {STRING, "foo"},   {COLON, ":"},       {STRING, "bar"},
+      {RBRACE, "}"},     {RECORD, "record"}, {LBRACE, "{"},
+      {IDENT, "a"},      {COLON, ":"},       {INT, "1"},
+      {RBRACE, "}"},     {DOT, "."},         {IDENT, "a"},
       {EOF_, ""},
   };
 
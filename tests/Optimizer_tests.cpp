@@ -0,0 +1,294 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "AST.h"
+#include "Evaluator.h"
+#include "Lexer.h"
+#include "Optimizer.h"
+#include "Parser.h"
+#include "TypeInference.h"
+
+#include <memory>
+#include <string>
+
+ProgramPtr parse(const std::string &input) {
+  auto lexer = new Lexer(input);
+  auto parser = new Parser(lexer);
+  auto program = parser->parseProgram();
+  REQUIRE(parser->errors().empty());
+  return program;
+}
+
+std::string evaluateToString(const ProgramPtr &program) {
+  auto environment = std::make_shared<Environment>();
+  auto evaluator = Evaluator(environment);
+  return evaluator.evaluate(program)->inspect();
+}
+
+TEST_CASE("Optimizer: constant folding") {
+  typedef struct {
+    std::string input;
+    std::string expected;
+    int rewritten;
+  } ConstantFoldingTest;
+
+  ConstantFoldingTest tests[] = {
+      {"1 + 2 * 3", "7", 2},
+      {"-5 + 10", "5", 2},
+      {"(10 - 4) / 3 < 3", "true", 3},
+      {"!true == false", "true", 2},
+      {R"("foo" + "bar")", "foobar", 1},
+      {R"("foo" == "fo" + "o")", "true", 2},
+      {R"("foo" != "bar")", "true", 1},
+      {"1 / 0", "(1 / 0)", 0},
+      {"x + 1 * 2", "(x + 2)", 1},
+      {"1 + true", "(1 + true)", 0},
+  };
+
+  for (const auto &test : tests) {
+    auto program = parse(test.input);
+    ConstantFoldingPass pass;
+    REQUIRE(pass.run(program) == test.rewritten);
+    REQUIRE(program->string() == test.expected);
+  }
+}
+
+TEST_CASE("Optimizer: dead branch elimination") {
+  typedef struct {
+    std::string input;
+    std::string expected;
+    int rewritten;
+  } DeadBranchTest;
+
+  DeadBranchTest tests[] = {
+      {"let x = if (true) { 1 } else { 2 };", "let x = 1;", 2},
+      {"let x = if (false) { 1 } else { 2 };", "let x = 2;", 2},
+      {"let x = if (false) { 1 };", "let x = iffalse ;", 1},
+      {"if (true) { let a = 1; a } 5", "let a = 1;a5", 1},
+      {"if (false) { let a = 1; a } 5", "5", 2},
+      {"if (x) { 1 } else { 2 }", "ifx 1else 2", 0},
+  };
+
+  for (const auto &test : tests) {
+    auto program = parse(test.input);
+    DeadBranchEliminationPass pass;
+    REQUIRE(pass.run(program) == test.rewritten);
+    REQUIRE(program->string() == test.expected);
+  }
+}
+
+TEST_CASE("Optimizer: inlining") {
+  typedef struct {
+    std::string input;
+    std::string expected;
+    int rewritten;
+  } InliningTest;
+
+  InliningTest tests[] = {
+      {"let double = fn(x) { x * 2 }; double(4);",
+       "let double = fn(x) (x * 2);(4 * 2)", 1},
+      {"let add = fn(a, b) { return a + b; }; let y = 1; add(y, 3);",
+       "let add = fn(ab) return (a + b);;let y = 1;(y + 3)", 1},
+      {"let fact = fn(n) { fact(n - 1) }; fact(3);",
+       "let fact = fn(n) fact((n - 1));fact(3)", 0},
+      {"let sq = fn(x) { x * x }; let f = fn(a) { sq(a + 1) }; 1;",
+       "let sq = fn(x) (x * x);let f = fn(a) sq((a + 1));1", 0},
+      {"let double = fn(x) { x * 2 }; let f = fn(double) { double(2) };",
+       "let double = fn(x) (x * 2);let f = fn(double) double(2);", 0},
+      {"double(1); let double = fn(x) { x * 2 };",
+       "double(1)let double = fn(x) (x * 2);", 0},
+      {"len([1, 2, 3]) + len(\"four\")", "(3 + 4)", 2},
+      {"len(\"naïve\")", "5", 1},
+      {"let a = [1, 2, 3]; first(a) + last(a) + a[1];",
+       "let a = [1, 2, 3];((1 + 3) + (a[1]))", 2},
+      {"let a = [1, 2]; push(a, 3); len(a);",
+       "let a = [1, 2];push(a, 3)len(a)", 0},
+      {"let len = fn(x) { 0 }; len(1) + len([1]);",
+       "let len = fn(x) 0;(0 + len([1]))", 1},
+      {"let a = [1, 2]; a[0] = 3; first(a);",
+       "let a = [1, 2];((a[0]) = 3)first(a)", 0},
+      {"let double = fn(x) { x * 2 }; double = fn(x) { x }; double(1);",
+       "let double = fn(x) (x * 2);(double = fn(x) x)double(1)", 0},
+  };
+
+  for (const auto &test : tests) {
+    auto program = parse(test.input);
+    InliningPass pass;
+    REQUIRE(pass.run(program) == test.rewritten);
+    REQUIRE(program->string() == test.expected);
+  }
+}
+
+TEST_CASE("Optimizer: levels") {
+  auto input = "let sq = fn(x) { x * x }; if (sq(3) > 5) { 1 } else { 2 }";
+
+  auto program = parse(input);
+  auto reports = Optimizer(O0).optimize(program);
+  REQUIRE(reports.empty());
+
+  program = parse(input);
+  reports = Optimizer(O1).optimize(program);
+  REQUIRE(reports.size() == 3);
+  REQUIRE(reports[0].rewritten == 0);
+  REQUIRE(reports[1].rewritten == 0);
+  REQUIRE(reports[2].name == "type-inference");
+
+  program = parse(input);
+  reports = Optimizer(O2).optimize(program);
+  REQUIRE(reports.size() == 4);
+  REQUIRE(reports[0].name == "constant-folding");
+  REQUIRE(reports[0].rewritten == 2);
+  REQUIRE(reports[1].rewritten == 2);
+  REQUIRE(reports[2].name == "inlining");
+  REQUIRE(reports[2].rewritten == 1);
+  REQUIRE(program->string() == "let sq = fn(x) (x * x);1");
+}
+
+TEST_CASE("Optimizer: optimized programs evaluate the same") {
+  std::string inputs[] = {
+      "let fib = fn(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2); };"
+      "fib(10) + (2 * 3 - 1);",
+      "let a = [1, 2, 3]; let sq = fn(x) { x * x }; sq(len(a)) + first(a);",
+      "let f = fn(x) { if (1 > 2) { return 0; } x + 1 }; f(1);",
+      "if (true) { 1 } 2 * 2;",
+      "let x = 1; if (false) { 3 }",
+      R"(let greet = fn(name) { "hello " + name }; greet("monkey"))",
+      "let a = [1, 2, 3]; let s = 0; for (x in a) { let s = s + x * len(a); }; "
+      "s",
+      "let i = 0; let n = 0; while (i < 5) { let n = n + i; let i = i + 1; }; "
+      "n",
+      "let inc = fn(x) { x + 1 }; let x = 0; for (inc in [fn(x) { x * 2 }]) "
+      "{ let x = inc(3); }; x + inc(1)",
+      "let a = [1, 2, 3]; a[1] = 5; first(a) + a[1] + len(a)",
+      "let n = 1; let f = fn(x) { x + n }; n = 10; f(1)",
+  };
+
+  for (const auto &input : inputs) {
+    auto expected = evaluateToString(parse(input));
+    auto program = parse(input);
+    Optimizer(O2).optimize(program);
+    REQUIRE(evaluateToString(program) == expected);
+  }
+}
+
+TEST_CASE("Optimizer: folding keeps runtime errors") {
+  typedef struct {
+    std::string input;
+    std::string expected;
+  } ParityTest;
+
+  ParityTest tests[] = {
+      {"len([nope])", "ERROR: identifier not found: nope"},
+      {"len([1 + \"a\", 2])", "ERROR: type mismatch: INTEGER + STRING"},
+      {"len([[1][5], 2])", "2"},
+      {"first([nope, 1])", "ERROR: identifier not found: nope"},
+      {"len([1, \"a\", true])", "3"},
+  };
+
+  for (const auto &test : tests) {
+    auto unoptimized = parse(test.input);
+    Optimizer(O0).optimize(unoptimized);
+    REQUIRE(evaluateToString(unoptimized) == test.expected);
+    auto optimized = parse(test.input);
+    Optimizer(O2).optimize(optimized);
+    REQUIRE(evaluateToString(optimized) == test.expected);
+  }
+}
+
+TEST_CASE("Optimizer: inlining keeps the order arguments fail in") {
+  typedef struct {
+    std::string input;
+    std::string expected;
+  } ParityTest;
+
+  ParityTest tests[] = {
+      {"let f = fn(a, b) { b + a }; f(nopea, nopeb)",
+       "ERROR: identifier not found: nopea"},
+      {"let f = fn(a, b) { a + b }; f(nopea, nopeb)",
+       "ERROR: identifier not found: nopea"},
+      {"let f = fn(a, b) { (a - 1) + b }; f(\"x\", nope)",
+       "ERROR: identifier not found: nope"},
+      {"let f = fn(a, b) { b - a }; f(1, nope)",
+       "ERROR: identifier not found: nope"},
+      {"let f = fn(a, b) { b - a }; f(1, 5)", "4"},
+  };
+
+  for (const auto &test : tests) {
+    for (auto level : {O0, O1, O2}) {
+      auto program = parse(test.input);
+      Optimizer(level).optimize(program);
+      REQUIRE(evaluateToString(program) == test.expected);
+    }
+  }
+}
+
+ExpressionPtr expressionAt(const ProgramPtr &program, size_t index) {
+  auto statement = program->statements[index];
+  if (statement->nodeType() == LET_STATEMENT)
+    return std::dynamic_pointer_cast<LetStatement>(statement)->value;
+  return std::dynamic_pointer_cast<ExpressionStatement>(statement)->expression;
+}
+
+TEST_CASE("Optimizer: type inference") {
+  auto program = parse("let a = 1; let b = a * 2; let s = \"x\"; "
+                       "a + b; a < b; s + s; !s; a == true;");
+  TypeInferencePass pass;
+  REQUIRE(pass.run(program) > 0);
+  REQUIRE(expressionAt(program, 1)->staticType == TYPE_INTEGER);
+  REQUIRE(expressionAt(program, 3)->staticType == TYPE_INTEGER);
+  REQUIRE(expressionAt(program, 4)->staticType == TYPE_BOOLEAN);
+  REQUIRE(expressionAt(program, 5)->staticType == TYPE_UNKNOWN);
+  REQUIRE(expressionAt(program, 6)->staticType == TYPE_BOOLEAN);
+  REQUIRE(expressionAt(program, 7)->staticType == TYPE_UNKNOWN);
+  REQUIRE(pass.run(program) == 0);
+}
+
+TEST_CASE("Optimizer: type inference with loops") {
+  auto program = parse("let i = 0; for (x in [1, true]) { let i = i + 1; x; }; "
+                       "i + 1; x;");
+  TypeInferencePass pass;
+  pass.run(program);
+  REQUIRE(expressionAt(program, 2)->staticType == TYPE_INTEGER);
+  REQUIRE(expressionAt(program, 3)->staticType == TYPE_UNKNOWN);
+}
+
+TEST_CASE("Optimizer: type inference with assignments") {
+  auto program = parse("let a = 1; let b = 2; b = b + 1; a = true; a; b;");
+  TypeInferencePass pass;
+  pass.run(program);
+  REQUIRE(expressionAt(program, 2)->staticType == TYPE_INTEGER);
+  REQUIRE(expressionAt(program, 4)->staticType == TYPE_UNKNOWN);
+  REQUIRE(expressionAt(program, 5)->staticType == TYPE_INTEGER);
+}
+
+TEST_CASE("Optimizer: type inference through functions") {
+  auto program = parse(
+      "let fib = fn(n) { if (n < 2) { return n; } fib(n - 1) + fib(n - 2); };"
+      "let id = fn(x) { x }; let apply = fn(f, x) { f(x) };"
+      "fib(10); id(1) + id(2); apply(id, 3) + 1; id(\"s\");");
+  TypeInferencePass pass;
+  pass.run(program);
+
+  auto fib = std::dynamic_pointer_cast<FunctionLiteralExpression>(
+      expressionAt(program, 0));
+  auto body = std::dynamic_pointer_cast<ExpressionStatement>(
+      fib->body->statements[1]);
+  REQUIRE(body->expression->staticType == TYPE_INTEGER);
+  REQUIRE(expressionAt(program, 3)->staticType == TYPE_INTEGER);
+  // id escapes through apply and is also called with a string.
+  REQUIRE(expressionAt(program, 4)->staticType == TYPE_UNKNOWN);
+  REQUIRE(expressionAt(program, 5)->staticType == TYPE_UNKNOWN);
+}
+
+TEST_CASE("Optimizer: unboxed evaluation falls back on wrong guesses") {
+  auto program = parse("let inc = fn(n) { n + 1 }; inc(1);");
+  Optimizer(O1).optimize(program);
+  auto environment = std::make_shared<Environment>();
+  auto evaluator = Evaluator(environment);
+  REQUIRE(evaluator.evaluate(program)->inspect() == "2");
+
+  // A later REPL line calling inc with a string still reports the error.
+  auto next = parse("inc(\"a\")");
+  Optimizer(O1).optimize(next);
+  REQUIRE(evaluator.evaluate(next)->inspect() ==
+          "ERROR: type mismatch: STRING + INTEGER");
+}
@@ -507,6 +507,23 @@ TEST_CASE("Parser: string literal expression") {
   REQUIRE(literal->tokenLiteral() == "hello world");
 }
 
+TEST_CASE("Parser: string literals must be UTF-8") {
+  auto valid = new Parser(new Lexer("\"h\xc3\xa9llo \xe2\x82\xac \xf0\x9f\x98\x80\""));
+  valid->parseProgram();
+  checkErrors(valid->errors());
+
+  // A stray continuation byte, a truncated sequence, an overlong encoding
+  // and a surrogate.
+  std::string inputs[] = {"\"a\x80\"", "\"\xe2\x82\"", "\"\xc0\xaf\"",
+                          "\"\xed\xa0\x80\""};
+  for (const auto &input : inputs) {
+    auto parser = new Parser(new Lexer(input));
+    parser->parseProgram();
+    REQUIRE(parser->errors() ==
+            std::vector<std::string>{"String literal is not valid UTF-8"});
+  }
+}
+
 TEST_CASE("Parser: array literal expression"){
   std::string input = R"([1, 2 * 2, 3 + 3])";
 
@@ -548,3 +565,189 @@ TEST_CASE("Parser: index expression"){
   testIdentifier(indexExpression->left, "myArray");
   testInfixExpression(indexExpression->index, 1, "+", 1);
 }
+
+TEST_CASE("Parser: hash literals") {
+  std::string input = R"({"one": 1, "two": 2 * 2, three: 3 + 3})";
+
+  auto lexer = new Lexer(input);
+  auto parser = new Parser(lexer);
+  auto program = parser->parseProgram();
+  checkErrors(parser->errors());
+
+  REQUIRE(program->statements.size() == 1);
+  auto expressionStatement =
+      dynamic_cast<ExpressionStatement *>(program->statements[0].get());
+  REQUIRE(expressionStatement != nullptr);
+
+  auto hash = dynamic_cast<HashLiteralExpression *>(
+      expressionStatement->expression.get());
+  REQUIRE(hash != nullptr);
+  REQUIRE(hash->pairs.size() == 3);
+  REQUIRE(hash->pairs[0].first->string() == "one");
+  REQUIRE(testIntegerLiteral(hash->pairs[0].second, 1));
+  REQUIRE(testInfixExpression(hash->pairs[1].second, 2, "*", 2));
+  REQUIRE(testIdentifier(hash->pairs[2].first, "three"));
+  REQUIRE(testInfixExpression(hash->pairs[2].second, 3, "+", 3));
+  REQUIRE(program->string() == "{one: 1, two: (2 * 2), three: (3 + 3)}");
+
+  auto empty = (new Parser(new Lexer("{}")))->parseProgram();
+  REQUIRE(empty->string() == "{}");
+}
+
+TEST_CASE("Parser: malformed hash literals") {
+  std::string inputs[] = {"{1}", "{1: 2 3: 4}", "{1: 2,", "{: 1}"};
+
+  for (const auto &input : inputs) {
+    auto lexer = new Lexer(input);
+    auto parser = new Parser(lexer);
+    parser->parseProgram();
+    REQUIRE(!parser->errors().empty());
+  }
+}
+
+TEST_CASE("Parser: records and fields") {
+  std::string input = R"(record {name: "x", score: 2 * 3})";
+
+  auto lexer = new Lexer(input);
+  auto parser = new Parser(lexer);
+  auto program = parser->parseProgram();
+  checkErrors(parser->errors());
+
+  REQUIRE(program->statements.size() == 1);
+  auto expressionStatement =
+      dynamic_cast<ExpressionStatement *>(program->statements[0].get());
+  REQUIRE(expressionStatement != nullptr);
+  auto record = dynamic_cast<RecordLiteralExpression *>(
+      expressionStatement->expression.get());
+  REQUIRE(record != nullptr);
+  REQUIRE(record->names == std::vector<std::string>{"name", "score"});
+  REQUIRE(testInfixExpression(record->values[1], 2, "*", 3));
+
+  // Field access binds like indexing.
+  std::pair<std::string, std::string> tests[] = {
+      {"r.a", "(r.a)"},
+      {"r.a.b", "((r.a).b)"},
+      {"-r.a * 2", "((-(r.a)) * 2)"},
+      {"f(x).a[0]", "((f(x).a)[0])"},
+      {"r.a = r.b + 1", "((r.a) = ((r.b) + 1))"},
+      {"record {}", "record {}"},
+      {"record {a: 1}.a", "(record {a: 1}.a)"},
+  };
+  for (const auto &[input, expected] : tests) {
+    auto parser = new Parser(new Lexer(input));
+    auto program = parser->parseProgram();
+    checkErrors(parser->errors());
+    REQUIRE(program->string() == expected);
+  }
+}
+
+TEST_CASE("Parser: malformed records") {
+  std::string inputs[] = {"record {a: 1, a: 2}", "record {1: 2}",
+                          "record a", "r.1", "record {a 1}"};
+
+  for (const auto &input : inputs) {
+    auto lexer = new Lexer(input);
+    auto parser = new Parser(lexer);
+    parser->parseProgram();
+    REQUIRE(!parser->errors().empty());
+  }
+}
+
+TEST_CASE("Parser: while expression") {
+  std::string input = "while (x < y) { x }";
+
+  auto lexer = new Lexer(input);
+  auto parser = new Parser(lexer);
+  auto program = parser->parseProgram();
+  checkErrors(parser->errors());
+
+  REQUIRE(program->statements.size() == 1);
+  auto expressionStatement =
+      dynamic_cast<ExpressionStatement *>(program->statements[0].get());
+  REQUIRE(expressionStatement != nullptr);
+
+  auto whileExpression =
+      dynamic_cast<WhileExpression *>(expressionStatement->expression.get());
+  REQUIRE(whileExpression != nullptr);
+  REQUIRE(testInfixExpression(whileExpression->condition, std::string("x"),
+                              "<", std::string("y")));
+
+  REQUIRE(whileExpression->body->statements.size() == 1);
+  auto body = dynamic_cast<ExpressionStatement *>(
+      whileExpression->body->statements[0].get());
+  REQUIRE(body != nullptr);
+  REQUIRE(testIdentifier(body->expression, "x"));
+}
+
+TEST_CASE("Parser: for expression") {
+  std::string input = "for (x in [1, 2]) { x; y }";
+
+  auto lexer = new Lexer(input);
+  auto parser = new Parser(lexer);
+  auto program = parser->parseProgram();
+  checkErrors(parser->errors());
+
+  REQUIRE(program->statements.size() == 1);
+  auto expressionStatement =
+      dynamic_cast<ExpressionStatement *>(program->statements[0].get());
+  REQUIRE(expressionStatement != nullptr);
+
+  auto forExpression =
+      dynamic_cast<ForExpression *>(expressionStatement->expression.get());
+  REQUIRE(forExpression != nullptr);
+  REQUIRE(forExpression->variable->value == "x");
+  auto iterable =
+      dynamic_cast<ArrayLiteralExpression *>(forExpression->iterable.get());
+  REQUIRE(iterable != nullptr);
+  REQUIRE(iterable->elements.size() == 2);
+  REQUIRE(forExpression->body->statements.size() == 2);
+  REQUIRE(program->string() == "for(x in [1, 2]) xy");
+}
+
+TEST_CASE("Parser: malformed for expression") {
+  std::string input = "for (x [1, 2]) { x }";
+
+  auto lexer = new Lexer(input);
+  auto parser = new Parser(lexer);
+  parser->parseProgram();
+  REQUIRE(!parser->errors().empty());
+}
+
+TEST_CASE("Parser: assignments") {
+  typedef struct {
+    std::string input;
+    std::string expected;
+  } AssignmentTest;
+
+  AssignmentTest tests[] = {
+      {"x = 5;", "(x = 5)"},
+      {"x = y = 1 + 2", "(x = (y = (1 + 2)))"},
+      {"a[i + 1] = a[i] * 2", "((a[(i + 1)]) = ((a[i]) * 2))"},
+      {"x = y == z", "(x = (y == z))"},
+  };
+
+  for (const auto &test : tests) {
+    auto lexer = new Lexer(test.input);
+    auto parser = new Parser(lexer);
+    auto program = parser->parseProgram();
+    checkErrors(parser->errors());
+    REQUIRE(program->statements.size() == 1);
+    auto statement =
+        dynamic_cast<ExpressionStatement *>(program->statements[0].get());
+    REQUIRE(statement != nullptr);
+    REQUIRE(dynamic_cast<AssignExpression *>(statement->expression.get()) !=
+            nullptr);
+    REQUIRE(program->string() == test.expected);
+  }
+}
+
+TEST_CASE("Parser: invalid assignment targets") {
+  std::string inputs[] = {"1 = 2", "f() = 1", "1 + x = 2"};
+
+  for (const auto &input : inputs) {
+    auto lexer = new Lexer(input);
+    auto parser = new Parser(lexer);
+    parser->parseProgram();
+    REQUIRE(!parser->errors().empty());
+  }
+}
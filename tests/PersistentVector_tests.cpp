@@ -0,0 +1,130 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "PersistentVector.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace {
+
+// Large enough for a trie three levels deep below the root.
+constexpr int largeSize = 32 * 32 * 32 + 100;
+
+std::vector<int> toVector(const PersistentVector<int> &vector) {
+  return std::vector<int>(vector.begin(), vector.end());
+}
+
+} // namespace
+
+TEST_CASE("PersistentVector: push and index across levels") {
+  PersistentVector<int> vector;
+  REQUIRE(vector.empty());
+  REQUIRE(vector.begin() == vector.end());
+
+  bool pushed = true;
+  for (int i = 0; i < largeSize; i++) {
+    vector.push_back(i);
+    pushed = pushed && vector.size() == static_cast<size_t>(i + 1) &&
+             vector.back() == i;
+  }
+  REQUIRE(pushed);
+
+  bool indexed = true;
+  for (int i = 0; i < largeSize; i++)
+    indexed = indexed && vector[i] == i;
+  REQUIRE(indexed);
+
+  std::vector<int> expected;
+  for (int i = 0; i < largeSize; i++)
+    expected.push_back(i);
+  REQUIRE(toVector(vector) == expected);
+}
+
+TEST_CASE("PersistentVector: versions do not see each other's changes") {
+  PersistentVector<int> original;
+  for (int i = 0; i < 2000; i++)
+    original.push_back(i);
+
+  auto changed = original;
+  changed.set(0, -1);
+  changed.set(1500, -2);
+  changed.set(1999, -3);
+  changed.push_back(2000);
+
+  REQUIRE(original.size() == 2000);
+  REQUIRE(original[0] == 0);
+  REQUIRE(original[1500] == 1500);
+  REQUIRE(original[1999] == 1999);
+  REQUIRE(changed.size() == 2001);
+  REQUIRE(changed[0] == -1);
+  REQUIRE(changed[1500] == -2);
+  REQUIRE(changed[1999] == -3);
+  REQUIRE(changed[2000] == 2000);
+
+  // Unshared again, the copy is updated in place.
+  changed.set(1500, 7);
+  REQUIRE(changed[1500] == 7);
+  REQUIRE(original[1500] == 1500);
+}
+
+TEST_CASE("PersistentVector: slices are windows onto the same elements") {
+  PersistentVector<int> vector;
+  for (int i = 0; i < 100; i++)
+    vector.push_back(i);
+
+  auto middle = vector.slice(10, 20);
+  REQUIRE(middle.size() == 10);
+  REQUIRE(middle.front() == 10);
+  REQUIRE(middle.back() == 19);
+  REQUIRE(toVector(middle.slice(8, 10)) == std::vector<int>{18, 19});
+  REQUIRE(vector.slice(100, 100).empty());
+
+  // Pushing onto a slice replaces what followed it only in the slice.
+  middle.push_back(-1);
+  middle.push_back(-2);
+  REQUIRE(toVector(middle.slice(9, 12)) == std::vector<int>{19, -1, -2});
+  REQUIRE(vector[20] == 20);
+  REQUIRE(vector[21] == 21);
+
+  // Dropping the first element over and over reaches every element.
+  auto rest = vector;
+  for (int i = 0; i < 100; i++) {
+    REQUIRE(rest.front() == i);
+    rest = rest.slice(1, rest.size());
+  }
+  REQUIRE(rest.empty());
+  rest.push_back(42);
+  REQUIRE(rest.front() == 42);
+  REQUIRE(vector.back() == 99);
+}
+
+TEST_CASE("PersistentVector: construction from a range") {
+  std::vector<int> values;
+  for (int i = 0; i < 1000; i++)
+    values.push_back(i * 3);
+  PersistentVector<int> vector(values.begin(), values.end());
+  REQUIRE(toVector(vector) == values);
+}
+
+TEST_CASE("PersistentVector: generation a leaf at a time") {
+  std::vector<int> expected;
+  for (int i = 0; i < largeSize; i++)
+    expected.push_back(i * 2);
+  auto vector = PersistentVector<int>::generate(
+      largeSize, [](int *values, size_t index, size_t count) {
+        for (size_t i = 0; i < count; i++)
+          values[i] = static_cast<int>(index + i) * 2;
+      });
+  REQUIRE(toVector(vector) == expected);
+
+  // It grows and shares like any other vector.
+  auto longer = vector;
+  longer.push_back(-1);
+  longer.set(5, -2);
+  REQUIRE(longer.size() == vector.size() + 1);
+  REQUIRE(longer.back() == -1);
+  REQUIRE(longer[5] == -2);
+  REQUIRE(vector[5] == 10);
+  REQUIRE(PersistentVector<int>::generate(0, [](int *, size_t, size_t) {})
+              .empty());
+}
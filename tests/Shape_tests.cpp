@@ -0,0 +1,34 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "Shape.h"
+
+TEST_CASE("Shape: adding fields") {
+  auto empty = Shape::empty();
+  REQUIRE(empty->size() == 0);
+  REQUIRE(empty->find("a") == nullptr);
+
+  auto ab = empty->with("a")->with("b");
+  REQUIRE(ab->size() == 2);
+  REQUIRE(ab->field(0).name == "a");
+  REQUIRE(ab->field(1).name == "b");
+
+  auto b = ab->find("b");
+  REQUIRE(b != nullptr);
+  REQUIRE(b->slot == 1);
+  REQUIRE(b->shape == ab);
+  REQUIRE(ab->find("c") == nullptr);
+}
+
+TEST_CASE("Shape: layouts are shared") {
+  auto empty = Shape::empty();
+  REQUIRE(empty->with("a")->with("b") == empty->with("a")->with("b"));
+  REQUIRE(empty->with("a")->with("b") != empty->with("b")->with("a"));
+
+  // A field of a longer shape is told apart from the same field of its
+  // parent.
+  auto a = empty->with("a");
+  auto ab = a->with("b");
+  REQUIRE(a->find("a") != ab->find("a"));
+  REQUIRE(a->find("a")->slot == ab->find("a")->slot);
+  REQUIRE(ab->find("a")->shape == ab);
+}
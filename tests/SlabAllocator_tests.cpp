@@ -0,0 +1,119 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "Environment.h"
+#include "Evaluator.h"
+#include "Lexer.h"
+#include "Object.h"
+#include "Parser.h"
+#include "SlabAllocator.h"
+
+#include <barrier>
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+
+TEST_CASE("SlabAllocator: blocks are recycled") {
+  auto first = SlabAllocator::allocate(24);
+  auto second = SlabAllocator::allocate(24);
+  REQUIRE(first != second);
+  REQUIRE(reinterpret_cast<uintptr_t>(first) % alignof(std::max_align_t) ==
+          0);
+  SlabAllocator::deallocate(second, 24);
+  // Sizes of the same class share a free list.
+  REQUIRE(SlabAllocator::allocate(32) == second);
+  SlabAllocator::deallocate(second, 32);
+  SlabAllocator::deallocate(first, 24);
+
+  // Refilling carves a new slab into distinct blocks.
+  std::set<void *> blocks;
+  for (int i = 0; i < 5000; i++)
+    blocks.insert(SlabAllocator::allocate(24));
+  REQUIRE(blocks.size() == 5000);
+  for (auto block : blocks)
+    SlabAllocator::deallocate(block, 24);
+}
+
+TEST_CASE("SlabAllocator: empty slabs are returned") {
+  auto reserved = SlabAllocator::slabsReserved();
+  std::vector<void *> blocks;
+  for (int i = 0; i < 100000; i++)
+    blocks.push_back(SlabAllocator::allocate(48));
+  REQUIRE(SlabAllocator::slabsReserved() > reserved + 50);
+  for (auto block : blocks)
+    SlabAllocator::deallocate(block, 48);
+  // Only the slab blocks are taken from next is kept.
+  REQUIRE(SlabAllocator::slabsReserved() <= reserved + 1);
+}
+
+TEST_CASE("SlabAllocator: blocks freed on other threads are reused") {
+  constexpr int rounds = 20;
+  // About 20 slabs a round.
+  std::vector<void *> blocks(20000);
+  auto reserved = SlabAllocator::slabsReserved();
+
+  // A thread that keeps allocating what another one frees.
+  std::barrier sync(2);
+  std::thread worker([&] {
+    for (int round = 0; round < rounds; round++) {
+      for (auto &block : blocks)
+        block = SlabAllocator::allocate(64);
+      sync.arrive_and_wait();
+      sync.arrive_and_wait();
+    }
+  });
+  for (int round = 0; round < rounds; round++) {
+    sync.arrive_and_wait();
+    for (auto block : blocks)
+      SlabAllocator::deallocate(block, 64);
+    sync.arrive_and_wait();
+  }
+  worker.join();
+  REQUIRE(SlabAllocator::slabsReserved() <= reserved + 25);
+
+  // Threads that exit while their blocks are still in use, each leaving its
+  // slabs to the next.
+  for (int round = 0; round < rounds; round++) {
+    std::thread([&] {
+      for (auto &block : blocks)
+        block = SlabAllocator::allocate(64);
+    }).join();
+    for (auto block : blocks)
+      SlabAllocator::deallocate(block, 64);
+  }
+  REQUIRE(SlabAllocator::slabsReserved() <= reserved + 50);
+}
+
+TEST_CASE("SlabAllocator: objects are counted per type") {
+  auto before = allocationStats<IntegerObject>();
+  {
+    std::vector<ObjectPtr> integers;
+    for (int i = 0; i < 10; i++)
+      integers.push_back(makeRef<IntegerObject>(i));
+    auto during = allocationStats<IntegerObject>();
+    REQUIRE(during.live == before.live + 10);
+    REQUIRE(during.peak >= during.live);
+    REQUIRE(during.total == before.total + 10);
+  }
+  auto after = allocationStats<IntegerObject>();
+  REQUIRE(after.live == before.live);
+  REQUIRE(after.peak >= before.live + 10);
+}
+
+TEST_CASE("SlabAllocator: evaluation releases objects and frames") {
+  auto integers = allocationStats<IntegerObject>();
+  auto environments = allocationStats<Environment>();
+  {
+    auto lexer = new Lexer("let sum = fn(n) { if (n == 0) { return 0; } "
+                           "n + sum(n - 1) }; sum(50);");
+    auto program = (new Parser(lexer))->parseProgram();
+    auto environment = std::make_shared<Environment>();
+    auto evaluator = Evaluator(environment);
+    auto result = evaluator.evaluate(program);
+    REQUIRE(dynamicRefCast<IntegerObject>(result)->value == 1275);
+    REQUIRE(allocationStats<IntegerObject>().total > integers.total);
+    REQUIRE(allocationStats<Environment>().peak > environments.live);
+  }
+  REQUIRE(allocationStats<IntegerObject>().live == integers.live);
+  REQUIRE(allocationStats<Environment>().live == environments.live);
+}
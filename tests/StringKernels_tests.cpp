@@ -0,0 +1,98 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "StringKernels.h"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+// Runs `check` with the AVX2 loops, where supported, and with the plain ones.
+template <typename F> void withEachKernel(F check) {
+  auto vectorized = StringKernels::vectorized();
+  for (auto enabled : {true, false}) {
+    StringKernels::useVectorized(enabled);
+    check();
+  }
+  StringKernels::useVectorized(vectorized);
+}
+
+} // namespace
+
+TEST_CASE("StringKernels: UTF-8 validation") {
+  std::vector<std::string> valid = {
+      "", "a", "\x7f", "\xc2\x80", "\xdf\xbf", "\xe0\xa0\x80", "\xed\x9f\xbf",
+      "\xee\x80\x80", "\xef\xbf\xbf", "\xf0\x90\x80\x80", "\xf4\x8f\xbf\xbf"};
+  std::vector<std::string> invalid = {
+      // Stray continuation bytes and bytes that never appear.
+      "\x80", "\xbf", "\xf8\x88\x80\x80\x80", "\xff",
+      // Sequences cut short, or followed by too many continuation bytes.
+      "\xc2", "\xe0\xa0", "\xf0\x90\x80", "\xc2\x80\x80", "\xc2" "a",
+      // Overlong encodings.
+      "\xc0\x80", "\xc1\xbf", "\xe0\x9f\xbf", "\xf0\x8f\xbf\xbf",
+      // Surrogates and code points beyond U+10FFFF.
+      "\xed\xa0\x80", "\xed\xbf\xbf", "\xf4\x90\x80\x80", "\xf5\x80\x80\x80"};
+
+  withEachKernel([&] {
+    // At every offset around the 32-byte blocks, surrounded by ASCII and by
+    // other multibyte sequences.
+    bool matched = true;
+    for (size_t offset = 0; offset < 70; offset++) {
+      for (auto filler : {std::string("x"), std::string("\xe2\x82\xac")}) {
+        std::string prefix;
+        while (prefix.size() < offset)
+          prefix += filler;
+        for (const auto &sequence : valid)
+          matched &= StringKernels::isValidUtf8(prefix + sequence + prefix);
+        for (const auto &sequence : invalid) {
+          matched &= !StringKernels::isValidUtf8(prefix + sequence + prefix);
+          matched &= !StringKernels::isValidUtf8(prefix + sequence);
+        }
+      }
+    }
+    REQUIRE(matched);
+  });
+}
+
+TEST_CASE("StringKernels: counting code points") {
+  withEachKernel([] {
+    REQUIRE(StringKernels::countCodePoints("") == 0);
+    REQUIRE(StringKernels::countCodePoints("hello") == 5);
+    REQUIRE(StringKernels::countCodePoints("h\xc3\xa9llo \xe2\x82\xac "
+                                           "\xf0\x9f\x98\x80") == 9);
+
+    std::string text;
+    size_t expected = 0;
+    for (int i = 0; i < 100; i++) {
+      text += i % 3 == 0 ? "\xe6\x97\xa5" : i % 3 == 1 ? "ab" : "\xc3\xa9";
+      expected += i % 3 == 1 ? 2 : 1;
+      REQUIRE(StringKernels::countCodePoints(text) == expected);
+    }
+  });
+}
+
+TEST_CASE("StringKernels: substring search") {
+  // Near misses everywhere: the first and last bytes of the patterns occur
+  // far more often than the patterns.
+  std::string text;
+  for (int i = 0; i < 300; i++)
+    text += "abcab"[i * 7 % 5];
+  text += "abcabcabd";
+  std::vector<std::string> patterns = {"",    "a",     "d",        "ab",
+                                       "abd", "cabca", "abcabcabd", "abcx",
+                                       "x",   text,    text + "a"};
+
+  withEachKernel([&] {
+    bool matched = true;
+    for (const auto &pattern : patterns) {
+      for (size_t start = 0; start < 70; start++) {
+        auto haystack = std::string_view(text).substr(start);
+        matched &= StringKernels::find(haystack, pattern) ==
+                   haystack.find(pattern);
+      }
+    }
+    REQUIRE(matched);
+    REQUIRE(StringKernels::find("", "a") == std::string_view::npos);
+    REQUIRE(StringKernels::find(std::string(100, 'a') + "b", "ab") == 99);
+  });
+}
@@ -0,0 +1,75 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "WorkStealingPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Sums [begin, end) by splitting it in halves down to small ranges.
+int64_t parallelSum(WorkStealingPool &pool, int64_t begin, int64_t end) {
+  if (end - begin <= 64) {
+    int64_t sum = 0;
+    for (auto i = begin; i < end; i++)
+      sum += i;
+    return sum;
+  }
+  auto middle = begin + (end - begin) / 2;
+  int64_t left = 0;
+  TaskGroup tasks(pool);
+  tasks.run([&] { left = parallelSum(pool, begin, middle); });
+  auto right = parallelSum(pool, middle, end);
+  tasks.wait();
+  return left + right;
+}
+
+} // namespace
+
+TEST_CASE("WorkStealingPool: groups wait for their tasks") {
+  WorkStealingPool pool(3);
+  REQUIRE(pool.size() == 3);
+
+  std::atomic<int> done = 0;
+  {
+    TaskGroup tasks(pool);
+    for (int i = 0; i < 100; i++)
+      tasks.run([&done] { done++; });
+  }
+  REQUIRE(done == 100);
+  REQUIRE(pool.pendingTasks() == 0);
+}
+
+TEST_CASE("WorkStealingPool: tasks fork and join recursively") {
+  WorkStealingPool pool(4);
+  REQUIRE(parallelSum(pool, 0, 100000) == int64_t(100000) * 99999 / 2);
+
+  // Work spreads over the workers.
+  std::mutex mutex;
+  std::set<std::thread::id> threads;
+  {
+    TaskGroup tasks(pool);
+    for (int i = 0; i < 64; i++)
+      tasks.run([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        std::lock_guard lock(mutex);
+        threads.insert(std::this_thread::get_id());
+      });
+  }
+  REQUIRE(threads.size() > 1);
+}
+
+TEST_CASE("WorkStealingPool: a pool with no workers still has one") {
+  WorkStealingPool pool(0);
+  REQUIRE(pool.size() == 1);
+  int value = 0;
+  TaskGroup tasks(pool);
+  tasks.run([&value] { value = 42; });
+  tasks.wait();
+  REQUIRE(value == 42);
+}